@@ -0,0 +1,119 @@
+﻿#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Счётчик выделений памяти: все operator new программы проходят здесь
+static std::atomic<long long> allocationCount(0);
+
+long long AllocationCounter::count()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+// Указатели уходят сюда, чтобы компилятор не выбросил пары new/delete
+// (C++14 разрешает не выполнять выделения, результат которых не виден)
+static void* volatile selfTestSink;
+
+bool AllocationCounter::selfTest()
+{
+    // выравнивание больше стандартного: такие new идут через перегрузки с align_val_t
+    struct alignas(64) Line {
+        char bytes[64];
+    };
+    bool ok = true;
+    long long before = count();
+    int* value = new int(0);
+    selfTestSink = value;
+    ok = ok && count() == before + 1;
+    delete value;
+    before = count();
+    char* chars = new (std::nothrow) char[16];
+    selfTestSink = chars;
+    ok = ok && count() == before + 1;
+    delete[] chars;
+    before = count();
+    Line* line = new Line();
+    selfTestSink = line;
+    ok = ok && count() == before + 1 && reinterpret_cast<std::uintptr_t>(line) % alignof(Line) == 0;
+    delete line;
+    before = count();
+    Line* lines = new (std::nothrow) Line[3];
+    selfTestSink = lines;
+    ok = ok && count() == before + 1 && reinterpret_cast<std::uintptr_t>(lines) % alignof(Line) == 0;
+    delete[] lines;
+    before = count();
+    void* raw = ::operator new(100, std::align_val_t(256));
+    selfTestSink = raw;
+    ok = ok && count() == before + 1 && reinterpret_cast<std::uintptr_t>(raw) % 256 == 0;
+    ::operator delete(raw, 100, std::align_val_t(256));
+    selfTestSink = nullptr;
+    return ok;
+}
+
+namespace {
+
+// Выровненный блок поверх malloc: перед ним хранится указатель на начало
+// выделенного, его и освобождает alignedFree. Одинаково под MSVC и GCC, в
+// отличие от aligned_alloc/_aligned_malloc
+void* alignedAllocate(std::size_t size, std::align_val_t alignment)
+{
+    std::size_t align = (std::size_t)alignment < sizeof(void*) ? sizeof(void*) : (std::size_t)alignment;
+    void* raw = std::malloc(size + align + sizeof(void*));
+    if (!raw)
+        return nullptr;
+    std::uintptr_t block = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + align - 1) & ~(std::uintptr_t)(align - 1);
+    reinterpret_cast<void**>(block)[-1] = raw;
+    return reinterpret_cast<void*>(block);
+}
+
+void alignedFree(void* p)
+{
+    if (p)
+        std::free(static_cast<void**>(p)[-1]);
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = alignedAllocate(size, alignment))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return alignedAllocate(size, alignment);
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept { return operator new(size, alignment, tag); }
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
@@ -0,0 +1,15 @@
+﻿#pragma once
+// Счётчик выделений памяти в куче. AllocationCounter.cpp заменяет глобальные
+// operator new/delete, поэтому компилируется прямо в программу (не в
+// библиотеку pacman_sim: из архива компоновщик не взял бы эти определения).
+// Нужен, чтобы проверять, что горячие пути - такт симуляции, кадр - не
+// выделяют память.
+
+class AllocationCounter {
+public:
+    // Сколько раз с запуска программы вызывался operator new (из всех потоков)
+    static long long count();
+    // Проверяет, что счётчик видит все виды new: обычный, nothrow, массивы и
+    // выровненные (align_val_t, через них работает AlignedAllocator карты)
+    static bool selfTest();
+};
@@ -0,0 +1,101 @@
+﻿// Запекание ресурсов игры в пакет (формат - см. AssetPack.h).
+// Использование: PacManAssetBake [--root dir] [--out assets.pmas] [--cpp file.cpp]
+//                    [--image path scale ...] [--file path ...]
+// --image уменьшает картинку в scale раз (до размера на экране) и кладёт её
+// в пакет в RGBA, --file кладёт файл как есть. Имя ресурса - path, как его
+// запрашивает игра; читается он из root/path. --cpp пишет пакет исходником
+// с массивом байтов, который собирается вместе с игрой.
+#include <SFML/Graphics.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "AssetPack.h"
+
+static bool writeSource(const std::vector<std::uint8_t>& bytes, const char* path)
+{
+    std::ofstream out(path);
+    out << "// Сгенерировано PacManAssetBake из ресурсов игры, не редактировать\n"
+        << "#include <cstddef>\n\n"
+        << "extern const std::size_t PACMAN_ASSETS_SIZE = " << bytes.size() << ";\n"
+        << "alignas(8) extern const unsigned char PACMAN_ASSETS[] = {";
+    for (std::size_t i = 0; i < bytes.size(); ++i)
+        out << (i % 20 ? "" : "\n    ") << (unsigned)bytes[i] << ",";
+    out << "\n    0\n};\n";
+    return (bool)out;
+}
+
+int main(int argc, char** argv)
+{
+    std::string root = ".";
+    const char* packPath = nullptr;
+    const char* sourcePath = nullptr;
+    std::vector<AssetSource> assets;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--root") && i + 1 < argc)
+            root = argv[++i];
+        else if (!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            packPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--cpp") && i + 1 < argc)
+            sourcePath = argv[++i];
+        else if (!std::strcmp(argv[i], "--image") && i + 2 < argc) {
+            std::string name = argv[++i];
+            float scale = (float)std::atof(argv[++i]);
+            sf::Image image;
+            if (scale <= 0 || !image.loadFromFile(root + "/" + name)) {
+                std::cerr << "Error reading image " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+            AssetSource asset = { name, ASSET_RGBA, scaledSide(image.getSize().x, scale), scaledSide(image.getSize().y, scale), {} };
+            downscaleRgba(image.getPixelsPtr(), image.getSize().x, image.getSize().y, asset.width, asset.height, asset.bytes);
+            std::cout << name << ": " << image.getSize().x << "x" << image.getSize().y << " -> " << asset.width << "x" << asset.height << std::endl;
+            assets.push_back(std::move(asset));
+        }
+        else if (!std::strcmp(argv[i], "--file") && i + 1 < argc) {
+            std::string name = argv[++i];
+            std::ifstream in(root + "/" + name, std::ios::binary);
+            if (!in) {
+                std::cerr << "Error reading " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+            AssetSource asset = { name, ASSET_FILE, 0, 0, {} };
+            asset.bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            std::cout << name << ": " << asset.bytes.size() << " bytes" << std::endl;
+            assets.push_back(std::move(asset));
+        }
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--root dir] [--out assets.pmas] [--cpp file.cpp] [--image path scale ...] [--file path ...]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::uint8_t> bytes;
+    std::string error;
+    if (!AssetPack::build(assets, bytes, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    // проверяем собранный пакет тем же кодом, что и при загрузке
+    AssetPack pack;
+    if (!pack.view(bytes.data(), bytes.size(), error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (packPath) {
+        std::ofstream out(packPath, std::ios::binary);
+        out.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+        if (!out) {
+            std::cerr << "Error writing " << packPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (sourcePath && !writeSource(bytes, sourcePath)) {
+        std::cerr << "Error writing " << sourcePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << pack.size() << " assets, " << bytes.size() << " bytes" << std::endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+﻿#include "AssetPack.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char PACK_MAGIC[4] = { 'P', 'M', 'A', 'S' };
+
+std::size_t align4(std::size_t n) { return (n + 3) & ~(std::size_t)3; }
+
+}
+
+bool AssetPack::view(const void* data, std::size_t size, std::string& error)
+{
+    base = nullptr;
+    length = 0;
+    entries = nullptr;
+    count = 0;
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    const AssetPackHeader* pack = reinterpret_cast<const AssetPackHeader*>(bytes);
+    if (size < sizeof(AssetPackHeader) || reinterpret_cast<std::uintptr_t>(bytes) % alignof(AssetPackHeader)
+        || std::memcmp(pack->magic, PACK_MAGIC, 4) || pack->version != ASSET_PACK_VERSION) {
+        error = "not an asset pack";
+        return false;
+    }
+    if (pack->assetCount > (size - sizeof(AssetPackHeader)) / sizeof(AssetEntry)) {
+        error = "truncated asset table";
+        return false;
+    }
+    // Проверяем всё, на что потом полагаются загрузчики, чтобы дальше читать без проверок
+    const AssetEntry* table = reinterpret_cast<const AssetEntry*>(pack + 1);
+    for (std::uint32_t i = 0; i < pack->assetCount; ++i) {
+        const AssetEntry& entry = table[i];
+        std::string where = "asset " + std::to_string(i) + ": ";
+        if (!std::memchr(entry.name, 0, ASSET_NAME_SIZE) || (i && std::strcmp(table[i - 1].name, entry.name) >= 0)) {
+            error = where + "bad name";
+            return false;
+        }
+        if (entry.offset % 4 || entry.offset > size || entry.size > size - entry.offset) {
+            error = where + "bad offset";
+            return false;
+        }
+        if (entry.kind == ASSET_RGBA ? (std::uint64_t)entry.width * entry.height * 4 != entry.size : entry.kind != ASSET_FILE) {
+            error = where + "bad size";
+            return false;
+        }
+    }
+    base = bytes;
+    length = size;
+    entries = table;
+    count = (int)pack->assetCount;
+    return true;
+}
+
+const AssetEntry* AssetPack::find(const std::string& name) const
+{
+    const AssetEntry* end = entries + count;
+    const AssetEntry* it = std::lower_bound(entries, end, name, [](const AssetEntry& entry, const std::string& key) {
+        return std::strcmp(entry.name, key.c_str()) < 0;
+    });
+    return it != end && name == it->name ? it : nullptr;
+}
+
+bool AssetPack::build(std::vector<AssetSource> sources, std::vector<std::uint8_t>& out, std::string& error)
+{
+    std::sort(sources.begin(), sources.end(), [](const AssetSource& a, const AssetSource& b) { return a.name < b.name; });
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i].name.empty() || sources[i].name.size() >= (std::size_t)ASSET_NAME_SIZE) {
+            error = "bad asset name '" + sources[i].name + "'";
+            return false;
+        }
+        if (i && sources[i].name == sources[i - 1].name) {
+            error = "duplicate asset '" + sources[i].name + "'";
+            return false;
+        }
+        if (sources[i].kind == ASSET_RGBA && (std::size_t)sources[i].width * sources[i].height * 4 != sources[i].bytes.size()) {
+            error = "bad image size for '" + sources[i].name + "'";
+            return false;
+        }
+    }
+
+    std::size_t offset = sizeof(AssetPackHeader) + sources.size() * sizeof(AssetEntry);
+    std::vector<AssetEntry> table(sources.size());
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        AssetEntry& entry = table[i];
+        std::memset(&entry, 0, sizeof(entry));
+        std::memcpy(entry.name, sources[i].name.c_str(), sources[i].name.size());
+        entry.kind = sources[i].kind;
+        entry.width = sources[i].width;
+        entry.height = sources[i].height;
+        entry.offset = (std::uint32_t)offset;
+        entry.size = (std::uint32_t)sources[i].bytes.size();
+        offset = align4(offset + entry.size);
+    }
+
+    out.assign(offset, 0);
+    AssetPackHeader header = {};
+    std::memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = ASSET_PACK_VERSION;
+    header.assetCount = (std::uint32_t)sources.size();
+    std::memcpy(out.data(), &header, sizeof(header));
+    if (!table.empty())
+        std::memcpy(out.data() + sizeof(header), table.data(), table.size() * sizeof(AssetEntry));
+    for (std::size_t i = 0; i < sources.size(); ++i)
+        if (!sources[i].bytes.empty())
+            std::memcpy(out.data() + table[i].offset, sources[i].bytes.data(), sources[i].bytes.size());
+    return true;
+}
+
+std::uint32_t scaledSide(std::uint32_t side, float scale)
+{
+    return std::max<std::uint32_t>(1, (std::uint32_t)std::lround(side * scale));
+}
+
+void downscaleRgba(const std::uint8_t* source, std::uint32_t sourceWidth, std::uint32_t sourceHeight,
+    std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t>& out)
+{
+    out.assign((std::size_t)width * height * 4, 0);
+    for (std::uint32_t y = 0; y < height; ++y) {
+        std::uint32_t y0 = (std::uint32_t)((std::uint64_t)y * sourceHeight / height);
+        std::uint32_t y1 = std::max(y0 + 1, (std::uint32_t)((std::uint64_t)(y + 1) * sourceHeight / height));
+        for (std::uint32_t x = 0; x < width; ++x) {
+            std::uint32_t x0 = (std::uint32_t)((std::uint64_t)x * sourceWidth / width);
+            std::uint32_t x1 = std::max(x0 + 1, (std::uint32_t)((std::uint64_t)(x + 1) * sourceWidth / width));
+            std::uint64_t r = 0, g = 0, b = 0, a = 0, count = 0;
+            for (std::uint32_t sy = y0; sy < y1; ++sy)
+                for (std::uint32_t sx = x0; sx < x1; ++sx) {
+                    const std::uint8_t* p = source + ((std::size_t)sy * sourceWidth + sx) * 4;
+                    r += p[0] * p[3];
+                    g += p[1] * p[3];
+                    b += p[2] * p[3];
+                    a += p[3];
+                    count++;
+                }
+            std::uint8_t* q = &out[((std::size_t)y * width + x) * 4];
+            q[0] = a ? (std::uint8_t)(r / a) : 0;
+            q[1] = a ? (std::uint8_t)(g / a) : 0;
+            q[2] = a ? (std::uint8_t)(b / a) : 0;
+            q[3] = (std::uint8_t)(a / count);
+        }
+    }
+}
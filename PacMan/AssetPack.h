@@ -0,0 +1,76 @@
+﻿#pragma once
+// Пакет ресурсов: картинки и шрифт, запечённые при сборке в один блок байтов,
+// который вкомпилирован в программу (PacManAssetBake). Картинки лежат уже
+// уменьшенными до размера на экране, в RGBA, их не нужно ни читать с диска,
+// ни разбирать. Пакет читается прямо из памяти без копирования.
+//
+// Формат (little-endian, все поля выровнены):
+//   AssetPackHeader, затем AssetEntry[assetCount], отсортированные по имени,
+//   затем данные ресурсов; смещения - от начала пакета, кратны 4.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const std::uint32_t ASSET_PACK_VERSION = 1;
+const int ASSET_NAME_SIZE = 64;
+
+enum AssetKind : std::uint32_t {
+    ASSET_FILE,     // байты файла как есть (шрифт)
+    ASSET_RGBA      // картинка width x height, 4 байта на пиксель
+};
+
+struct AssetPackHeader {
+    char magic[4];                  // "PMAS"
+    std::uint32_t version;
+    std::uint32_t assetCount;
+    std::uint32_t reserved;
+};
+
+struct AssetEntry {
+    char name[ASSET_NAME_SIZE];     // путь, по которому ресурс лежал бы на диске; с нулём в конце
+    std::uint32_t kind;             // AssetKind
+    std::uint32_t width, height;    // для ASSET_RGBA
+    std::uint32_t offset, size;
+    std::uint32_t reserved;
+};
+
+// Ресурс для сборки пакета
+struct AssetSource {
+    std::string name;
+    AssetKind kind;
+    std::uint32_t width, height;
+    std::vector<std::uint8_t> bytes;
+};
+
+class AssetPack {
+private:
+    const std::uint8_t* base;
+    std::size_t length;
+    const AssetEntry* entries;
+    int count;
+public:
+    AssetPack() : base(nullptr), length(0), entries(nullptr), count(0) {}
+
+    // Пакет поверх готовых байтов, выровненных на 4; память не копируется
+    // и должна жить дольше пакета. false и текст ошибки в error, если байты повреждены
+    bool view(const void* data, std::size_t size, std::string& error);
+
+    int size() const { return count; }
+    const AssetEntry& get(int i) const { return entries[i]; }
+    // Ресурс по имени (двоичный поиск) или nullptr
+    const AssetEntry* find(const std::string& name) const;
+    const std::uint8_t* data(const AssetEntry& entry) const { return base + entry.offset; }
+
+    // Собирает пакет; имена должны быть короче ASSET_NAME_SIZE и не повторяться
+    static bool build(std::vector<AssetSource> sources, std::vector<std::uint8_t>& out, std::string& error);
+};
+
+// Размер картинки side после уменьшения в scale раз, не меньше одного пикселя
+std::uint32_t scaledSide(std::uint32_t side, float scale);
+
+// Уменьшение RGBA-картинки усреднением по площади: пиксель результата -
+// среднее накрытых им исходных пикселей с весом по прозрачности, чтобы
+// прозрачный фон не темнил края. Общее для запекания и загрузки с диска.
+void downscaleRgba(const std::uint8_t* source, std::uint32_t sourceWidth, std::uint32_t sourceHeight,
+    std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t>& out);
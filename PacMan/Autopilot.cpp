@@ -0,0 +1,345 @@
+﻿#include "Autopilot.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "ThreadPool.h"
+
+namespace {
+    const float LIFE_PENALTY = 500.0f;      // потерянная жизнь в очках
+    const float WIN_BONUS = 1000.0f;
+    const double REWARD_SCALE = 50.0;       // очки, соответствующие единице в формуле UCT
+    const double EXPLORATION = 1.0;
+    const double DISTANCE_WEIGHT = 1.0;     // очков за клетку до ближайшей точки в конце доигрыша
+    // ход обычно занимает одну клетку; упёршийся в стену Пакман стоит не дольше двух
+    const int MOVE_TICKS_LIMIT = 2 * (MOVE_STEP / speedPerTick(PACMAN_SPEED) + 1);
+
+    const int REVERSE[4] = { 1, 0, 3, 2 };
+}
+
+AutopilotInput::AutopilotInput(const Simulation& world, const AutopilotSettings& settings, ThreadPool* pool)
+    : world(world), settings(settings), pool(pool), trees(settings.trees > 0 ? settings.trees : pool ? pool->size() : 1), direction(-1), ticksLeft(0), ready(false)
+{
+    for (std::size_t i = 0; i < trees.size(); ++i) {
+        trees[i].random.setSeed(settings.seed + i);
+        // на узел сверх предела уходит не больше четырёх детей
+        trees[i].nodes.reserve(settings.maxNodes + 4);
+        trees[i].compacted.reserve(settings.maxNodes + 4);
+        // путь от корня не длиннее числа узлов
+        trees[i].path.reserve(settings.maxNodes + 4);
+    }
+}
+
+bool AutopilotInput::Tree::reset(const Simulation& source, const GameSnapshot& root)
+{
+    if (!world || world->getPacmanStartX() != source.getPacmanStartX() || world->getPacmanStartY() != source.getPacmanStartY()
+        || !world->restore(root)) {
+        world.reset(new Simulation(source.getLevel(), source.getPacmanStartX(), source.getPacmanStartY(), 1));
+        if (!world->restore(root))
+            return false;
+    }
+    nodes.clear();
+    Node node = {};
+    node.state = root;
+    node.parent = -1;
+    node.firstChild = -1;
+    node.action = -1;
+    node.simulated = true;
+    nodes.push_back(node);
+    return true;
+}
+
+float AutopilotInput::Tree::move(int direction, int& ticks, bool& terminal)
+{
+    const Pacman& pacman = world->getPacman();
+    const int x = pacman.getX(), y = pacman.getY();
+    const int points = pacman.getPoints(), lives = pacman.getLives();
+    float bonus = 0;
+    ticks = 0;
+    terminal = false;
+    while (ticks < MOVE_TICKS_LIMIT) {
+        int result = world->step(direction);
+        if (result) {
+            terminal = true;
+            if (result == 1)
+                bonus = WIN_BONUS;
+            break;
+        }
+        ticks++;
+        if (pacman.getX() != x || pacman.getY() != y)
+            break;
+    }
+    if (!pacman.getLives())
+        terminal = true;
+    return (pacman.getPoints() - points) - LIFE_PENALTY * (lives - pacman.getLives()) + bonus;
+}
+
+void AutopilotInput::Tree::expand(int node)
+{
+    world->restore(nodes[node].state);
+    const Pacman& pacman = world->getPacman();
+    const int cell = world->getMap().cellId(pacman.getNextY(), pacman.getNextX());
+    nodes[node].firstChild = (int)nodes.size();
+    for (int d = 0; d < 4; ++d)
+        if (world->getGraph().canMove(cell, d)) {
+            Node child = {};
+            child.parent = node;
+            child.firstChild = -1;
+            child.action = (std::int8_t)d;
+            nodes.push_back(child);
+            nodes[node].childCount++;
+        }
+}
+
+void AutopilotInput::Tree::simulate(int node)
+{
+    Node& child = nodes[node];
+    world->restore(nodes[child.parent].state);
+    int ticks;
+    child.reward = move(child.action, ticks, child.terminal);
+    child.ticks = (std::uint8_t)ticks;
+    world->clone(child.state);
+    child.simulated = true;
+}
+
+int AutopilotInput::Tree::select(int node) const
+{
+    const Node& parent = nodes[node];
+    const double logVisits = std::log((double)parent.visits + 1);
+    int best = parent.firstChild;
+    double bestScore = -1e300;
+    for (int c = parent.firstChild; c < parent.firstChild + parent.childCount; ++c) {
+        const Node& child = nodes[c];
+        if (!child.visits)
+            return c;
+        double score = child.value / child.visits / REWARD_SCALE + EXPLORATION * std::sqrt(logVisits / child.visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = c;
+        }
+    }
+    return best;
+}
+
+int AutopilotInput::Tree::nearestPellet()
+{
+    const Map& map = world->getMap();
+    const MazeGraph& graph = world->getGraph();
+    const CellSet& pellets = map.getPellets();
+    if (distance.size() != map.cellCount()) {
+        distance.assign(map.cellCount(), -1);
+        queue.reserve(map.cellCount());
+    }
+    const Pacman& pacman = world->getPacman();
+    queue.clear();
+    queue.push_back(map.cellId(pacman.getY(), pacman.getX()));
+    distance[queue[0]] = 0;
+    int result = 0;
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        int cell = queue[head];
+        if (pellets.contains(cell)) {
+            result = distance[cell];
+            break;
+        }
+        for (int d = 0; d < 4; ++d) {
+            int next = graph.step(cell, d);
+            if (graph.canMove(cell, d) && distance[next] < 0) {
+                distance[next] = distance[cell] + 1;
+                queue.push_back(next);
+            }
+        }
+    }
+    // сбрасываются только тронутые клетки
+    for (int cell : queue)
+        distance[cell] = -1;
+    return result;
+}
+
+double AutopilotInput::Tree::rollout(int moves)
+{
+    double total = 0;
+    int options[4];
+    for (int k = 0; k < moves; ++k) {
+        const Pacman& pacman = world->getPacman();
+        const int cell = world->getMap().cellId(pacman.getNextY(), pacman.getNextX());
+        // разворот - только из тупика: случайное блуждание туда-обратно ничего не оценивает
+        int count = 0;
+        for (int d = 0; d < 4; ++d)
+            if (world->getGraph().canMove(cell, d) && d != REVERSE[pacman.getNextDirection()])
+                options[count++] = d;
+        int direction = count ? options[random.nextInt(count)] : REVERSE[pacman.getNextDirection()];
+        int ticks;
+        bool terminal;
+        total += move(direction, ticks, terminal);
+        if (terminal)
+            return total;
+    }
+    return total - DISTANCE_WEIGHT * nearestPellet();
+}
+
+void AutopilotInput::Tree::iterate(const AutopilotSettings& settings)
+{
+    // Выбор: спуск по UCT до нового узла; новый лист сначала только
+    // оценивается доигрышем, раскрывается при следующем посещении
+    path.clear();
+    path.push_back(0);
+    int node = 0;
+    bool fresh = false;
+    while (!nodes[node].terminal) {
+        if (nodes[node].firstChild < 0) {
+            if ((node && !nodes[node].visits) || (int)nodes.size() + 4 > settings.maxNodes)
+                break;
+            expand(node);
+            if (!nodes[node].childCount)
+                break;
+        }
+        node = select(node);
+        path.push_back(node);
+        if (!nodes[node].simulated) {
+            simulate(node);
+            fresh = true;
+            break;
+        }
+    }
+    if (!fresh)
+        world->restore(nodes[node].state);
+
+    double value = nodes[node].terminal ? 0 : rollout(settings.rolloutMoves);
+    for (std::size_t i = path.size() - 1; i > 0; --i) {
+        Node& n = nodes[path[i]];
+        value += n.reward;
+        n.value += value;
+        n.visits++;
+    }
+    nodes[0].visits++;
+    iterations++;
+}
+
+void AutopilotInput::Tree::advance(int action, const Node* fallback)
+{
+    const Node& root = nodes[0];
+    int child = -1;
+    for (int c = root.firstChild; root.firstChild >= 0 && c < root.firstChild + root.childCount; ++c)
+        if (nodes[c].action == action && nodes[c].simulated)
+            child = c;
+    if (child < 0) {
+        // ход в этом дереве ещё не пробовали: корень берётся из другого дерева
+        GameSnapshot state = fallback->state;
+        nodes.clear();
+        Node node = {};
+        node.state = state;
+        node.parent = -1;
+        node.firstChild = -1;
+        node.action = -1;
+        node.simulated = true;
+        node.terminal = fallback->terminal;
+        nodes.push_back(node);
+        return;
+    }
+
+    // Поддерево выбранного хода переносится в начало второго буфера обходом
+    // в ширину: дети по-прежнему идут подряд, прочие ветви отбрасываются
+    compacted.clear();
+    compacted.push_back(nodes[child]);
+    compacted[0].parent = -1;
+    for (std::size_t i = 0; i < compacted.size(); ++i) {
+        const int first = compacted[i].firstChild;
+        if (first < 0)
+            continue;
+        compacted[i].firstChild = (int)compacted.size();
+        for (int c = first; c < first + compacted[i].childCount; ++c) {
+            compacted.push_back(nodes[c]);
+            compacted.back().parent = (int)i;
+        }
+    }
+    nodes.swap(compacted);
+}
+
+void AutopilotInput::search()
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(settings.budgetMicros);
+    const AutopilotSettings& limits = settings;
+    auto run = [&limits, deadline](Tree& tree) {
+        if (limits.iterations > 0) {
+            for (int i = 0; i < limits.iterations; ++i)
+                tree.iterate(limits);
+            return;
+        }
+        do
+            tree.iterate(limits);
+        while (std::chrono::steady_clock::now() < deadline);
+    };
+    if (!pool) {
+        for (Tree& tree : trees)
+            run(tree);
+        return;
+    }
+    // ждём только свои деревья: пул может быть общим с обновлением призраков
+    pool->parallelFor(0, (int)trees.size(), 1, [this, &run](int i) { run(trees[i]); });
+}
+
+int AutopilotInput::decide()
+{
+    // Решение по сумме посещений: самый проверенный ход, а не самый удачный
+    int visits[4] = { 0, 0, 0, 0 };
+    for (const Tree& tree : trees) {
+        const Node& root = tree.nodes[0];
+        for (int c = root.firstChild; root.firstChild >= 0 && c < root.firstChild + root.childCount; ++c)
+            visits[tree.nodes[c].action] += tree.nodes[c].visits;
+    }
+    int best = -1;
+    for (int d = 0; d < 4; ++d)
+        if (visits[d] > 0 && (best < 0 || visits[d] > visits[best]))
+            best = d;
+    return best;
+}
+
+int AutopilotInput::getDirection()
+{
+    if (ticksLeft > 0) {
+        // идём к клетке следующего решения, а дерево тем временем растёт из неё
+        search();
+        ticksLeft--;
+        return direction;
+    }
+    if (!world.clone(current)) {
+        ready = false;
+        return -1;
+    }
+    // Мир разошёлся с предсказанием (новая партия, ввод со стороны): деревья заново
+    if (!ready || std::memcmp(&trees[0].nodes[0].state, &current, sizeof(GameSnapshot))) {
+        for (Tree& tree : trees)
+            if (!tree.reset(world, current)) {
+                ready = false;
+                return -1;
+            }
+    }
+    search();
+    direction = decide();
+    if (direction < 0) {
+        ready = false;
+        return -1;
+    }
+
+    const Node* chosen = nullptr;
+    for (const Tree& tree : trees) {
+        const Node& root = tree.nodes[0];
+        for (int c = root.firstChild; !chosen && root.firstChild >= 0 && c < root.firstChild + root.childCount; ++c)
+            if (tree.nodes[c].action == direction && tree.nodes[c].simulated)
+                chosen = &tree.nodes[c];
+    }
+    ticksLeft = chosen->ticks - 1;
+    // копия: advance() переписывает узлы того дерева, где лежит chosen
+    const Node fallback = *chosen;
+    for (Tree& tree : trees)
+        tree.advance(direction, &fallback);
+    ready = true;
+    return direction;
+}
+
+long long AutopilotInput::getIterations() const
+{
+    long long total = 0;
+    for (const Tree& tree : trees)
+        total += tree.iterations;
+    return total;
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+// Автопилот: игрок, который выбирает направление поиском по дереву
+// Монте-Карло (UCT) над копиями мира. Ход дерева - направление, которое
+// держится до перехода Пакмана в следующую клетку; каждый узел хранит
+// GameSnapshot после своего хода, поэтому спуск по дереву - это restore(),
+// а не повтор тактов. Оценка листа - короткий случайный доигрыш плюс
+// расстояние до ближайшей точки.
+//
+// Деревья независимы: у каждого рабочего потока своё дерево, свой мир и
+// свой генератор, решение принимается по сумме посещений корневых ходов
+// всех деревьев. При бюджете в итерациях и заданном числе деревьев
+// результат не зависит от числа потоков и порядка их работы.
+// Между тактами дерево не выбрасывается: пока Пакман доходит до клетки
+// следующего решения, поиск идёт уже из неё, и при совпадении мира с
+// предсказанием накопленное поддерево переезжает в корень.
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Simulation.h"
+
+class ThreadPool;
+
+struct AutopilotSettings {
+    int budgetMicros = 1000;    // время поиска на такт
+    int iterations = 0;         // если больше нуля - итераций на такт в каждом дереве вместо времени
+    int trees = 0;              // 0 - по числу потоков пула (без пула одно)
+    int maxNodes = 4096;        // предел узлов одного дерева; дальше дерево не растёт, доигрыши продолжаются
+    int rolloutMoves = 4;       // ходов в случайном доигрыше
+    std::uint64_t seed = 1;
+};
+
+class AutopilotInput : public InputManager {
+private:
+    struct Node {
+        GameSnapshot state;     // мир после хода, действителен при simulated
+        int parent;
+        int firstChild;         // дети идут подряд; -1 - узел не раскрыт
+        std::int8_t childCount;
+        std::int8_t action;     // направление хода из родителя
+        std::uint8_t ticks;     // тактов в ходе
+        bool simulated;
+        bool terminal;          // партия закончилась: победа или последняя жизнь
+        int visits;
+        double value;           // сумма оценок доигрышей через этот узел
+        float reward;           // очки за ход с учётом потерянных жизней
+    };
+
+    // Дерево одного рабочего потока вместе с его миром
+    struct Tree {
+        std::vector<Node> nodes;        // nodes[0] - корень
+        std::vector<Node> compacted;    // второй буфер для переноса поддерева в корень
+        std::vector<int> path;
+        std::vector<int> queue;
+        std::vector<int> distance;
+        std::unique_ptr<Simulation> world;
+        Random random;
+        long long iterations = 0;
+
+        // Корень - снимок root мира source; мир дерева пересоздаётся, если source на другом уровне
+        bool reset(const Simulation& source, const GameSnapshot& root);
+        void iterate(const AutopilotSettings& settings);
+        int select(int node) const;
+        void expand(int node);
+        void simulate(int node);
+        float move(int direction, int& ticks, bool& terminal);
+        double rollout(int moves);
+        int nearestPellet();
+        void advance(int action, const Node* fallback);
+    };
+
+    const Simulation& world;
+    AutopilotSettings settings;
+    ThreadPool* pool;
+    std::vector<Tree> trees;
+    GameSnapshot current;
+    int direction;
+    int ticksLeft;              // тактов до следующего решения
+    bool ready;                 // корни деревьев - предсказанное состояние следующего решения
+
+    void search();
+    int decide();
+public:
+    // world - мир, в котором играет автопилот; пул может быть nullptr,
+    // тогда одно дерево считается в вызывающем потоке
+    AutopilotInput(const Simulation& world, const AutopilotSettings& settings, ThreadPool* pool = nullptr);
+    int getDirection() override;
+
+    // Итераций поиска за всё время, по всем деревьям
+    long long getIterations() const;
+    // Узлов в дереве первого потока
+    int getNodeCount() const { return (int)trees[0].nodes.size(); }
+};
@@ -0,0 +1,36 @@
+﻿#include "BatchRunner.h"
+#include <algorithm>
+
+EpisodeResult BatchRunner::runEpisode(Simulation& world, int level, std::uint64_t seed, InputManager& input) const
+{
+    world.load(levels.get(level), seed);
+    EpisodeResult episode = { seed, level, 0, 0, 0 };
+    while (episode.ticks < maxTicks) {
+        episode.result = world.step(input.getDirection());
+        if (episode.result)
+            break;
+        episode.ticks++;
+    }
+    episode.points = world.getPacman().getPoints();
+    return episode;
+}
+
+std::vector<EpisodeResult> BatchRunner::run(std::uint64_t firstSeed, int episodes, const InputFactory& makeInput)
+{
+    std::vector<EpisodeResult> results(episodes);
+    // куски поменьше, чтобы было что перехватывать под конец прогона
+    int grain = std::max(1, episodes / ((int)pool.size() * 16));
+    for (int first = 0; first < episodes; first += grain) {
+        int last = std::min(episodes, first + grain);
+        pool.submit([this, first, last, firstSeed, &makeInput, &results] {
+            Simulation world(levels.get(first % levels.size()), firstSeed + (std::uint64_t)first);
+            for (int i = first; i < last; ++i) {
+                std::uint64_t seed = firstSeed + (std::uint64_t)i;
+                std::unique_ptr<InputManager> input = makeInput(seed, world);
+                results[i] = runEpisode(world, i % levels.size(), seed, *input);
+            }
+        });
+    }
+    pool.wait();
+    return results;
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+// Пакетный прогон независимых партий на пуле потоков: каждая партия
+// начинается с чистого мира (Simulation::load) и своего игрока, созданных по
+// зерну партии, поэтому результат партии зависит только от зерна и уровня,
+// а не от того, какой поток и в каком порядке её выполнил. Мир создаётся
+// один раз на кусок партий и переиспользуется.
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Simulation.h"
+#include "ThreadPool.h"
+
+struct EpisodeResult {
+    std::uint64_t seed;
+    int level;          // номер уровня в пакете
+    int result;         // 1 - победа, 2 - поражение, 0 - не закончилась за отведённые такты
+    int points;
+    long long ticks;
+};
+
+// Создаёт игрока для партии с данным зерном; world - мир, в котором пойдёт
+// партия (ещё не загружен). Вызывается из рабочих потоков
+using InputFactory = std::function<std::unique_ptr<InputManager>(std::uint64_t seed, const Simulation& world)>;
+
+class BatchRunner {
+private:
+    ThreadPool& pool;
+    const LevelPack& levels;
+    long long maxTicks;     // предел длины одной партии
+public:
+    BatchRunner(ThreadPool& pool, const LevelPack& levels, long long maxTicks)
+        : pool(pool), levels(levels), maxTicks(maxTicks) {}
+
+    // Партии с зёрнами firstSeed, firstSeed + 1, ...; i-я партия идёт на
+    // уровне i % число уровней. Результаты в том же порядке.
+    std::vector<EpisodeResult> run(std::uint64_t firstSeed, int episodes, const InputFactory& makeInput);
+    // Одна партия на мире world, который перед этим загружается заново
+    EpisodeResult runEpisode(Simulation& world, int level, std::uint64_t seed, InputManager& input) const;
+};
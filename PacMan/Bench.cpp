@@ -0,0 +1,415 @@
+﻿// Микробенчмарки горячих путей симуляции с фиксированными зёрнами.
+// Использование: PacManBench [--filter строка] [--min-time секунды] [--out file.json]
+//                            [--baseline base.json] [--tolerance проценты]
+// Результат - JSON: для каждого замера ns/op, выделений памяти на операцию и
+// операций в секунду (у замеров step операция - один такт, то есть это ticks/sec).
+// С --baseline каждый замер сравнивается с сохранённым прогоном; если какой-то
+// стал медленнее больше чем на tolerance процентов или стал выделять память,
+// программа завершается с ошибкой.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Simulation.h"
+#include "Autopilot.h"
+#include "AllocationCounter.h"
+
+// Измеряемая часть замера: подготовка между start() и stop() не считается
+class Meter {
+private:
+    std::chrono::steady_clock::time_point started;
+    long long allocationsAtStart;
+public:
+    double nanoseconds = 0;
+    long long allocations = 0;
+    void start() {
+        allocationsAtStart = AllocationCounter::count();
+        started = std::chrono::steady_clock::now();
+    }
+    void stop() {
+        auto finished = std::chrono::steady_clock::now();
+        nanoseconds += std::chrono::duration<double, std::nano>(finished - started).count();
+        allocations += AllocationCounter::count() - allocationsAtStart;
+    }
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(long long ops, Meter& meter)> run;   // выполняет ops операций
+};
+
+struct BenchResult {
+    std::string name;
+    long long ops;
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+// Сценарии - классический лабиринт с правками, собранный через fromAscii
+static std::string editClassic(const std::function<void(std::vector<std::string>& rows)>& edit)
+{
+    std::vector<std::string> rows;
+    std::istringstream in(LevelPack::classicAscii());
+    std::string line;
+    while (std::getline(in, line) && !line.empty())
+        rows.push_back(line);
+    std::string rest;
+    while (std::getline(in, line))
+        rest += line + "\n";
+    edit(rows);
+    std::string text;
+    for (const std::string& row : rows)
+        text += row + "\n";
+    return text + "\n" + rest;
+}
+
+static void buildScenarios(LevelPack& pack)
+{
+    // frightened: большая точка сразу справа от старта Пакмана (14, 26)
+    std::string frightened = editClassic([](std::vector<std::string>& rows) {
+        rows[26][15] = 'O';
+    });
+    // endgame: меньше 20 точек, Pinky сразу переходит на ускоренную погоню
+    std::string endgame = editClassic([](std::vector<std::string>& rows) {
+        for (int y = 0; y < (int)rows.size(); ++y)
+            for (int x = 0; x < (int)rows[y].size(); ++x)
+                if ((rows[y][x] == 'o' || rows[y][x] == 'O') && !(y == 26 && x >= 7 && x <= 22))
+                    rows[y][x] = ' ';
+    });
+    std::vector<std::uint8_t> bytes;
+    std::string error;
+    if (!LevelPack::fromAscii({ LevelPack::classicAscii(), frightened, endgame }, bytes, error) || !pack.assign(std::move(bytes), error)) {
+        std::cerr << "Error building scenarios: " << error << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+// Игрок с фиксированным зерном: держит направление, иногда меняет
+class ScriptedInput {
+private:
+    Random random;
+    int direction;
+public:
+    explicit ScriptedInput(std::uint64_t seed) : random(seed), direction(3) {}
+    int next() {
+        if (random.nextInt(40) == 0)
+            direction = random.nextInt(4);
+        return direction;
+    }
+};
+
+// Такты партии на уровне level; партия начинается заново после окончания
+// и каждые episodeTicks тактов (сброс в замер не входит)
+static Benchmark stepBenchmark(const std::string& name, const Level& level, int extraGhosts, long long episodeTicks)
+{
+    return { name, [&level, extraGhosts, episodeTicks](long long ops, Meter& meter) {
+        Simulation simulation(level, 1);
+        for (int i = 0; i < extraGhosts; ++i)
+            simulation.addGhost(static_cast<GhostArchetype>(i % ARCHETYPE_COUNT));
+        ScriptedInput input(1);
+        // разогрев: рабочие массивы такта выделяются при первых тактах, а не в замере
+        for (long long t = 0; t < episodeTicks; ++t)
+            if (simulation.step(input.next()))
+                break;
+        simulation.reset();
+        long long done = 0;
+        while (done < ops) {
+            long long segment = ops - done < episodeTicks ? ops - done : episodeTicks;
+            int result = 0;
+            meter.start();
+            for (long long t = 0; t < segment && !result; ++t, ++done)
+                result = simulation.step(input.next());
+            meter.stop();
+            simulation.reset();
+        }
+    } };
+}
+
+static std::vector<Benchmark> makeBenchmarks(const LevelPack& scenarios)
+{
+    const Level& early = scenarios.get(0);
+    const Level& frightened = scenarios.get(1);
+    const Level& endgame = scenarios.get(2);
+    std::vector<Benchmark> benchmarks;
+
+    benchmarks.push_back(stepBenchmark("step/early", early, 0, 600));
+    // испуг длится 300 тактов после большой точки на первом шаге
+    benchmarks.push_back(stepBenchmark("step/frightened", frightened, 0, 300));
+    benchmarks.push_back(stepBenchmark("step/endgame", endgame, 0, 600));
+    benchmarks.push_back(stepBenchmark("step/early_1000_ghosts", early, 1000, 600));
+
+    benchmarks.push_back({ "reset", [&early](long long ops, Meter& meter) {
+        Simulation simulation(early, 1);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            simulation.reset();
+        meter.stop();
+    } });
+    benchmarks.push_back({ "load", [&early, &endgame](long long ops, Meter& meter) {
+        Simulation simulation(early, 1);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            simulation.load(i & 1 ? endgame : early, (std::uint64_t)i);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "load_builtin", [&endgame](long long ops, Meter& meter) {
+        // как load, но каждый второй раз встроенный уровень: его индексы посчитаны при компиляции
+        const Level& builtin = LevelPack::builtin().get(0);
+        Simulation simulation(builtin, 1);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            simulation.load(i & 1 ? endgame : builtin, (std::uint64_t)i);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "load_same_level", [&early](long long ops, Meter& meter) {
+        // новая партия на том же уровне, как в пакете из одного уровня: без перестройки индексов
+        Simulation simulation(early, 1);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            simulation.load(early, (std::uint64_t)i);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "Map::load", [&early](long long ops, Meter& meter) {
+        Map map;
+        map.load(early);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            map.load(early);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "DistanceField::compute", [&early](long long ops, Meter& meter) {
+        Map map;
+        map.load(early);
+        DistanceField field;
+        std::vector<int> queue;
+        field.compute(map, map.cellId(26, 14), queue);
+        const int targets[2] = { map.cellId(26, 14), map.cellId(4, 2) };
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            field.compute(map, targets[i & 1], queue);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "checksum", [&early](long long ops, Meter& meter) {
+        Simulation simulation(early, 1);
+        std::uint64_t sink = 0;
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            sink += simulation.checksum();
+        meter.stop();
+        if (sink == 42)
+            std::cerr << "";
+    } });
+    benchmarks.push_back({ "clone", [&early](long long ops, Meter& meter) {
+        Simulation simulation(early, 1);
+        for (int t = 0; t < 200; ++t)
+            simulation.step(t / 16 % 4);
+        GameSnapshot snapshot;
+        std::uint64_t sink = 0;
+        meter.start();
+        for (long long i = 0; i < ops; ++i) {
+            simulation.clone(snapshot);
+            sink += snapshot.random;
+        }
+        meter.stop();
+        if (sink == 42)
+            std::cerr << "";
+    } });
+    benchmarks.push_back({ "restore", [&early](long long ops, Meter& meter) {
+        // откат попеременно к двум снимкам, между которыми съедено несколько точек
+        Simulation simulation(early, 1);
+        GameSnapshot snapshots[2];
+        for (int t = 0; t < 300; ++t) {
+            if (t == 100)
+                simulation.clone(snapshots[0]);
+            simulation.step(t / 16 % 4);
+        }
+        simulation.clone(snapshots[1]);
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            simulation.restore(snapshots[i & 1]);
+        meter.stop();
+    } });
+    benchmarks.push_back({ "reachablePellets", [&early](long long ops, Meter& meter) {
+        // заливка по битовым слоям из клетки Пакмана через весь лабиринт
+        Simulation simulation(early, 1);
+        simulation.step(3);
+        int sink = simulation.reachablePellets().count();
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            sink += simulation.reachablePellets().count();
+        meter.stop();
+        if (sink == 42)
+            std::cerr << "";
+    } });
+    benchmarks.push_back({ "collisions_1000_ghosts", [&early](long long ops, Meter& meter) {
+        // постройка корзин и поиск попаданий, как в конце каждого такта
+        Simulation simulation(early, 1);
+        for (int i = 0; i < 1000; ++i)
+            simulation.addGhost(static_cast<GhostArchetype>(i % ARCHETYPE_COUNT));
+        for (int t = 0; t < 200; ++t)
+            simulation.step(t / 30 % 4);
+        GhostStore ghosts = simulation.getGhosts();
+        Pacman pacman = simulation.getPacman();
+        SpatialHash hash;
+        std::vector<int> hits;
+        const int w = simulation.getMap().getW(), h = simulation.getMap().getH();
+        hash.build(ghosts.x.data(), ghosts.y.data(), ghosts.size(), w, h);
+        meter.start();
+        for (long long i = 0; i < ops; ++i) {
+            hash.build(ghosts.x.data(), ghosts.y.data(), ghosts.size(), w, h);
+            detectCollisions(ghosts, hash, pacman.getX(), pacman.getY(), pacman.getX() + 1, pacman.getY(), hits);
+        }
+        meter.stop();
+    } });
+    benchmarks.push_back({ "autopilot_tick", [&early](long long ops, Meter& meter) {
+        // такт игры автопилотом с фиксированным числом итераций поиска:
+        // нагрузка на step/clone/restore в том виде, в каком её даёт поиск
+        Simulation simulation(early, 1);
+        AutopilotSettings settings;
+        settings.iterations = 4;
+        AutopilotInput autopilot(simulation, settings);
+        simulation.step(autopilot.getDirection());
+        meter.start();
+        for (long long i = 0; i < ops; ++i)
+            if (simulation.step(autopilot.getDirection()))
+                simulation.reset();
+        meter.stop();
+    } });
+    return benchmarks;
+}
+
+// Удваивает число операций, пока измеряемая часть не займёт minSeconds
+static BenchResult measure(const Benchmark& benchmark, double minSeconds)
+{
+    long long ops = 1;
+    for (;;) {
+        Meter meter;
+        benchmark.run(ops, meter);
+        if (meter.nanoseconds >= minSeconds * 1e9 || ops >= (1LL << 40))
+            return { benchmark.name, ops, meter.nanoseconds / ops, (double)meter.allocations / ops };
+        ops *= meter.nanoseconds > 0 && meter.nanoseconds < minSeconds * 1e8 ? 10 : 2;
+    }
+}
+
+static std::string toJson(const std::vector<BenchResult>& results)
+{
+    std::ostringstream out;
+    out << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "    { \"name\": \"%s\", \"ops\": %lld, \"ns_per_op\": %.2f, \"allocs_per_op\": %.6f, \"ops_per_sec\": %.1f }%s\n",
+            r.name.c_str(), r.ops, r.nsPerOp, r.allocsPerOp, r.nsPerOp > 0 ? 1e9 / r.nsPerOp : 0.0, i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// Читает файл в формате toJson(): по одному замеру в строке
+static bool readBaseline(const char* path, std::map<std::string, BenchResult>& baseline)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::size_t name = line.find("\"name\": \"");
+        std::size_t ns = line.find("\"ns_per_op\": ");
+        std::size_t allocs = line.find("\"allocs_per_op\": ");
+        if (name == std::string::npos || ns == std::string::npos || allocs == std::string::npos)
+            continue;
+        name += 9;
+        BenchResult r;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.ops = 0;
+        r.nsPerOp = std::atof(line.c_str() + ns + 13);
+        r.allocsPerOp = std::atof(line.c_str() + allocs + 17);
+        baseline[r.name] = r;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* outPath = nullptr;
+    const char* baselinePath = nullptr;
+    double minSeconds = 0.2;
+    double tolerance = 15;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--min-time") && i + 1 < argc)
+            minSeconds = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            outPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc)
+            tolerance = std::atof(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--filter text] [--min-time seconds] [--out file.json]"
+                << " [--baseline base.json] [--tolerance percent]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::map<std::string, BenchResult> baseline;
+    if (baselinePath && !readBaseline(baselinePath, baseline)) {
+        std::cerr << "Error reading baseline " << baselinePath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    LevelPack scenarios;
+    buildScenarios(scenarios);
+    std::vector<BenchResult> results;
+    for (const Benchmark& benchmark : makeBenchmarks(scenarios)) {
+        if (filter && benchmark.name.find(filter) == std::string::npos)
+            continue;
+        results.push_back(measure(benchmark, minSeconds));
+        std::cerr << results.back().name << ": " << results.back().nsPerOp << " ns/op, "
+            << results.back().allocsPerOp << " allocs/op" << std::endl;
+    }
+
+    std::string json = toJson(results);
+    if (outPath) {
+        std::ofstream out(outPath);
+        if (!(out << json)) {
+            std::cerr << "Error writing " << outPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+        std::cout << json;
+
+    // Сравнение с базовым прогоном: время в процентах, выделения - любой рост
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        auto base = baseline.find(r.name);
+        if (base == baseline.end())
+            continue;
+        double change = base->second.nsPerOp > 0 ? (r.nsPerOp / base->second.nsPerOp - 1) * 100 : 0;
+        bool slower = change > tolerance;
+        bool allocates = r.allocsPerOp > base->second.allocsPerOp + 0.01;
+        if (slower || allocates)
+            regressions++;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-28s %+7.1f%%  allocs/op %.6f -> %.6f%s", r.name.c_str(), change,
+            base->second.allocsPerOp, r.allocsPerOp, slower || allocates ? "  REGRESSION" : "");
+        std::cerr << line << std::endl;
+    }
+    if (regressions) {
+        std::cerr << regressions << " benchmark(s) regressed against " << baselinePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+﻿#pragma once
+// Битовая карта лабиринта: один бит на клетку, номер бита - Map::cellId.
+// Классический лабиринт с рамкой (37 x 32 клетки) умещается в 19 слов по
+// 64 бита, поэтому копирование, сравнение, хэширование и подсчёт занимают
+// несколько десятков инструкций. Все операции - циклы по непрерывному
+// массиву слов без ветвлений, компилятор разворачивает их в SIMD.
+// Сдвиг на 1 бит - сосед слева/справа, на stride бит - сосед сверху/снизу.
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+inline int popcount64(std::uint64_t word)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(word);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// Номер младшего установленного бита; word != 0
+inline int lowestBit64(std::uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+class Bitboard {
+private:
+    std::vector<std::uint64_t> words;
+public:
+    // Все биты сброшены; при том же размере без выделения памяти
+    void resize(int bits) { words.assign((bits + 63) / 64, 0); }
+    void clear() { for (std::uint64_t& word : words) word = 0; }
+    // Слова из готового массива того же размера (индексы из LevelCompiler.h)
+    void assignWords(const std::uint64_t* source) { for (std::size_t i = 0; i < words.size(); ++i) words[i] = source[i]; }
+    int wordCount() const { return (int)words.size(); }
+    const std::uint64_t* data() const { return words.data(); }
+
+    bool test(int bit) const { return (words[bit >> 6] >> (bit & 63)) & 1; }
+    void set(int bit) { words[bit >> 6] |= 1ull << (bit & 63); }
+    void reset(int bit) { words[bit >> 6] &= ~(1ull << (bit & 63)); }
+    void assign(int bit, bool value) { if (value) set(bit); else reset(bit); }
+
+    int count() const {
+        int total = 0;
+        for (std::uint64_t word : words)
+            total += popcount64(word);
+        return total;
+    }
+    bool any() const {
+        std::uint64_t all = 0;
+        for (std::uint64_t word : words)
+            all |= word;
+        return all != 0;
+    }
+    // Номер установленного бита с порядковым номером rank (с нуля, по
+    // возрастанию) или -1; зависит только от набора битов, а не от того,
+    // в каком порядке их ставили
+    int select(int rank) const {
+        for (std::size_t i = 0; i < words.size(); ++i) {
+            int inWord = popcount64(words[i]);
+            if (rank < inWord) {
+                std::uint64_t word = words[i];
+                for (; rank > 0; --rank)
+                    word &= word - 1;
+                return (int)i * 64 + lowestBit64(word);
+            }
+            rank -= inWord;
+        }
+        return -1;
+    }
+    bool operator==(const Bitboard& other) const { return words == other.words; }
+    bool operator!=(const Bitboard& other) const { return words != other.words; }
+
+    Bitboard& operator&=(const Bitboard& other) {
+        for (std::size_t i = 0; i < words.size(); ++i) words[i] &= other.words[i];
+        return *this;
+    }
+    Bitboard& operator|=(const Bitboard& other) {
+        for (std::size_t i = 0; i < words.size(); ++i) words[i] |= other.words[i];
+        return *this;
+    }
+    Bitboard& andNot(const Bitboard& other) {
+        for (std::size_t i = 0; i < words.size(); ++i) words[i] &= ~other.words[i];
+        return *this;
+    }
+    // Число общих битов, без временной карты
+    int countAnd(const Bitboard& other) const {
+        int total = 0;
+        for (std::size_t i = 0; i < words.size(); ++i)
+            total += popcount64(words[i] & other.words[i]);
+        return total;
+    }
+
+    // this |= (src << n) | (src >> n): все клетки на расстоянии n номеров
+    // от клеток src; для n = 1 - соседи по строке, для n = stride - по столбцу.
+    // src - другая карта того же размера
+    void orShifted(const Bitboard& src, int n) {
+        const int size = (int)words.size();
+        const int wordShift = n >> 6, bitShift = n & 63;
+        for (int i = 0; i < size; ++i) {
+            std::uint64_t up = 0, down = 0;
+            // src << n: бит j переходит в j + n
+            if (i - wordShift >= 0) {
+                up = src.words[i - wordShift] << bitShift;
+                if (bitShift && i - wordShift - 1 >= 0)
+                    up |= src.words[i - wordShift - 1] >> (64 - bitShift);
+            }
+            // src >> n: бит j переходит в j - n
+            if (i + wordShift < size) {
+                down = src.words[i + wordShift] >> bitShift;
+                if (bitShift && i + wordShift + 1 < size)
+                    down |= src.words[i + wordShift + 1] << (64 - bitShift);
+            }
+            words[i] |= up | down;
+        }
+    }
+};
@@ -0,0 +1,42 @@
+﻿#pragma once
+// Множество клеток лабиринта (номера Map::cellId) с добавлением, удалением,
+// проверкой и выбором случайной клетки за O(1). Клетки лежат плотным
+// массивом, а для каждой клетки сетки известно её место в нём; удалённую
+// клетку замещает последняя.
+#include <vector>
+#include "Random.h"
+
+class CellSet {
+private:
+    std::vector<int> cells;
+    std::vector<int> position;  // место клетки в cells или -1
+public:
+    // Пустое множество для сетки из cellCount клеток; память переиспользуется
+    void reset(int cellCount) {
+        cells.clear();
+        cells.reserve(cellCount);
+        position.assign(cellCount, -1);
+    }
+    int size() const { return (int)cells.size(); }
+    bool empty() const { return cells.empty(); }
+    bool contains(int cell) const { return position[cell] >= 0; }
+    void insert(int cell) {
+        if (position[cell] >= 0)
+            return;
+        position[cell] = (int)cells.size();
+        cells.push_back(cell);
+    }
+    void erase(int cell) {
+        int i = position[cell];
+        if (i < 0)
+            return;
+        cells[i] = cells.back();
+        position[cells[i]] = i;
+        cells.pop_back();
+        position[cell] = -1;
+    }
+    // Равновероятно любая клетка; множество не должно быть пустым
+    int sample(Random& random) const { return cells[random.nextInt(size())]; }
+    const int* begin() const { return cells.data(); }
+    const int* end() const { return cells.data() + cells.size(); }
+};
@@ -0,0 +1,36 @@
+﻿#include "Collision.h"
+#include "Simulation.h"
+#include <algorithm>
+
+int detectCollisions(const GhostStore& ghosts, const SpatialHash& hash, int pacmanX, int pacmanY, int nextX, int nextY, std::vector<int>& hits)
+{
+    hits.clear();
+    // у входа в туннель следующая клетка на другом конце ряда, и прямоугольник
+    // запроса на этот такт растягивается на весь ряд
+    const int* gx = ghosts.x.data();
+    const int* gy = ghosts.y.data();
+    hash.query(std::min(pacmanX, nextX), std::min(pacmanY, nextY), std::max(pacmanX, nextX), std::max(pacmanY, nextY),
+        [&](int i) {
+            if ((gx[i] == pacmanX && gy[i] == pacmanY) || (gx[i] == nextX && gy[i] == nextY))
+                hits.push_back(i);
+        });
+    // корзины обходятся по порядку сетки, а обрабатывать нужно по номеру призрака
+    std::sort(hits.begin(), hits.end());
+    return (int)hits.size();
+}
+
+int resolveCollisions(GhostStore& ghosts, const std::vector<int>& hits, Pacman& pacman)
+{
+    int caught = 0;
+    for (int i : hits) {
+        if (ghosts.state[i] == Ghost::FRIGHTENED) {
+            ghosts.respawn(i, ghosts.homeX[i], ghosts.homeY[i]);
+            pacman.addPoints(GHOST_EATEN_POINTS);
+        }
+        else
+            caught = 1;
+    }
+    if (caught)
+        pacman.loseLife();
+    return caught;
+}
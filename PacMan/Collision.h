@@ -0,0 +1,21 @@
+﻿#pragma once
+// Столкновения Пакмана с призраками. Призраки разложены по корзинам
+// SpatialHash, поэтому проверяются только те, что стоят рядом с Пакманом:
+// стоимость почти не зависит от того, четыре призрака или четыре тысячи.
+#include <vector>
+
+class Pacman;
+class GhostStore;
+class SpatialHash;
+
+// Очки за съеденного испуганного призрака
+const int GHOST_EATEN_POINTS = 300;
+
+// Собирает в hits номера всех призраков, стоящих в клетке Пакмана или в
+// клетке, куда он направляется (через туннель - на другом его конце), по возрастанию. Возвращает число попаданий.
+int detectCollisions(const GhostStore& ghosts, const SpatialHash& hash, int pacmanX, int pacmanY, int nextX, int nextY, std::vector<int>& hits);
+
+// Обрабатывает все попадания: испуганные призраки съедаются и возвращаются
+// в свою клетку дома, за остальных Пакман теряет одну жизнь.
+// Возвращает 1, если Пакмана поймали.
+int resolveCollisions(GhostStore& ghosts, const std::vector<int>& hits, Pacman& pacman);
@@ -0,0 +1,117 @@
+﻿#include "DistanceField.h"
+#include "Simulation.h"
+
+void DistanceField::compute(const Map& map, int targetCell, std::vector<int>& queue)
+{
+    const int stride = map.getStride();
+    const int offsets[4] = { -stride, stride, -1, 1 };
+
+    target = targetCell;
+    dist.assign(map.cellCount(), UNREACHABLE);
+    queue.clear();
+    dist[targetCell] = 0;
+    queue.push_back(targetCell);
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        int cell = queue[head];
+        std::uint16_t next = dist[cell] + 1;
+        for (int d = 0; d < 4; ++d) {
+            int neighbour = cell + offsets[d];
+            if (map.getTile(neighbour).isPassable && dist[neighbour] == UNREACHABLE) {
+                dist[neighbour] = next;
+                queue.push_back(neighbour);
+            }
+        }
+        int wrap = map.tunnelExit(cell);
+        if (wrap >= 0 && dist[wrap] == UNREACHABLE) {
+            dist[wrap] = next;
+            queue.push_back(wrap);
+        }
+    }
+}
+
+void DistanceFieldCache::init(const Map& map, int startX, int startY)
+{
+    // память всех слотов сразу: призраки в коридорах полей не просят, и
+    // слот может впервые понадобиться через много тактов после загрузки
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        fields[i].invalidate();
+        fields[i].reserve(map.cellCount());
+        lastUse[i] = 0;
+    }
+    useCounter = 0;
+
+    // Доступные клетки - те, куда можно дойти от стартовой
+    reach.compute(map, map.cellId(startY, startX), queue);
+
+    // Многоисточниковый BFS по всей сетке без учёта стен: для каждой клетки
+    // запоминаем ближайшую доступную, чтобы цели в стенах имели смысл
+    nearestWalkable.assign(map.cellCount(), -1);
+    queue.clear();
+    for (int i = 0; i < map.getH(); ++i)
+        for (int j = 0; j < map.getW(); ++j) {
+            int cell = map.cellId(i, j);
+            if (reach.at(cell) != DistanceField::UNREACHABLE) {
+                nearestWalkable[cell] = cell;
+                queue.push_back(cell);
+            }
+        }
+    const int stride = map.getStride();
+    const int offsets[4] = { -stride, stride, -1, 1 };
+    for (std::size_t head = 0; head < queue.size(); ++head) {
+        int cell = queue[head];
+        for (int d = 0; d < 4; ++d) {
+            int neighbour = cell + offsets[d];
+            if (map.getTile(neighbour).type != SENTINEL_TILE.type && nearestWalkable[neighbour] < 0) {
+                nearestWalkable[neighbour] = nearestWalkable[cell];
+                queue.push_back(neighbour);
+            }
+        }
+    }
+}
+
+int DistanceFieldCache::snap(const Map& map, int x, int y) const
+{
+    // цели за пределами сетки прижимаем к краю
+    if (x < 0) x = 0;
+    if (x >= map.getW()) x = map.getW() - 1;
+    if (y < 0) y = 0;
+    if (y >= map.getH()) y = map.getH() - 1;
+    return nearestWalkable[map.cellId(y, x)];
+}
+
+const DistanceField& DistanceFieldCache::getCell(const Map& map, int target)
+{
+    useCounter++;
+    int victim = 0;
+    for (int i = 0; i < (int)fields.size(); ++i) {
+        if (fields[i].getTarget() == target) {
+            lastUse[i] = useCounter;
+            return fields[i];
+        }
+        if (lastUse[i] < lastUse[victim])
+            victim = i;
+    }
+    // нет готового поля: пересчитываем самое давно не использованное
+    fields[victim].compute(map, target, queue);
+    lastUse[victim] = useCounter;
+    return fields[victim];
+}
+
+void DistanceFieldCache::prepare(const Map& map, const std::vector<int>& targetCells)
+{
+    // все нужные поля должны поместиться одновременно, иначе LRU вытеснит уже подготовленные
+    if (targetCells.size() > fields.size()) {
+        fields.resize(targetCells.size());
+        lastUse.resize(targetCells.size(), 0);
+    }
+    for (int target : targetCells)
+        getCell(map, target);
+}
+
+const DistanceField& DistanceFieldCache::find(int targetCell) const
+{
+    for (const DistanceField& field : fields)
+        if (field.getTarget() == targetCell)
+            return field;
+    return fields[0];   // сюда не попадаем, если цель была в prepare()
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+// Поля расстояний по лабиринту: для целевой клетки BFS считает, за сколько
+// шагов до неё можно дойти из любой клетки с учётом стен и туннеля.
+// Призраки выбирают направление простым сравнением чисел из таблицы.
+#include <cstdint>
+#include <vector>
+
+class Map;
+
+class DistanceField {
+public:
+    static constexpr std::uint16_t UNREACHABLE = 0xFFFF;
+private:
+    int target;                         // номер целевой клетки (Map::cellId), -1 - не посчитано
+    std::vector<std::uint16_t> dist;    // расстояние по номеру клетки, включая рамку
+public:
+    DistanceField() : target(-1) {}
+    int getTarget() const { return target; }
+    std::uint16_t at(int cell) const { return dist[cell]; }
+    // Поле снова "не посчитано"; память таблицы остаётся для следующего compute
+    void invalidate() { target = -1; }
+    // Память таблицы под лабиринт из cells клеток заранее, чтобы compute не выделял её
+    void reserve(int cells) { dist.reserve(cells); }
+    void compute(const Map& map, int targetCell, std::vector<int>& queue);
+};
+
+// Общий для всех призраков кэш полей. Поле пересчитывается, только когда
+// цель уходит в новую клетку (например, Пакман сделал шаг); призраки с
+// одинаковой целью пользуются одним полем.
+class DistanceFieldCache {
+private:
+    static constexpr int SLOTS = 8;     // начальная ёмкость; prepare() может её увеличить
+    std::vector<DistanceField> fields;
+    std::vector<long long> lastUse;
+    long long useCounter;
+    std::vector<int> nearestWalkable;   // ближайшая доступная клетка для любой клетки сетки
+    std::vector<int> queue;             // очередь BFS, переиспользуется
+    DistanceField reach;                // поле от старта в init(), переиспользуется
+public:
+    DistanceFieldCache() : fields(SLOTS), lastUse(SLOTS, 0), useCounter(0) {}
+    // Подготовка под лабиринт; startX, startY - любая клетка основной области
+    void init(const Map& map, int startX, int startY);
+    // Клетка-цель для (x, y): цель вне лабиринта или в стене заменяется ближайшей доступной клеткой
+    int snap(const Map& map, int x, int y) const;
+    // Поле до цели (x, y), при необходимости пересчитывается
+    const DistanceField& get(const Map& map, int x, int y) { return getCell(map, snap(map, x, y)); }
+    const DistanceField& getCell(const Map& map, int targetCell);
+    // Считает поля сразу для всех целей (номера клеток после snap, без повторов).
+    // До следующего изменения кэша find() для них ничего не меняет и может
+    // вызываться из нескольких потоков одновременно.
+    void prepare(const Map& map, const std::vector<int>& targetCells);
+    const DistanceField& find(int targetCell) const;
+};
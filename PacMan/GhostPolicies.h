@@ -0,0 +1,135 @@
+﻿#pragma once
+// Поведение призраков как набор политик времени компиляции: выбор цели,
+// скорость, реакция на испуг и вид на экране. Архетип - это комбинация
+// политик (GhostBehaviour), а общий код шага призрака - шаблон, который
+// компилятор разворачивает под каждую комбинацию без виртуальных вызовов.
+// Новый вид призрака - новая специализация ArchetypeBehaviour (и значение
+// GhostArchetype), ядро движения для него то же самое.
+#include <type_traits>
+#include "Simulation.h"
+
+// Всё, что нужно политике цели: положения на начало такта
+struct TargetContext {
+    const Map& map;
+    const GhostStore& ghosts;
+    const DistanceField& pacmanField;   // путь по лабиринту до Пакмана
+    int pacmanX, pacmanY;
+    int dx, dy;                         // куда смотрит Пакман
+};
+
+// Базы-метки: по ним GhostBehaviour проверяет, что каждая политика на своём месте
+struct TargetingPolicy {};
+struct SpeedPolicy {};
+struct FrightPolicy {};
+struct LookPolicy {};
+
+// Цель: клетка (x, y), к которой призрак идёт в погоне; может лежать вне лабиринта
+struct TargetPacman : TargetingPolicy {
+    static void target(const TargetContext& c, int, int& x, int& y) {
+        x = c.pacmanX;
+        y = c.pacmanY;
+    }
+};
+
+template <int Cells>
+struct TargetAhead : TargetingPolicy {
+    static void target(const TargetContext& c, int, int& x, int& y) {
+        x = c.pacmanX + Cells * c.dx;
+        y = c.pacmanY + Cells * c.dy;
+    }
+};
+
+// Отражение напарника относительно точки в Cells клетках перед Пакманом
+template <int Cells>
+struct TargetMirrorPartner : TargetingPolicy {
+    static void target(const TargetContext& c, int i, int& x, int& y) {
+        // без напарника отражает относительно самого себя
+        int partner = c.ghosts.indexOf(c.ghosts.partner[i]);
+        int bx = partner >= 0 ? c.ghosts.x[partner] : c.ghosts.x[i];
+        int by = partner >= 0 ? c.ghosts.y[partner] : c.ghosts.y[i];
+        x = bx + 2 * (c.pacmanX + Cells * c.dx - bx);
+        y = by + 2 * (c.pacmanY + Cells * c.dy - by);
+    }
+};
+
+// На Пакмана издалека; ближе Radius клеток пути - в левый нижний угол
+template <int Radius>
+struct TargetPacmanFromAfar : TargetingPolicy {
+    static void target(const TargetContext& c, int i, int& x, int& y) {
+        if (c.pacmanField.at(c.map.cellId(c.ghosts.y[i], c.ghosts.x[i])) <= Radius) {
+            x = 0;
+            y = c.map.getH();
+        }
+        else
+            TargetPacman::target(c, i, x, y);
+    }
+};
+
+// Скорость погони; endgame - в лабиринте осталось мало точек
+struct RegularSpeed : SpeedPolicy {
+    static int chaseSpeed(bool) { return speedPerTick(GHOST_SPEED); }
+};
+
+struct EndgameSprint : SpeedPolicy {
+    static int chaseSpeed(bool endgame) { return speedPerTick(endgame ? PINKY_ENDGAME_SPEED : GHOST_SPEED); }
+};
+
+// Испуг: ignoresFright - призрак продолжает погоню, а таймер испуга стоит
+struct Frightenable : FrightPolicy {
+    static bool ignoresFright(bool) { return false; }
+};
+
+struct FearlessInEndgame : FrightPolicy {
+    static bool ignoresFright(bool endgame) { return endgame; }
+};
+
+// Вид: на экране окончания игры призрак рисуется уменьшенным квадратом или как обычно
+struct RegularLook : LookPolicy {
+    static constexpr bool shrinksOnGameOver = false;
+};
+
+struct ShrinkOnGameOver : LookPolicy {
+    static constexpr bool shrinksOnGameOver = true;
+};
+
+template <class Targeting, class Speed, class Fright, class Look>
+struct GhostBehaviour : Targeting, Speed, Fright, Look {
+    static_assert(std::is_base_of<TargetingPolicy, Targeting>::value, "first policy must choose the target");
+    static_assert(std::is_base_of<SpeedPolicy, Speed>::value, "second policy must give the speed");
+    static_assert(std::is_base_of<FrightPolicy, Fright>::value, "third policy must handle fright");
+    static_assert(std::is_base_of<LookPolicy, Look>::value, "fourth policy must describe the look");
+};
+
+template <GhostArchetype Type>
+struct ArchetypeBehaviour;
+
+template <>
+struct ArchetypeBehaviour<BLINKY> : GhostBehaviour<TargetPacman, RegularSpeed, Frightenable, ShrinkOnGameOver> {};
+template <>
+struct ArchetypeBehaviour<PINKY> : GhostBehaviour<TargetAhead<4>, EndgameSprint, FearlessInEndgame, RegularLook> {};
+template <>
+struct ArchetypeBehaviour<INKY> : GhostBehaviour<TargetMirrorPartner<2>, RegularSpeed, Frightenable, RegularLook> {};
+template <>
+struct ArchetypeBehaviour<CLYDE> : GhostBehaviour<TargetPacmanFromAfar<8>, RegularSpeed, Frightenable, RegularLook> {};
+
+// fn(ArchetypeBehaviour<type>()) - единственное место, где архетип из
+// данных превращается в тип; дальше всё подставляется на этапе компиляции
+template <class F>
+inline void withBehaviour(GhostArchetype type, F&& fn)
+{
+    static_assert(ARCHETYPE_COUNT == 4, "withBehaviour must list every archetype");
+    switch (type) {
+    case PINKY: fn(ArchetypeBehaviour<PINKY>()); break;
+    case INKY: fn(ArchetypeBehaviour<INKY>()); break;
+    case CLYDE: fn(ArchetypeBehaviour<CLYDE>()); break;
+    default: fn(ArchetypeBehaviour<BLINKY>()); break;
+    }
+}
+
+// Для кода, которому нужно одно свойство, а не весь шаг (отрисовка)
+inline bool shrinksOnGameOver(GhostArchetype type)
+{
+    bool result = false;
+    withBehaviour(type, [&](auto behaviour) { result = decltype(behaviour)::shrinksOnGameOver; });
+    return result;
+}
@@ -0,0 +1,82 @@
+﻿#include "GhostStore.h"
+
+namespace {
+
+template <typename T>
+void removeAt(std::vector<T>& values, int i) {
+    values[i] = values.back();
+    values.pop_back();
+}
+
+}
+
+GhostHandle GhostStore::create(GhostArchetype type, int spawnX, int spawnY, int homeX, int homeY, std::uint64_t seed)
+{
+    std::uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else {
+        slot = (std::uint32_t)slotIndex.size();
+        slotIndex.push_back(0);
+        slotGeneration.push_back(0);
+    }
+    slotIndex[slot] = (std::uint32_t)size();
+    indexSlot.push_back(slot);
+
+    x.push_back(spawnX);
+    y.push_back(spawnY);
+    prevX.push_back(spawnX);
+    prevY.push_back(spawnY);
+    score.push_back(0);
+    speed.push_back(0);
+    direction.push_back(3);
+    lastDirection.push_back(3);
+    state.push_back(0);
+    frightenedTimer.push_back(0);
+    archetype.push_back(type);
+    this->spawnX.push_back(spawnX);
+    this->spawnY.push_back(spawnY);
+    this->homeX.push_back(homeX);
+    this->homeY.push_back(homeY);
+    partner.push_back(GhostHandle());
+    // у каждого призрака своя последовательность, даже при общем зерне мира
+    random.push_back(Random(seed + 0x9E3779B97F4A7C15ull * (slot + 1)));
+    return { slot, slotGeneration[slot] };
+}
+
+void GhostStore::destroy(GhostHandle handle)
+{
+    if (!valid(handle))
+        return;
+    int i = (int)slotIndex[handle.slot];
+    std::uint32_t movedSlot = indexSlot.back();
+    removeAt(x, i); removeAt(y, i);
+    removeAt(prevX, i); removeAt(prevY, i);
+    removeAt(score, i); removeAt(speed, i);
+    removeAt(direction, i); removeAt(lastDirection, i);
+    removeAt(state, i); removeAt(frightenedTimer, i);
+    removeAt(archetype, i);
+    removeAt(spawnX, i); removeAt(spawnY, i);
+    removeAt(homeX, i); removeAt(homeY, i);
+    removeAt(partner, i);
+    removeAt(random, i);
+    removeAt(indexSlot, i);
+    slotIndex[movedSlot] = (std::uint32_t)i;
+    slotGeneration[handle.slot]++;
+    freeSlots.push_back(handle.slot);
+}
+
+void GhostStore::clear()
+{
+    while (size())
+        destroy(handleAt(size() - 1));
+}
+
+void GhostStore::respawn(int i, int newX, int newY)
+{
+    x[i] = prevX[i] = newX;
+    y[i] = prevY[i] = newY;
+    score[i] = 0;
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+// Хранилище призраков структурой массивов: каждая характеристика - свой
+// плотный массив, призрак - номер в этих массивах. Обход всех призраков
+// идёт по непрерывной памяти, а число призраков ничем не ограничено.
+// Номер в массивах меняется при удалении (на место удалённого переезжает
+// последний), поэтому снаружи призраков держат по GhostHandle: слот плюс
+// поколение, устаревший дескриптор просто перестаёт быть действительным.
+#include <cstdint>
+#include <vector>
+#include "Random.h"
+
+// Поведение призрака при выборе цели
+enum GhostArchetype : std::uint8_t {
+    BLINKY,     // прямо на Пакмана
+    PINKY,      // на 4 клетки впереди Пакмана
+    INKY,       // отражение напарника-Blinky относительно точки в 2 клетках перед Пакманом
+    CLYDE,      // на Пакмана издалека, в угол вблизи
+    ARCHETYPE_COUNT
+};
+
+struct GhostHandle {
+    std::uint32_t slot = 0xFFFFFFFFu;
+    std::uint32_t generation = 0;
+    bool operator==(const GhostHandle& other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const GhostHandle& other) const { return !(*this == other); }
+};
+
+class GhostStore {
+private:
+    std::vector<std::uint32_t> slotIndex;       // слот -> номер в массивах
+    std::vector<std::uint32_t> slotGeneration;
+    std::vector<std::uint32_t> freeSlots;
+    std::vector<std::uint32_t> indexSlot;       // номер в массивах -> слот
+public:
+    // Компоненты, по номеру призрака от 0 до size() - 1
+    std::vector<int> x, y;
+    std::vector<int> prevX, prevY;              // клетка до последнего шага
+    std::vector<int> score, speed;              // прогресс шага и его прирост за такт
+    std::vector<int> direction, lastDirection;
+    std::vector<std::uint8_t> state;            // Ghost::GhostState
+    std::vector<int> frightenedTimer;
+    std::vector<std::uint8_t> archetype;        // GhostArchetype
+    std::vector<int> spawnX, spawnY;            // куда встаёт после поимки Пакмана и конца испуга
+    std::vector<int> homeX, homeY;              // куда возвращается съеденным
+    std::vector<GhostHandle> partner;           // Blinky, от которого считает цель Inky
+    std::vector<Random> random;                 // свой генератор: обновление не зависит от порядка и потоков
+
+    int size() const { return (int)x.size(); }
+    GhostHandle create(GhostArchetype type, int spawnX, int spawnY, int homeX, int homeY, std::uint64_t seed);
+    void destroy(GhostHandle handle);
+    void clear();
+    bool valid(GhostHandle handle) const {
+        return handle.slot < slotGeneration.size() && slotGeneration[handle.slot] == handle.generation;
+    }
+    // Номер в массивах или -1 для недействительного дескриптора
+    int indexOf(GhostHandle handle) const { return valid(handle) ? (int)slotIndex[handle.slot] : -1; }
+    GhostHandle handleAt(int i) const { return { indexSlot[i], slotGeneration[indexSlot[i]] }; }
+    // Ставит призрака i в клетку (x, y) со сброшенным прогрессом шага; направление не меняется
+    void respawn(int i, int x, int y);
+};
@@ -0,0 +1,879 @@
+﻿// Консольный прогон симуляции без окна: для ботов и длительных прогонов под Linux.
+// Использование: PacManHeadless [--ticks N] [--seed S] [--levels pack.pmlv] [--ghosts G] [--threads T] [--trace file.json] [--record file.pmr [--checksum-interval K]] [autopilot]
+//                PacManHeadless --batch N [--threads T] [--max-ticks M] [--seed S] [--levels pack.pmlv] [--results file.csv] [autopilot]
+//                PacManHeadless --replay file.pmr [--replay file2.pmr ...] [--threads T] [--levels pack.pmlv]
+//                PacManHeadless --alloc-gate [--warmup W] [--ticks N] [--seed S] [--ghosts G] [--threads T] [autopilot]
+//                PacManHeadless --alloc-selftest
+//                PacManHeadless --snapshot-check [--ticks N] [--seed S] [--levels pack.pmlv] [--ghosts G]
+//                PacManHeadless --replay-check [--ticks N] [--seed S]
+//                PacManHeadless --scenario-check [--seed S] [--levels pack.pmlv]
+//                PacManHeadless --index-check [--ticks N] [--seed S]
+// В пакетном режиме N партий с зёрнами S, S + 1, ... идут параллельно на T потоках,
+// по очереди на всех уровнях пакета; без --levels - на встроенном лабиринте.
+// --ghosts добавляет G призраков сверх четырёх (нагрузочный прогон), их
+// обновление делится между T потоками.
+// --record пишет контрольную сумму после каждого такта; --checksum-interval K -
+// после каждого K-го (запись короче, расхождение находится с точностью до K тактов).
+// В режиме воспроизведения записи проигрываются с проверкой контрольных сумм на
+// том уровне, где сделаны (пакет ищется по пути из записи, --levels его
+// подменяет); запись с другого лабиринта отвергается.
+// autopilot: --autopilot [--budget-us U] [--iterations I] - играет AutopilotInput
+// вместо случайного игрока. В одиночном прогоне поиск идёт на T потоках, в
+// пакетном каждая партия ищет в своём потоке; --iterations делает ход
+// автопилота воспроизводимым (не зависящим от скорости машины).
+// --alloc-gate - проверка для ctest: после W тактов разогрева (буферы дорастают
+// до рабочих размеров) такты, вместе с ходами автопилота и новыми партиями
+// (через Simulation::load, как в пакетном режиме), не должны выделять память; иначе программа завершается с ошибкой. Перед
+// прогоном (и отдельно по --alloc-selftest) проверяется сам счётчик: он должен
+// видеть все виды operator new, включая выровненные.
+// --snapshot-check - проверка снимков для ctest: каждый снимок непрерывного
+// прогона проходит запись, чтение и restore в другом мире, после чего тот
+// обязан повторить контрольные суммы прогона такт в такт; испорченные снимки
+// должны отвергаться, не меняя мир.
+// --replay-check - проверка записей для ctest: записанный прогон проигрывается
+// без расхождений, обрезанные и испорченные файлы отвергаются без падения.
+// --scenario-check - игровые ситуации для ctest: положение из снимка, исход
+// такта должен совпасть с ожидаемым (встреча с призраком через туннель).
+// --index-check - индексы встроенного лабиринта, собранные при компиляции,
+// совпадают с построенными при загрузке того же текста.
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Simulation.h"
+#include "Autopilot.h"
+#include "BatchRunner.h"
+#include "Replay.h"
+#include "Profiler.h"
+#include "AllocationCounter.h"
+
+// Случайный "игрок": держит направление несколько тактов, затем выбирает новое
+class RandomInput : public InputManager {
+private:
+    std::mt19937 rng;
+    int direction;
+    int holdTicks;
+public:
+    RandomInput(unsigned seed) : rng(seed), direction(-1), holdTicks(0) {}
+    int getDirection() override {
+        if (holdTicks-- <= 0) {
+            direction = static_cast<int>(rng() % 5) - 1;
+            holdTicks = static_cast<int>(rng() % 2000);
+        }
+        return direction;
+    }
+};
+
+// Жадный игрок: идёт к ближайшей точке, изредка сворачивает наугад. В
+// отличие от RandomInput доедает до появления фруктов
+class GreedyInput : public InputManager {
+private:
+    const Simulation& world;
+    std::mt19937 rng;
+    std::vector<int> firstMove;     // по клеткам: направление первого шага пути или -1
+    std::vector<int> queue;
+public:
+    GreedyInput(const Simulation& world, unsigned seed) : world(world), rng(seed) {}
+    int getDirection() override {
+        if (rng() % 8 == 0)
+            return static_cast<int>(rng() % 4);
+        const Map& map = world.getMap();
+        const MazeGraph& graph = world.getGraph();
+        int start = map.cellId(world.getPacman().getY(), world.getPacman().getX());
+        firstMove.assign(map.cellCount(), -1);
+        queue.assign(1, start);
+        firstMove[start] = 4;
+        for (std::size_t head = 0; head < queue.size(); ++head) {
+            int cell = queue[head];
+            if (cell != start && map.getPellets().contains(cell))
+                return firstMove[cell];
+            for (int d = 0; d < 4; ++d)
+                if (graph.canMove(cell, d)) {
+                    int next = graph.step(cell, d);
+                    if (firstMove[next] < 0) {
+                        firstMove[next] = cell == start ? d : firstMove[cell];
+                        queue.push_back(next);
+                    }
+                }
+        }
+        return static_cast<int>(rng() % 4);
+    }
+};
+
+static int runBatch(const LevelPack& levels, int episodes, unsigned threads, long long maxTicks, unsigned seed, const char* resultsPath,
+    const AutopilotSettings* autopilot)
+{
+    ThreadPool pool(threads);
+    BatchRunner runner(pool, levels, maxTicks);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<EpisodeResult> results = runner.run(seed, episodes, [autopilot](std::uint64_t episodeSeed, const Simulation& world) {
+        if (autopilot) {
+            AutopilotSettings settings = *autopilot;
+            settings.seed = episodeSeed;
+            return std::unique_ptr<InputManager>(new AutopilotInput(world, settings));
+        }
+        return std::unique_ptr<InputManager>(new RandomInput((unsigned)episodeSeed));
+    });
+    auto finish = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(finish - start).count();
+
+    long long won = 0, lost = 0, unfinished = 0, ticks = 0, totalPoints = 0;
+    int record = 0;
+    for (const EpisodeResult& episode : results) {
+        if (episode.result == 1) won++;
+        else if (episode.result == 2) lost++;
+        else unfinished++;
+        ticks += episode.ticks;
+        totalPoints += episode.points;
+        if (episode.points > record)
+            record = episode.points;
+    }
+    std::cout << "threads=" << pool.size() << " levels=" << levels.size() << " episodes=" << episodes << " won=" << won << " lost=" << lost
+        << " unfinished=" << unfinished << " record=" << record
+        << " mean_points=" << (episodes ? (double)totalPoints / episodes : 0) << " ticks=" << ticks
+        << " seconds=" << seconds << " episodes/sec=" << (seconds > 0 ? episodes / seconds : 0)
+        << " ticks/sec=" << (seconds > 0 ? ticks / seconds : 0) << std::endl;
+
+    if (resultsPath) {
+        std::ofstream out(resultsPath);
+        out << "seed,level,result,points,ticks\n";
+        for (const EpisodeResult& episode : results)
+            out << episode.seed << "," << episode.level << "," << episode.result << "," << episode.points << "," << episode.ticks << "\n";
+        if (!out) {
+            std::cerr << "Error writing results " << resultsPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+static int runReplays(const std::vector<std::string>& paths, unsigned threads, const char* levelsPath)
+{
+    const long long READ_FAILED = -3, NO_LEVEL = -4;
+    ThreadPool pool(threads);
+    // -1 - совпало, Replay::WRONG_LEVEL, READ_FAILED, NO_LEVEL или такт расхождения
+    std::vector<long long> outcomes(paths.size());
+    std::vector<long long> steps(paths.size());
+    std::vector<std::string> sources(paths.size());
+    auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(0, (int)paths.size(), 1, [&](int i) {
+        Replay replay;
+        if (!replay.load(paths[i])) {
+            outcomes[i] = READ_FAILED;
+            return;
+        }
+        // уровень из источника записи; --levels подменяет пакет, если его перенесли
+        sources[i] = levelsPath ? levelsPath : replay.getLevelSource();
+        LevelPack pack;
+        std::string error;
+        if (!sources[i].empty() && (!pack.open(sources[i], error) || replay.getLevelIndex() >= pack.size())) {
+            outcomes[i] = NO_LEVEL;
+            return;
+        }
+        const Level& level = sources[i].empty() ? LevelPack::builtin().get(0) : pack.get(replay.getLevelIndex());
+        outcomes[i] = replay.verify(level);
+        if (outcomes[i] != Replay::WRONG_LEVEL)
+            steps[i] = replay.getSteps();
+    });
+    auto finish = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(finish - start).count();
+
+    long long totalSteps = 0;
+    int failed = 0;
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        totalSteps += steps[i];
+        if (outcomes[i] == READ_FAILED)
+            std::cerr << paths[i] << ": cannot read replay" << std::endl;
+        else if (outcomes[i] == NO_LEVEL)
+            std::cerr << paths[i] << ": cannot open the recorded level in " << sources[i] << std::endl;
+        else if (outcomes[i] == Replay::WRONG_LEVEL)
+            std::cerr << paths[i] << ": recorded on another level than "
+                << (sources[i].empty() ? std::string("the built-in maze") : sources[i]) << std::endl;
+        else if (outcomes[i] >= 0)
+            std::cerr << paths[i] << ": desync at tick " << outcomes[i] << std::endl;
+        failed += outcomes[i] != -1;
+    }
+    std::cout << "replays=" << paths.size() << " failed=" << failed << " ticks=" << totalSteps
+        << " seconds=" << seconds << " ticks/sec=" << (seconds > 0 ? totalSteps / seconds : 0) << std::endl;
+    return failed ? EXIT_FAILURE : 0;
+}
+
+static int runSnapshotCheck(const Level& level, long long ticks, unsigned seed, int extraGhosts)
+{
+    const long long SNAPSHOT_EVERY = 1000;
+    const long long REPLAY_TICKS = 2 * SNAPSHOT_EVERY;
+    const int FUZZ_ROUNDS = 2000;
+    if (ticks <= 0) {
+        std::cerr << "snapshot-check: --ticks must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Непрерывный прогон: ввод и контрольные суммы каждого такта, снимки перед
+    // каждым SNAPSHOT_EVERY-м тактом в сериализованном виде
+    Simulation world(level, seed);
+    for (int i = 0; i < extraGhosts; ++i)
+        world.addGhost(static_cast<GhostArchetype>(i % ARCHETYPE_COUNT));
+    // жадный игрок доходит до фруктов, так что проверяется и выбор их клеток
+    GreedyInput input(world, seed);
+    std::vector<int> directions((std::size_t)ticks);
+    std::vector<std::uint64_t> checksums((std::size_t)ticks);
+    std::vector<std::vector<std::uint8_t>> saved;
+    int fruitSnapshots = 0;
+    for (long long t = 0; t < ticks; ++t) {
+        if (t % SNAPSHOT_EVERY == 0) {
+            GameSnapshot snapshot;
+            if (!world.clone(snapshot)) {
+                std::cerr << "snapshot-check: the world does not fit a snapshot (at most " << SNAPSHOT_GHOSTS << " ghosts)" << std::endl;
+                return EXIT_FAILURE;
+            }
+            fruitSnapshots += world.getFruit().getIsActive();
+            saved.emplace_back();
+            writeSnapshot(snapshot, saved.back());
+        }
+        directions[t] = input.getDirection();
+        if (world.step(directions[t]))
+            world.reset();
+        checksums[t] = world.checksum();
+    }
+
+    // Восстановление в мире с другим зерном и составом призраков
+    Simulation other(level, seed + 1);
+    long long restoredTicks = 0;
+    int failures = 0;
+    for (std::size_t k = 0; k < saved.size(); ++k) {
+        GameSnapshot snapshot;
+        std::string error;
+        if (!readSnapshot(saved[k].data(), saved[k].size(), snapshot, error) || !other.restore(snapshot)) {
+            std::cerr << "snapshot-check: snapshot " << k << " rejected: " << (error.empty() ? "restore failed" : error) << std::endl;
+            failures++;
+            continue;
+        }
+        long long begin = (long long)k * SNAPSHOT_EVERY, end = std::min(ticks, begin + REPLAY_TICKS);
+        for (long long t = begin; t < end; ++t, ++restoredTicks) {
+            if (other.step(directions[t]))
+                other.reset();
+            if (other.checksum() != checksums[t]) {
+                std::cerr << "snapshot-check: snapshot " << k << " diverges at tick " << t << std::endl;
+                failures++;
+                break;
+            }
+        }
+    }
+
+    // Испорченные снимки: чтение или restore отвергает их, мир не меняется
+    GameSnapshot base;
+    std::string error;
+    readSnapshot(saved[saved.size() / 2].data(), saved[saved.size() / 2].size(), base, error);
+    int wallX = -1, wallY = -1;
+    for (int cell = 0; wallX < 0 && cell < (int)level.tileCount(); ++cell) {
+        int x = other.getMap().cellX(cell), y = other.getMap().cellY(cell);
+        if (x >= 0 && x < other.getMap().getW() && y >= 0 && y < other.getMap().getH() && !level.tiles()[cell].passable)
+            wallX = x, wallY = y;
+    }
+    const int W = other.getMap().getW(), H = other.getMap().getH();
+    const std::vector<std::function<void(GameSnapshot&)>> corruptions = {
+        [](GameSnapshot& s) { s.level ^= 1; },
+        [](GameSnapshot& s) { s.ghostCount = -1; },
+        [](GameSnapshot& s) { s.ghostCount = SNAPSHOT_GHOSTS + 1; },
+        [](GameSnapshot& s) { s.fruitIndex = -1; },
+        [](GameSnapshot& s) { s.fruitIndex = SNAPSHOT_FRUITS; },
+        [](GameSnapshot& s) { s.pacmanX = -1; },
+        [W](GameSnapshot& s) { s.pacmanX = (std::int16_t)W; },
+        [H](GameSnapshot& s) { s.pacmanY = (std::int16_t)H; },
+        [wallX, wallY](GameSnapshot& s) { s.pacmanX = (std::int16_t)wallX; s.pacmanY = (std::int16_t)wallY; },
+        [](GameSnapshot& s) { s.pacmanDirection = 4; },
+        [](GameSnapshot& s) { s.pacmanScore = -1; },
+        [W](GameSnapshot& s) { s.fruits[s.fruitIndex].x = (std::int16_t)W; },
+        [W](GameSnapshot& s) { s.ghosts[0].x = (std::int16_t)W; },
+        [](GameSnapshot& s) { s.ghosts[0].archetype = ARCHETYPE_COUNT; },
+        [](GameSnapshot& s) { s.ghosts[0].lastDirection = -1; },
+        [](GameSnapshot& s) { s.smallFood++; },
+        [](GameSnapshot& s) { s.pellets[SNAPSHOT_WORDS - 1] |= 1ull << 63; },
+    };
+    int rejected = 0;
+    for (const auto& corrupt : corruptions) {
+        GameSnapshot snapshot = base;
+        corrupt(snapshot);
+        std::vector<std::uint8_t> bytes;
+        writeSnapshot(snapshot, bytes);
+        std::uint64_t before = other.checksum();
+        if (!readSnapshot(bytes.data(), bytes.size(), snapshot, error) || (!other.restore(snapshot) && other.checksum() == before))
+            rejected++;
+    }
+    if (rejected != (int)corruptions.size()) {
+        std::cerr << "snapshot-check: " << corruptions.size() - rejected << " corrupted snapshots accepted" << std::endl;
+        failures++;
+    }
+
+    // Случайно испорченные байты: что бы ни приняли чтение и restore, мир
+    // после этого играется как обычно
+    std::mt19937 rng(seed);
+    int fuzzAccepted = 0;
+    for (int round = 0; round < FUZZ_ROUNDS; ++round) {
+        std::vector<std::uint8_t> bytes = saved[rng() % saved.size()];
+        bytes[5 + rng() % (bytes.size() - 5)] ^= (std::uint8_t)(1 + rng() % 255);
+        GameSnapshot snapshot;
+        if (!readSnapshot(bytes.data(), bytes.size(), snapshot, error) || !other.restore(snapshot))
+            continue;
+        fuzzAccepted++;
+        for (int t = 0; t < 100; ++t)
+            if (other.step(static_cast<int>(rng() % 4)))
+                other.reset();
+    }
+
+    std::cout << "snapshot-check: snapshots=" << saved.size() << " with-fruit=" << fruitSnapshots << " restored-ticks=" << restoredTicks << " corrupted-rejected=" << rejected
+        << "/" << corruptions.size() << " fuzz-accepted=" << fuzzAccepted << "/" << FUZZ_ROUNDS << " failures=" << failures << std::endl;
+    return failures ? EXIT_FAILURE : 0;
+}
+
+// Проверка игровых ситуаций для ctest: положение собирается из снимка, после
+// одного такта сверяется исход. Встреча в туннеле: Пакман у одного входа идёт в
+// туннель, призрак стоит у другого - это столкновение, как и у соседних клеток
+static int runScenarioCheck(const Level& level, unsigned seed)
+{
+    const LevelHeader& info = level.info();
+    if (!info.tunnelCount) {
+        std::cerr << "scenario-check: the level has no tunnel" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const LevelTunnel& tunnel = info.tunnels[0];
+    struct Scenario {
+        const char* name;
+        int pacmanX, direction, ghostX;
+        bool frightened;
+    };
+    const Scenario scenarios[] = {
+        { "tunnel-left", tunnel.leftX, 2, tunnel.rightX, false },
+        { "tunnel-right", tunnel.rightX, 3, tunnel.leftX, false },
+        { "tunnel-left-frightened", tunnel.leftX, 2, tunnel.rightX, true },
+    };
+    Simulation world(level, seed);
+    int failures = 0;
+    for (const Scenario& scenario : scenarios) {
+        world.reset();
+        GameSnapshot s;
+        world.clone(s);
+        // оба стоят на месте: прогресс шага нулевой
+        s.pacmanX = s.pacmanNextX = s.pacmanPrevX = (std::int16_t)scenario.pacmanX;
+        s.pacmanY = s.pacmanNextY = s.pacmanPrevY = (std::int16_t)tunnel.y;
+        s.pacmanDirection = (std::int8_t)scenario.direction;
+        s.pacmanScore = 0;
+        SnapshotGhost& ghost = s.ghosts[0];
+        ghost.x = ghost.prevX = (std::int16_t)scenario.ghostX;
+        ghost.y = ghost.prevY = (std::int16_t)tunnel.y;
+        ghost.direction = ghost.lastDirection = (std::int8_t)MazeGraph::reverse(scenario.direction);
+        ghost.score = 0;
+        ghost.state = (std::uint8_t)(scenario.frightened ? Ghost::FRIGHTENED : Ghost::NORMAL);
+        ghost.frightenedTimer = scenario.frightened ? TICKS_PER_SECOND : 0;
+        if (!world.restore(s)) {
+            std::cerr << "scenario-check: " << scenario.name << ": snapshot rejected" << std::endl;
+            failures++;
+            continue;
+        }
+        const int lives = world.getPacman().getLives(), points = world.getPacman().getPoints();
+        world.step(scenario.direction);
+        bool ok = scenario.frightened
+            ? world.getPacman().getLives() == lives && world.getPacman().getPoints() >= points + GHOST_EATEN_POINTS
+            : world.getPacman().getLives() == lives - 1;
+        std::cout << "scenario-check: " << scenario.name << " lives " << lives << "->" << world.getPacman().getLives()
+            << " points " << points << "->" << world.getPacman().getPoints() << (ok ? " ok" : " FAILED") << std::endl;
+        failures += !ok;
+    }
+    return failures ? EXIT_FAILURE : 0;
+}
+
+// Проверка встроенного уровня для ctest: индексы, собранные при компиляции
+// (LevelCompiler.h), слово в слово совпадают с тем, что Map::load и
+// MazeGraph::build строят при загрузке того же текста, и оба мира играют такт в такт
+static int runIndexCheck(long long ticks, unsigned seed)
+{
+    const Level& compiled = LevelPack::builtin().get(0);
+    const LevelIndexes* indexes = compiled.precomputed();
+    std::vector<std::uint8_t> bytes;
+    LevelPack pack;
+    std::string error;
+    if (!indexes) {
+        std::cerr << "index-check: the built-in level has no compiled indexes" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!LevelPack::fromAscii({ LevelPack::classicAscii() }, bytes, error) || !pack.assign(bytes, error) || pack.get(0).precomputed()) {
+        std::cerr << "index-check: cannot build the classic maze from text: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    Simulation fast(compiled, seed), built(pack.get(0), seed);
+    const Map& map = built.getMap();
+    const MazeGraph& graph = built.getGraph();
+    const int cells = (int)map.cellCount();
+    const int words = (cells + 63) / 64;
+
+    // Слои по битам: слово в слово; развилки и клетки фруктов в рантайме не
+    // битовые, из них собираются такие же слова
+    std::vector<std::uint64_t> junctions(words), fruitCells(words);
+    for (int cell = 0; cell < cells; ++cell)
+        if (graph.isJunction(cell))
+            junctions[cell >> 6] |= 1ull << (cell & 63);
+    for (int cell : map.getFruitCells())
+        fruitCells[cell >> 6] |= 1ull << (cell & 63);
+    struct Layer {
+        const char* name;
+        const std::uint64_t* compiled;
+        const std::uint64_t* built;
+        int words;
+    };
+    const Layer layers[] = {
+        { "reachable", indexes->reachable, graph.getReachable().data(), graph.getReachable().wordCount() },
+        { "junctions", indexes->junctions, junctions.data(), words },
+        { "walls", indexes->walls, map.getWalls().data(), map.getWalls().wordCount() },
+        { "smallPellets", indexes->smallPellets, map.getSmallPellets().data(), map.getSmallPellets().wordCount() },
+        { "powerPellets", indexes->powerPellets, map.getPowerPellets().data(), map.getPowerPellets().wordCount() },
+        { "freeCells", indexes->freeCells, map.getFreeCells().data(), map.getFreeCells().wordCount() },
+        { "fruitCells", indexes->fruitCells, fruitCells.data(), words },
+    };
+    int failures = 0;
+    for (const Layer& layer : layers) {
+        int differ = layer.words == words ? 0 : words;
+        for (int w = 0; !differ && w < words; ++w)
+            differ = layer.compiled[w] != layer.built[w] ? w + 1 : 0;
+        if (differ) {
+            std::cerr << "index-check: " << layer.name << " differs" << (layer.words == words ? " in word " : ", word count ")
+                << (layer.words == words ? differ - 1 : layer.words) << std::endl;
+            failures++;
+        }
+    }
+    // Соседи и ходы - по клеткам
+    int stepsDiffer = 0, exitsDiffer = 0;
+    for (int cell = 0; cell < cells; ++cell) {
+        for (int d = 0; d < 4; ++d)
+            stepsDiffer += indexes->neighbours[cell * 4 + d] != graph.step(cell, d);
+        exitsDiffer += indexes->exits[cell] != graph.exitMask(cell);
+    }
+    if (stepsDiffer || exitsDiffer) {
+        std::cerr << "index-check: neighbours differ in " << stepsDiffer << " steps, exits in " << exitsDiffer << " cells" << std::endl;
+        failures++;
+    }
+
+    // Миры на готовых и построенных индексах играют одинаково
+    RandomInput input(seed);
+    long long t = 0;
+    for (; t < ticks; ++t) {
+        int direction = input.getDirection();
+        int a = fast.step(direction), b = built.step(direction);
+        if (fast.checksum() != built.checksum() || a != b) {
+            std::cerr << "index-check: the worlds diverge at tick " << t << std::endl;
+            failures++;
+            break;
+        }
+        if (a) {
+            fast.reset();
+            built.reset();
+        }
+    }
+
+    std::cout << "index-check: cells=" << cells << " layers=" << sizeof(layers) / sizeof(layers[0]) << " ticks=" << t
+        << " failures=" << failures << std::endl;
+    return failures ? EXIT_FAILURE : 0;
+}
+
+// Запись .pmr, разобранная на поля, чтобы --replay-check портил их по отдельности
+struct ReplayImage {
+    std::vector<std::uint8_t> prefix;       // "PMRP" и версия
+    std::uint64_t identity[4];              // зерно, отпечаток уровня, номер уровня, длина источника
+    std::vector<std::uint8_t> source;
+    std::uint64_t header[5];                // startX, startY, интервал сумм, такты, длина журнала
+    std::vector<std::uint8_t> events;
+    std::uint64_t checksumCount;
+    std::vector<std::uint8_t> checksums;    // по 4 байта на сумму
+
+    static void put(std::vector<std::uint8_t>& out, std::uint64_t value) {
+        for (; value >= 0x80; value >>= 7)
+            out.push_back((std::uint8_t)(value | 0x80));
+        out.push_back((std::uint8_t)value);
+    }
+    static std::uint64_t get(const std::vector<std::uint8_t>& in, std::size_t& at) {
+        std::uint64_t value = 0;
+        for (int shift = 0; at < in.size(); shift += 7) {
+            std::uint8_t byte = in[at++];
+            value |= (std::uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return value;
+    }
+    // bytes - заведомо правильная запись (Replay::write)
+    explicit ReplayImage(const std::vector<std::uint8_t>& bytes) : prefix(bytes.begin(), bytes.begin() + 5) {
+        std::size_t at = prefix.size();
+        for (std::uint64_t& value : identity)
+            value = get(bytes, at);
+        source.assign(bytes.begin() + at, bytes.begin() + at + identity[3]);
+        at += identity[3];
+        for (std::uint64_t& value : header)
+            value = get(bytes, at);
+        events.assign(bytes.begin() + at, bytes.begin() + at + header[4]);
+        at += header[4];
+        checksumCount = get(bytes, at);
+        checksums.assign(bytes.begin() + at, bytes.end());
+    }
+    std::vector<std::uint8_t> bytes() const {
+        std::vector<std::uint8_t> out = prefix;
+        for (std::uint64_t value : identity)
+            put(out, value);
+        out.insert(out.end(), source.begin(), source.end());
+        for (std::uint64_t value : header)
+            put(out, value);
+        out.insert(out.end(), events.begin(), events.end());
+        put(out, checksumCount);
+        out.insert(out.end(), checksums.begin(), checksums.end());
+        return out;
+    }
+};
+
+// Проверка записей для ctest: записанный прогон читается и проигрывается без
+// расхождений, а обрезанные и испорченные файлы отвергаются при чтении или
+// расходятся при проверке - без падения и без бесконечного проигрывания
+static int runReplayCheck(long long ticks, unsigned seed)
+{
+    const int FUZZ_ROUNDS = 1000;
+    if (ticks <= 0) {
+        std::cerr << "replay-check: --ticks must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const Level& level = LevelPack::builtin().get(0);
+    Simulation world(level, seed);
+    GreedyInput input(world, seed);
+    Replay recorder(level, "", 0, seed, world.getPacmanStartX(), world.getPacmanStartY());
+    for (long long t = 0; t < ticks; ++t) {
+        int direction = input.getDirection();
+        int result = world.step(direction);
+        recorder.recordStep(direction, world);
+        if (result) {
+            world.reset();
+            recorder.recordReset();
+        }
+    }
+    std::vector<std::uint8_t> saved;
+    recorder.write(saved);
+
+    int failures = 0;
+    Replay replay;
+    if (!replay.read(saved.data(), saved.size()) || replay.verify(level) != -1) {
+        std::cerr << "replay-check: the recorded replay does not verify" << std::endl;
+        failures++;
+    }
+
+    // На другом лабиринте (классический без одной точки) запись не проигрывается
+    std::string ascii = LevelPack::classicAscii();
+    ascii[ascii.find('o')] = ' ';
+    std::vector<std::uint8_t> packBytes;
+    LevelPack other;
+    std::string error;
+    if (!LevelPack::fromAscii({ ascii }, packBytes, error) || !other.assign(packBytes, error)) {
+        std::cerr << "replay-check: cannot build the second maze: " << error << std::endl;
+        failures++;
+    }
+    else if (!replay.read(saved.data(), saved.size()) || replay.verify(other.get(0)) != Replay::WRONG_LEVEL) {
+        std::cerr << "replay-check: a replay of the built-in maze is played on another maze" << std::endl;
+        failures++;
+    }
+
+    // Обрезанный файл не читается, какой бы длины ни был остаток
+    int truncatedAccepted = 0;
+    for (std::size_t size = 0; size < saved.size(); ++size)
+        truncatedAccepted += replay.read(saved.data(), size);
+    if (truncatedAccepted) {
+        std::cerr << "replay-check: " << truncatedAccepted << " truncated replays accepted" << std::endl;
+        failures++;
+    }
+
+    // Испорченные поля: чтение отвергает файл или проверка находит расхождение
+    int wallX = -1, wallY = -1;
+    for (int y = 0; wallX < 0 && y < level.info().height; ++y)
+        for (int x = 0; wallX < 0 && x < level.info().width; ++x)
+            if (!level.tiles()[(y + 1) * (level.info().width + 2) + x + 1].passable)
+                wallX = x, wallY = y;
+    const std::vector<std::function<void(ReplayImage&)>> corruptions = {
+        [](ReplayImage& r) { r.prefix[0] = 'X'; },
+        [](ReplayImage& r) { r.prefix[4]++; },
+        [](ReplayImage& r) { r.identity[0]++; },
+        [](ReplayImage& r) { r.identity[1] ^= 1; },
+        [](ReplayImage& r) { r.identity[2] = (std::uint64_t)INT_MAX + 1; },
+        [](ReplayImage& r) { r.identity[3] = Replay::MAX_SOURCE + 1; r.source.assign(Replay::MAX_SOURCE + 1, 'x'); },
+        [](ReplayImage& r) { r.identity[3]++; },
+        [](ReplayImage& r) { r.header[0] = 100000; },
+        [](ReplayImage& r) { r.header[1] = 100000; },
+        [](ReplayImage& r) { r.header[0] = ~0ull; },
+        [wallX, wallY](ReplayImage& r) { r.header[0] = (std::uint64_t)wallX; r.header[1] = (std::uint64_t)wallY; },
+        [](ReplayImage& r) { r.header[2] = 0; },
+        [](ReplayImage& r) { r.header[2] = 1ull << 32; },
+        [](ReplayImage& r) { r.header[2] = (std::uint64_t)INT_MAX + 1; },
+        [](ReplayImage& r) { r.header[3] = 1ull << 63; },
+        [](ReplayImage& r) { r.header[3] += r.header[2]; },
+        [](ReplayImage& r) { r.header[3] = 0; },
+        [](ReplayImage& r) { r.header[4]++; },
+        [](ReplayImage& r) { r.events.push_back(7); r.header[4]++; },
+        [](ReplayImage& r) { ReplayImage::put(r.events, (r.header[3] + 1) << 3); r.header[4] = r.events.size(); },
+        [](ReplayImage& r) { r.checksumCount = 0; r.checksums.clear(); },
+        [](ReplayImage& r) { r.checksumCount--; r.checksums.resize(r.checksums.size() - 4); },
+        [](ReplayImage& r) { r.checksums.push_back(0); },
+        [](ReplayImage& r) { r.checksums[0] ^= 1; },
+    };
+    int rejected = 0;
+    for (const auto& corrupt : corruptions) {
+        ReplayImage image(saved);
+        corrupt(image);
+        std::vector<std::uint8_t> bytes = image.bytes();
+        if (!replay.read(bytes.data(), bytes.size()) || replay.verify(level) != -1)
+            rejected++;
+    }
+    if (rejected != (int)corruptions.size()) {
+        std::cerr << "replay-check: " << corruptions.size() - rejected << " corrupted replays accepted" << std::endl;
+        failures++;
+    }
+
+    // Случайно испорченные байты: принятая запись проигрывается без падения;
+    // записи длиннее исходной не проигрываются, чтобы проверка не затянулась
+    std::mt19937 rng(seed);
+    int fuzzAccepted = 0;
+    for (int round = 0; round < FUZZ_ROUNDS; ++round) {
+        std::vector<std::uint8_t> bytes = saved;
+        bytes[5 + rng() % (bytes.size() - 5)] ^= (std::uint8_t)(1 + rng() % 255);
+        if (!replay.read(bytes.data(), bytes.size()))
+            continue;
+        fuzzAccepted++;
+        if (replay.getSteps() <= ticks)
+            replay.verify(level);
+    }
+
+    std::cout << "replay-check: ticks=" << ticks << " bytes=" << saved.size() << " truncated-accepted=" << truncatedAccepted
+        << " corrupted-rejected=" << rejected << "/" << corruptions.size() << " fuzz-accepted=" << fuzzAccepted << "/" << FUZZ_ROUNDS
+        << " failures=" << failures << std::endl;
+    return failures ? EXIT_FAILURE : 0;
+}
+
+int main(int argc, char** argv)
+{
+    long long ticks = 10000000;
+    unsigned seed = 1;
+    const char* tracePath = nullptr;
+    int batch = 0;
+    unsigned threads = 0;
+    long long maxTicks = 1000000;
+    const char* resultsPath = nullptr;
+    const char* recordPath = nullptr;
+    long long checksumInterval = Replay::DEFAULT_CHECKSUM_INTERVAL;
+    const char* levelsPath = nullptr;
+    int extraGhosts = 0;
+    std::vector<std::string> replayPaths;
+    bool autopilot = false;
+    AutopilotSettings autopilotSettings;
+    bool allocGate = false;
+    bool snapshotCheck = false;
+    bool replayCheck = false;
+    bool scenarioCheck = false;
+    bool indexCheck = false;
+    long long warmupTicks = 20000;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--ticks") && i + 1 < argc)
+            ticks = std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (!std::strcmp(argv[i], "--batch") && i + 1 < argc)
+            batch = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (!std::strcmp(argv[i], "--max-ticks") && i + 1 < argc)
+            maxTicks = std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--results") && i + 1 < argc)
+            resultsPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--record") && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--checksum-interval") && i + 1 < argc)
+            checksumInterval = std::atoll(argv[++i]);
+        else if (!std::strcmp(argv[i], "--replay") && i + 1 < argc)
+            replayPaths.push_back(argv[++i]);
+        else if (!std::strcmp(argv[i], "--levels") && i + 1 < argc)
+            levelsPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--ghosts") && i + 1 < argc)
+            extraGhosts = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--autopilot"))
+            autopilot = true;
+        else if (!std::strcmp(argv[i], "--budget-us") && i + 1 < argc)
+            autopilotSettings.budgetMicros = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--iterations") && i + 1 < argc)
+            autopilotSettings.iterations = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--alloc-gate"))
+            allocGate = true;
+        else if (!std::strcmp(argv[i], "--alloc-selftest")) {
+            bool ok = AllocationCounter::selfTest();
+            std::cout << "alloc-selftest: " << (ok ? "ok" : "FAILED, some operator new bypasses the counter") << std::endl;
+            return ok ? 0 : EXIT_FAILURE;
+        }
+        else if (!std::strcmp(argv[i], "--snapshot-check"))
+            snapshotCheck = true;
+        else if (!std::strcmp(argv[i], "--replay-check"))
+            replayCheck = true;
+        else if (!std::strcmp(argv[i], "--scenario-check"))
+            scenarioCheck = true;
+        else if (!std::strcmp(argv[i], "--index-check"))
+            indexCheck = true;
+        else if (!std::strcmp(argv[i], "--warmup") && i + 1 < argc)
+            warmupTicks = std::atoll(argv[++i]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--ticks N] [--seed S] [--levels pack.pmlv] [--ghosts G] [--threads T] [--trace file.json] [--record file.pmr [--checksum-interval K]] [autopilot]\n"
+                << "       " << argv[0] << " --batch N [--threads T] [--max-ticks M] [--seed S] [--levels pack.pmlv] [--results file.csv] [autopilot]\n"
+                << "       " << argv[0] << " --replay file.pmr [--replay file2.pmr ...] [--threads T] [--levels pack.pmlv]\n"
+                << "       " << argv[0] << " --alloc-gate [--warmup W] [--ticks N] [--seed S] [--ghosts G] [--threads T] [autopilot]\n"
+                << "       " << argv[0] << " --alloc-selftest\n"
+                << "       " << argv[0] << " --snapshot-check [--ticks N] [--seed S] [--levels pack.pmlv] [--ghosts G]\n"
+                << "       " << argv[0] << " --replay-check [--ticks N] [--seed S]\n"
+                << "       " << argv[0] << " --scenario-check [--seed S] [--levels pack.pmlv]\n"
+                << "       " << argv[0] << " --index-check [--ticks N] [--seed S]\n"
+                << "autopilot: --autopilot [--budget-us U] [--iterations I]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (allocGate && (batch > 0 || !replayPaths.empty() || recordPath || warmupTicks >= ticks)) {
+        std::cerr << "--alloc-gate runs a single simulation without --record, with --ticks above --warmup" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (allocGate && !AllocationCounter::selfTest()) {
+        std::cerr << "alloc-gate: the allocation counter misses some operator new" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!replayPaths.empty())
+        return runReplays(replayPaths, threads, levelsPath);
+    if (replayCheck)
+        return runReplayCheck(ticks, seed);
+    if (indexCheck)
+        return runIndexCheck(ticks, seed);
+
+    LevelPack pack;
+    if (levelsPath) {
+        std::string error;
+        if (pack.open(levelsPath, error) && !pack.size())
+            error = "no levels";
+        if (!pack.size()) {
+            std::cerr << "Error loading levels " << levelsPath << ": " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    const LevelPack& levels = levelsPath ? pack : LevelPack::builtin();
+    if (snapshotCheck)
+        return runSnapshotCheck(levels.get(0), ticks, seed, extraGhosts);
+    if (scenarioCheck)
+        return runScenarioCheck(levels.get(0), seed);
+    if (batch > 0)
+        return runBatch(levels, batch, threads, maxTicks, seed, resultsPath, autopilot ? &autopilotSettings : nullptr);
+    if (checksumInterval < 1 || checksumInterval > INT_MAX || (checksumInterval != Replay::DEFAULT_CHECKSUM_INTERVAL && !recordPath)) {
+        std::cerr << "--checksum-interval goes with --record and must be from 1 to " << INT_MAX << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (recordPath && extraGhosts) {
+        std::cerr << "Replays are recorded with four ghosts only" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (recordPath && levelsPath && std::strlen(levelsPath) > Replay::MAX_SOURCE) {
+        std::cerr << "Level pack path is too long to be stored in a replay" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Simulation simulation(levels.get(0), seed);
+    std::unique_ptr<ThreadPool> pool;
+    if (extraGhosts > 0) {
+        for (int i = 0; i < extraGhosts; ++i)
+            simulation.addGhost(static_cast<GhostArchetype>(i % ARCHETYPE_COUNT));
+        if (threads != 1) {
+            pool.reset(new ThreadPool(threads));
+            simulation.setThreadPool(pool.get());
+        }
+    }
+    std::unique_ptr<InputManager> input;
+    if (autopilot) {
+        if (threads != 1 && !pool)
+            pool.reset(new ThreadPool(threads));
+        autopilotSettings.seed = seed;
+        input.reset(new AutopilotInput(simulation, autopilotSettings, pool.get()));
+    }
+    else
+        input.reset(new RandomInput(seed));
+    // партии записи идут на первом уровне: без --alloc-gate новая партия - reset()
+    std::unique_ptr<Replay> recorder(recordPath ? new Replay(levels.get(0), levelsPath ? levelsPath : "", 0, seed,
+        simulation.getPacmanStartX(), simulation.getPacmanStartY(), (int)checksumInterval) : nullptr);
+    long long episodes = 0, won = 0, lost = 0;
+    long long allocationsAtWarmup = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long t = 0; t < ticks; ++t) {
+        if (allocGate && t == warmupTicks)
+            allocationsAtWarmup = AllocationCounter::count();
+        int direction = input->getDirection();
+        int result = simulation.step(direction);
+        if (recorder)
+            recorder->recordStep(direction, simulation);
+        if (result) {
+            episodes++;
+            if (result == 1) won++;
+            else lost++;
+            if (allocGate) {
+                // под проверкой новая партия начинается с load(), как в
+                // BatchRunner: уровни пакета по очереди, тот же состав призраков
+                simulation.load(levels.get((int)(episodes % levels.size())), seed + (unsigned)episodes);
+                for (int i = 0; i < extraGhosts; ++i)
+                    simulation.addGhost(static_cast<GhostArchetype>(i % ARCHETYPE_COUNT));
+            }
+            else
+                simulation.reset();
+            if (recorder)
+                recorder->recordReset();
+        }
+    }
+    auto finish = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(finish - start).count();
+
+    std::cout << "ticks=" << ticks << " episodes=" << episodes << " won=" << won << " lost=" << lost
+        << " record=" << simulation.getRecord() << " ghosts=" << simulation.getGhostCount() << " seconds=" << seconds
+        << " ticks/sec=" << (seconds > 0 ? ticks / seconds : 0) << std::endl;
+    if (autopilot) {
+        long long iterations = static_cast<AutopilotInput&>(*input).getIterations();
+        std::cout << "autopilot iterations=" << iterations << " iterations/sec=" << (seconds > 0 ? iterations / seconds : 0) << std::endl;
+    }
+#ifdef PACMAN_PROFILE
+    for (int phase = 0; phase < Profiler::getPhaseCount(); ++phase) {
+        Profiler::PhaseStats stats = Profiler::getStats(phase);
+        std::cout << stats.name << ": count=" << stats.count << " p50=" << stats.p50Us << "us p99=" << stats.p99Us
+            << "us max=" << stats.maxUs << "us" << std::endl;
+    }
+    if (tracePath && !Profiler::writeChromeTrace(tracePath))
+        std::cerr << "Error writing trace " << tracePath << std::endl;
+#else
+    if (tracePath)
+        std::cerr << "Built without PACMAN_PROFILE, no trace written" << std::endl;
+#endif
+    if (allocGate) {
+        long long allocations = AllocationCounter::count() - allocationsAtWarmup;
+        std::cout << "alloc-gate: allocations=" << allocations << " over " << ticks - warmupTicks << " ticks after "
+            << warmupTicks << " warm-up ticks" << std::endl;
+        if (allocations) {
+            std::cerr << "alloc-gate: steady-state ticks allocate memory" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (recorder) {
+        if (!recorder->save(recordPath)) {
+            std::cerr << "Error writing replay " << recordPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "recorded " << recorder->getSteps() << " ticks, input log " << recorder->getEventBytes() << " bytes" << std::endl;
+    }
+    return 0;
+}
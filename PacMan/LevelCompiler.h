@@ -0,0 +1,343 @@
+﻿#pragma once
+// Сборка уровня из текста (формат LevelPack::fromAscii) на этапе компиляции.
+// Результат - готовый образ пакета из одного уровня, те же байты, что выдаёт
+// fromAscii: программа не разбирает встроенный лабиринт, а смотрит в
+// константные данные. Проверки (checkLevel) идут в static_assert, поэтому
+// кривой лабиринт - ошибка сборки, а не запуска.
+//
+// Рядом с образом compileIndexes считает индексы, которые иначе строили бы
+// при загрузке Map::load и MazeGraph::build (LevelIndexes): соседей и ходы
+// клеток, развилки, слои стен, точек и пустых клеток. Они тоже лежат в
+// программе, а не в пакете, и достаются уровню через Level::precomputed.
+//
+// Оценка разбита на несколько constexpr-вычислений (размеры, образ, проверки,
+// индексы), чтобы каждое укладывалось в лимит шагов компилятора.
+#include "LevelPack.h"
+
+struct AsciiLevel {
+    // Число строк лабиринта: до первой пустой строки
+    static constexpr int height(const char* text) {
+        int rows = 0;
+        for (const char* p = text; *p && *p != '\n'; ++rows) {
+            while (*p && *p != '\n')
+                ++p;
+            if (*p)
+                ++p;
+        }
+        return rows;
+    }
+    // Длина самой длинной строки лабиринта
+    static constexpr int width(const char* text) {
+        int widest = 0;
+        for (const char* p = text; *p && *p != '\n';) {
+            int length = 0;
+            for (; *p && *p != '\n'; ++p)
+                ++length;
+            widest = length > widest ? length : widest;
+            if (*p)
+                ++p;
+        }
+        return widest;
+    }
+
+    static constexpr bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+    // Читает count целых начиная с p и сдвигает p за них; false, если чисел меньше
+    static constexpr bool readInts(const char*& p, std::int32_t* out, int count) {
+        for (int i = 0; i < count; ++i) {
+            while (isSpace(*p))
+                ++p;
+            bool negative = *p == '-';
+            if (negative)
+                ++p;
+            if (*p < '0' || *p > '9')
+                return false;
+            std::int32_t value = 0;
+            for (; *p >= '0' && *p <= '9'; ++p)
+                value = value * 10 + (*p - '0');
+            out[i] = negative ? -value : value;
+        }
+        return true;
+    }
+
+    static constexpr bool readPoints(const char*& p, LevelPoint* points, int count) {
+        for (int i = 0; i < count; ++i) {
+            std::int32_t xy[2] = {};
+            if (!readInts(p, xy, 2))
+                return false;
+            points[i] = { xy[0], xy[1] };
+        }
+        return true;
+    }
+
+    // Совпадает ли начало строки line с "key="; при совпадении value - начало значений
+    static constexpr bool isKey(const char* line, const char* key, const char*& value) {
+        for (; *key; ++key, ++line)
+            if (*line != *key)
+                return false;
+        if (*line != '=')
+            return false;
+        value = line + 1;
+        return true;
+    }
+
+    static constexpr const char* skipMaze(const char* text) {
+        const char* p = text;
+        while (*p && *p != '\n') {
+            while (*p && *p != '\n')
+                ++p;
+            if (*p)
+                ++p;
+        }
+        return *p ? p + 1 : p;
+    }
+
+    static constexpr bool inside(const LevelHeader& level, LevelPoint point) {
+        return point.x >= 0 && point.x < level.width && point.y >= 0 && point.y < level.height;
+    }
+
+    // Параметры уровня из строк "ключ=значения" после лабиринта; false при ошибке.
+    // Строже, чем разбор в fromAscii: строка без известного ключа - тоже ошибка
+    static constexpr bool readKeys(const char* text, LevelHeader& level) {
+        bool hasPacman = false, hasGhosts = false, hasHomes = false;
+        for (const char* line = skipMaze(text); *line;) {
+            const char* value = nullptr;
+            bool ok = true;
+            if (*line != '\n' && *line != '\r') {
+                if (isKey(line, "name", value)) {
+                    for (int i = 0; i + 1 < (int)sizeof(level.name) && value[i] && value[i] != '\n' && value[i] != '\r'; ++i)
+                        level.name[i] = value[i];
+                }
+                else if (isKey(line, "pacman", value))
+                    ok = hasPacman = readPoints(value, &level.pacman, 1);
+                else if (isKey(line, "ghosts", value))
+                    ok = hasGhosts = readPoints(value, level.ghostSpawn, LEVEL_GHOSTS);
+                else if (isKey(line, "homes", value))
+                    ok = hasHomes = readPoints(value, level.ghostHome, LEVEL_GHOSTS);
+                else if (isKey(line, "tunnel", value)) {
+                    std::int32_t tunnel[3] = {};
+                    ok = level.tunnelCount < LEVEL_MAX_TUNNELS && readInts(value, tunnel, 3);
+                    if (ok)
+                        level.tunnels[level.tunnelCount++] = { tunnel[0], tunnel[1], tunnel[2] };
+                }
+                else if (isKey(line, "fruit", value))
+                    ok = readPoints(value, &level.fruitMin, 1) && readPoints(value, &level.fruitMax, 1);
+                else
+                    ok = false;
+            }
+            if (!ok)
+                return false;
+            while (*line && *line != '\n')
+                ++line;
+            if (*line)
+                ++line;
+        }
+        return hasPacman && hasGhosts && hasHomes;
+    }
+};
+
+// Образ пакета с одним уровнем; раскладка совпадает с выводом fromAscii
+template <int W, int H>
+struct CompiledLevel {
+    LevelPackHeader pack;
+    LevelEntry entry;
+    LevelHeader level;
+    LevelTile tiles[(W + 2) * (H + 2)];
+};
+
+// Итоги проверок уровня; каждое поле проверяется своим static_assert
+struct LevelCheck {
+    bool keysValid;         // есть pacman, ghosts и homes, значения разобраны, чужих ключей нет
+    bool rowsSameWidth;
+    bool pointsInside;      // старты, дома, концы туннелей и область фруктов внутри лабиринта
+    bool startsPassable;    // Пакман и призраки стоят не в стене
+    bool pelletsReachable;  // до каждой точки можно дойти от старта Пакмана
+};
+
+
+// Образ пакета из текста уровня; W и H - AsciiLevel::width/height того же текста.
+// Ошибки разбора не прерывают сборку образа, их ловит checkLevel
+template <int W, int H>
+constexpr CompiledLevel<W, H> compileLevel(const char* text) {
+    CompiledLevel<W, H> out{};
+    out.pack.magic[0] = 'P';
+    out.pack.magic[1] = 'M';
+    out.pack.magic[2] = 'L';
+    out.pack.magic[3] = 'V';
+    out.pack.version = LEVEL_PACK_VERSION;
+    out.pack.levelCount = 1;
+    out.entry.offset = sizeof(LevelPackHeader) + sizeof(LevelEntry);
+    out.entry.size = sizeof(LevelHeader) + sizeof(out.tiles);
+    LevelHeader& level = out.level;
+    level.width = W;
+    level.height = H;
+    level.fruitMax = { W - 1, H - 1 };
+    AsciiLevel::readKeys(text, level);
+
+    const int stride = W + 2;
+    for (int cell = 0; cell < (W + 2) * (H + 2); ++cell)
+        out.tiles[cell] = { '#', 0 };   // рамка, как BORDER_TILE в LevelPack.cpp
+    const char* p = text;
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            char type = *p && *p != '\n' ? *p++ : ' ';
+            out.tiles[(y + 1) * stride + x + 1] = { type, (std::uint8_t)(type != 'X') };
+            level.smallFood += type == 'o';
+            level.bigFood += type == 'O';
+        }
+        while (*p && *p != '\n')
+            ++p;
+        if (*p)
+            ++p;
+    }
+    return out;
+}
+
+// Проверки образа и исходного текста. Ходы - как у MazeGraph::build: туннель
+// переносит на другой конец, из клеток за входом в туннель нельзя вверх и вниз
+// (tunnelStepX и isBeyondTunnel из LevelPack.h - общие с Map)
+template <int W, int H>
+constexpr LevelCheck checkLevel(const CompiledLevel<W, H>& compiled, const char* text) {
+    LevelCheck check{};
+    LevelHeader keys{};
+    check.keysValid = AsciiLevel::readKeys(text, keys);
+
+    check.rowsSameWidth = true;
+    for (const char* p = text; *p && *p != '\n';) {
+        int length = 0;
+        for (; *p && *p != '\n'; ++p)
+            ++length;
+        check.rowsSameWidth = check.rowsSameWidth && length == W;
+        if (*p)
+            ++p;
+    }
+
+    const LevelHeader& level = compiled.level;
+    check.pointsInside = AsciiLevel::inside(level, level.pacman) && AsciiLevel::inside(level, level.fruitMin)
+        && AsciiLevel::inside(level, level.fruitMax) && level.fruitMin.x <= level.fruitMax.x && level.fruitMin.y <= level.fruitMax.y;
+    for (int g = 0; g < LEVEL_GHOSTS; ++g)
+        check.pointsInside = check.pointsInside && AsciiLevel::inside(level, level.ghostSpawn[g]) && AsciiLevel::inside(level, level.ghostHome[g]);
+    for (int t = 0; t < level.tunnelCount; ++t) {
+        const LevelTunnel& tunnel = level.tunnels[t];
+        check.pointsInside = check.pointsInside && AsciiLevel::inside(level, { tunnel.leftX, tunnel.y })
+            && AsciiLevel::inside(level, { tunnel.rightX, tunnel.y }) && tunnel.leftX + 1 < tunnel.rightX;
+    }
+    if (!check.pointsInside)
+        return check;
+
+    const int stride = W + 2;
+    auto cellOf = [stride](LevelPoint point) { return (point.y + 1) * stride + point.x + 1; };
+    check.startsPassable = compiled.tiles[cellOf(level.pacman)].passable;
+    for (int g = 0; g < LEVEL_GHOSTS; ++g)
+        check.startsPassable = check.startsPassable && compiled.tiles[cellOf(level.ghostSpawn[g])].passable;
+
+    // Поиск в ширину от Пакмана; очередь - массив клеток, пройденные помечены в reached
+    bool reached[(W + 2) * (H + 2)] = {};
+    int queue[(W + 2) * (H + 2)] = {};
+    int tail = 0;
+    queue[tail++] = cellOf(level.pacman);
+    reached[queue[0]] = true;
+    for (int head = 0; head < tail; ++head) {
+        const int cell = queue[head];
+        const int x = cell % stride - 1, y = cell / stride - 1;
+        const int next[4] = { cell - stride, cell + stride, cellOf({ tunnelStepX(level, y, x, 2), y }), cellOf({ tunnelStepX(level, y, x, 3), y }) };
+        for (int d = isBeyondTunnel(level, y, x) ? 2 : 0; d < 4; ++d)
+            if (compiled.tiles[next[d]].passable && !reached[next[d]]) {
+                reached[next[d]] = true;
+                queue[tail++] = next[d];
+            }
+    }
+    check.pelletsReachable = true;
+    for (int cell = 0; cell < (W + 2) * (H + 2); ++cell) {
+        char type = compiled.tiles[cell].type;
+        check.pelletsReachable = check.pelletsReachable && (reached[cell] || (type != 'o' && type != 'O'));
+    }
+    return check;
+}
+
+// Индексы уровня для LevelIndexes; раскладка массивов - как в Map и MazeGraph
+template <int W, int H>
+struct CompiledIndexes {
+    static constexpr int CELLS = (W + 2) * (H + 2);
+    static constexpr int WORDS = (CELLS + 63) / 64;
+    std::int32_t neighbours[CELLS * 4];
+    std::uint8_t exits[CELLS];
+    std::uint64_t reachable[WORDS];
+    std::uint64_t junctions[WORDS];
+    std::uint64_t walls[WORDS];
+    std::uint64_t smallPellets[WORDS];
+    std::uint64_t powerPellets[WORDS];
+    std::uint64_t freeCells[WORDS];
+    std::uint64_t fruitCells[WORDS];
+
+    constexpr LevelIndexes view() const {
+        return { neighbours, exits, reachable, junctions, walls, smallPellets, powerPellets, freeCells, fruitCells };
+    }
+};
+
+// Те же правила, что в рантайме: шаги и маски ходов - MazeGraph::build с
+// общими tunnelStepX и isBeyondTunnel, развилки - достижимые клетки, где ходов не
+// два, слои - Map::index
+template <int W, int H>
+constexpr CompiledIndexes<W, H> compileIndexes(const CompiledLevel<W, H>& compiled) {
+    using Indexes = CompiledIndexes<W, H>;
+    Indexes out{};
+    const LevelHeader& level = compiled.level;
+    const int stride = W + 2;
+    auto setBit = [](std::uint64_t* words, int cell) { words[cell >> 6] |= 1ull << (cell & 63); };
+    auto testBit = [](const std::uint64_t* words, int cell) { return ((words[cell >> 6] >> (cell & 63)) & 1) != 0; };
+
+    for (int cell = 0; cell < Indexes::CELLS; ++cell) {
+        for (int d = 0; d < 4; ++d)
+            out.neighbours[cell * 4 + d] = -1;
+        if (!compiled.tiles[cell].passable)
+            setBit(out.walls, cell);
+    }
+    for (int y = 0; y < H; ++y)
+        for (int x = 0; x < W; ++x) {
+            const int cell = (y + 1) * stride + x + 1;
+            // шаги влево и вправо через туннель - по тем же правилам, что Map::stepX
+            const int left = tunnelStepX(level, y, x, 2), right = tunnelStepX(level, y, x, 3);
+            const bool beyondTunnel = isBeyondTunnel(level, y, x);
+            const int next[4] = { cell - stride, cell + stride, (y + 1) * stride + left + 1, (y + 1) * stride + right + 1 };
+            std::uint8_t mask = 0;
+            for (int d = 0; d < 4; ++d) {
+                out.neighbours[cell * 4 + d] = next[d];
+                if (compiled.tiles[next[d]].passable && (d >= 2 || !beyondTunnel))
+                    mask |= 1 << d;
+            }
+            out.exits[cell] = mask;
+
+            const LevelTile& tile = compiled.tiles[cell];
+            bool fruitArea = x >= level.fruitMin.x && x <= level.fruitMax.x && y >= level.fruitMin.y && y <= level.fruitMax.y;
+            if (tile.type == 'o')
+                setBit(out.smallPellets, cell);
+            if (tile.type == 'O')
+                setBit(out.powerPellets, cell);
+            if (fruitArea && tile.type == ' ')
+                setBit(out.freeCells, cell);
+            if (fruitArea && (tile.passable || tile.type == ' '))
+                setBit(out.fruitCells, cell);
+        }
+
+    // Достижимые от старта Пакмана по разрешённым ходам
+    int queue[Indexes::CELLS] = {};
+    int tail = 0;
+    queue[tail++] = (level.pacman.y + 1) * stride + level.pacman.x + 1;
+    setBit(out.reachable, queue[0]);
+    for (int head = 0; head < tail; ++head)
+        for (int d = 0; d < 4; ++d) {
+            const int next = out.neighbours[queue[head] * 4 + d];
+            if (((out.exits[queue[head]] >> d) & 1) && !testBit(out.reachable, next)) {
+                setBit(out.reachable, next);
+                queue[tail++] = next;
+            }
+        }
+    for (int cell = 0; cell < Indexes::CELLS; ++cell) {
+        const std::uint8_t mask = out.exits[cell];
+        const int moves = (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+        if (testBit(out.reachable, cell) && mask && moves != 2)
+            setBit(out.junctions, cell);
+    }
+    return out;
+}
@@ -0,0 +1,388 @@
+﻿#include "LevelPack.h"
+#include "LevelCompiler.h"
+#include <cstring>
+#include <sstream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char PACK_MAGIC[4] = { 'P', 'M', 'L', 'V' };
+const int MAX_SIDE = 1024;
+const LevelTile BORDER_TILE = { '#', 0 };   // как SENTINEL_TILE
+
+constexpr char CLASSIC_LEVEL[] =
+    "                              \n"
+    "                              \n"
+    "                              \n"
+    " XXXXXXXXXXXXXXXXXXXXXXXXXXXX \n"
+    " XooooooooooooXXooooooooooooX \n"
+    " XoXXXXoXXXXXoXXoXXXXXoXXXXoX \n"
+    " XOXXXXoXXXXXoXXoXXXXXoXXXXOX \n"
+    " XoXXXXoXXXXXoXXoXXXXXoXXXXoX \n"
+    " XooooooooooooooooooooooooooX \n"
+    " XoXXXXoXXoXXXXXXXXoXXoXXXXoX \n"
+    " XoXXXXoXXoXXXXXXXXoXXoXXXXoX \n"
+    " XooooooXXooooXXooooXXooooooX \n"
+    " XXXXXXoXXXXX XX XXXXXoXXXXXX \n"
+    " nnnnnXoXXXXX XX XXXXXoXnnnnn \n"
+    " nnnnnXoXX          XXoXnnnnn \n"
+    " nnnnnXoXX XXXXXXXX XXoXnnnnn \n"
+    " XXXXXXoXX XnnnnnnX XXoXXXXXX \n"
+    "       o   XnnnnnnX   o       \n"
+    " XXXXXXoXX XnnnnnnX XXoXXXXXX \n"
+    " nnnnnXoXX XXXXXXXX XXoXnnnnn \n"
+    " nnnnnXoXX          XXoXnnnnn \n"
+    " nnnnnXoXX XXXXXXXX XXoXnnnnn \n"
+    " XXXXXXoXX XXXXXXXX XXoXXXXXX \n"
+    " XooooooooooooXXooooooooooooX \n"
+    " XoXXXXoXXXXXoXXoXXXXXoXXXXoX \n"
+    " XoXXXXoXXXXXoXXoXXXXXoXXXXoX \n"
+    " XOooXXooooooooooooooooXXooOX \n"
+    " XXXoXXoXXoXXXXXXXXoXXoXXoXXX \n"
+    " XXXoXXoXXoXXXXXXXXoXXoXXoXXX \n"
+    " XooooooXXooooXXooooXXooooooX \n"
+    " XoXXXXXXXXXXoXXoXXXXXXXXXXoX \n"
+    " XoXXXXXXXXXXoXXoXXXXXXXXXXoX \n"
+    " XooooooooooooooooooooooooooX \n"
+    " XXXXXXXXXXXXXXXXXXXXXXXXXXXX \n"
+    "                              \n"
+    "\n"
+    "name=classic\n"
+    "pacman=14 26\n"
+    "ghosts=11 14 13 14 15 14 17 14\n"
+    "homes=13 16 16 16 13 18 16 18\n"
+    "tunnel=17 1 28\n"
+    "fruit=4 4 26 33\n";
+
+// Классический лабиринт собирается в образ пакета при компиляции
+constexpr int CLASSIC_WIDTH = AsciiLevel::width(CLASSIC_LEVEL);
+constexpr int CLASSIC_HEIGHT = AsciiLevel::height(CLASSIC_LEVEL);
+constexpr CompiledLevel<CLASSIC_WIDTH, CLASSIC_HEIGHT> CLASSIC_IMAGE = compileLevel<CLASSIC_WIDTH, CLASSIC_HEIGHT>(CLASSIC_LEVEL);
+constexpr LevelCheck CLASSIC_CHECK = checkLevel(CLASSIC_IMAGE, CLASSIC_LEVEL);
+static_assert(CLASSIC_CHECK.keysValid, "classic maze: bad or missing pacman/ghosts/homes/tunnel/fruit key");
+static_assert(CLASSIC_CHECK.rowsSameWidth, "classic maze: rows differ in width");
+static_assert(CLASSIC_CHECK.pointsInside, "classic maze: start, home, tunnel or fruit area outside the maze");
+static_assert(CLASSIC_CHECK.startsPassable, "classic maze: Pac-Man or a ghost starts inside a wall");
+static_assert(CLASSIC_CHECK.pelletsReachable, "classic maze: a pellet cannot be reached from the Pac-Man start");
+static_assert(CLASSIC_IMAGE.level.smallFood + CLASSIC_IMAGE.level.bigFood > 0, "classic maze: no pellets");
+constexpr CompiledIndexes<CLASSIC_WIDTH, CLASSIC_HEIGHT> CLASSIC_INDEXES = compileIndexes(CLASSIC_IMAGE);
+constexpr LevelIndexes CLASSIC_INDEXES_VIEW = CLASSIC_INDEXES.view();
+
+bool inside(const LevelHeader& level, LevelPoint point) {
+    return point.x >= 0 && point.x < level.width && point.y >= 0 && point.y < level.height;
+}
+
+bool readPoints(std::istringstream& values, LevelPoint* points, int count) {
+    for (int i = 0; i < count; ++i)
+        if (!(values >> points[i].x >> points[i].y))
+            return false;
+    return true;
+}
+
+bool parseLevel(const std::string& source, LevelHeader& level, std::vector<LevelTile>& tiles, std::string& error) {
+    std::istringstream in(source);
+    std::vector<std::string> rows;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            break;
+        rows.push_back(line);
+    }
+    std::memset(&level, 0, sizeof(level));
+    level.height = (std::int32_t)rows.size();
+    for (const std::string& row : rows)
+        if ((std::int32_t)row.size() > level.width)
+            level.width = (std::int32_t)row.size();
+    if (level.width < 3 || level.height < 3 || level.width > MAX_SIDE || level.height > MAX_SIDE) {
+        error = "maze must be between 3 and 1024 cells on each side";
+        return false;
+    }
+    level.fruitMax = { level.width - 1, level.height - 1 };
+
+    bool hasPacman = false, hasGhosts = false, hasHomes = false;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::size_t eq = line.find('=');
+        if (line.empty() || eq == std::string::npos)
+            continue;
+        std::string key = line.substr(0, eq);
+        std::istringstream values(line.substr(eq + 1));
+        bool ok;
+        if (key == "name") {
+            std::strncpy(level.name, line.c_str() + eq + 1, sizeof(level.name) - 1);
+            ok = true;
+        }
+        else if (key == "pacman")
+            ok = hasPacman = readPoints(values, &level.pacman, 1);
+        else if (key == "ghosts")
+            ok = hasGhosts = readPoints(values, level.ghostSpawn, LEVEL_GHOSTS);
+        else if (key == "homes")
+            ok = hasHomes = readPoints(values, level.ghostHome, LEVEL_GHOSTS);
+        else if (key == "tunnel") {
+            LevelTunnel tunnel;
+            ok = level.tunnelCount < LEVEL_MAX_TUNNELS && (bool)(values >> tunnel.y >> tunnel.leftX >> tunnel.rightX);
+            if (ok)
+                level.tunnels[level.tunnelCount++] = tunnel;
+        }
+        else if (key == "fruit")
+            ok = readPoints(values, &level.fruitMin, 1) && readPoints(values, &level.fruitMax, 1);
+        else {
+            error = "unknown key '" + key + "'";
+            return false;
+        }
+        if (!ok) {
+            error = "bad value for '" + key + "'";
+            return false;
+        }
+    }
+    if (!hasPacman || !hasGhosts || !hasHomes) {
+        error = "pacman, ghosts and homes are required";
+        return false;
+    }
+
+    const int stride = level.width + 2;
+    tiles.assign((std::size_t)(level.height + 2) * stride, BORDER_TILE);
+    for (int y = 0; y < level.height; ++y)
+        for (int x = 0; x < level.width; ++x) {
+            char type = x < (int)rows[y].size() ? rows[y][x] : ' ';
+            tiles[(std::size_t)(y + 1) * stride + x + 1] = { type, (std::uint8_t)(type != 'X') };
+            level.smallFood += type == 'o';
+            level.bigFood += type == 'O';
+        }
+    return true;
+}
+
+}
+
+LevelPack::LevelPack() : base(nullptr), length(0), mapping(nullptr)
+#ifdef _WIN32
+    , file(nullptr), mappingHandle(nullptr)
+#endif
+{
+}
+
+LevelPack::~LevelPack()
+{
+    close();
+}
+
+void LevelPack::close()
+{
+#ifdef _WIN32
+    if (mapping)
+        UnmapViewOfFile(mapping);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (file)
+        CloseHandle(file);
+    file = mappingHandle = nullptr;
+#else
+    if (mapping)
+        munmap(mapping, length);
+#endif
+    mapping = nullptr;
+    owned.clear();
+    base = nullptr;
+    length = 0;
+    levels.clear();
+}
+
+bool LevelPack::open(const std::string& path, std::string& error)
+{
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        error = "cannot open " + path;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = (std::size_t)fileSize.QuadPart;
+    mappingHandle = length ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    mapping = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open " + path;
+        return false;
+    }
+    struct stat info;
+    length = fstat(fd, &info) == 0 ? (std::size_t)info.st_size : 0;
+    void* view = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    mapping = view == MAP_FAILED ? nullptr : view;
+#endif
+    if (!mapping) {
+        close();
+        error = "cannot map " + path;
+        return false;
+    }
+    base = static_cast<const std::uint8_t*>(mapping);
+    if (!index(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool LevelPack::assign(std::vector<std::uint8_t> bytes, std::string& error)
+{
+    close();
+    owned = std::move(bytes);
+    base = owned.data();
+    length = owned.size();
+    if (!index(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool LevelPack::view(const void* data, std::size_t size, std::string& error)
+{
+    close();
+    base = static_cast<const std::uint8_t*>(data);
+    length = size;
+    if (!index(error)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool LevelPack::index(std::string& error)
+{
+    // Проверяем всё, на что потом полагается симуляция, чтобы дальше читать без проверок
+    const LevelPackHeader* pack = reinterpret_cast<const LevelPackHeader*>(base);
+    if (length < sizeof(LevelPackHeader) || std::memcmp(pack->magic, PACK_MAGIC, 4) || pack->version != LEVEL_PACK_VERSION) {
+        error = "not a level pack";
+        return false;
+    }
+    if (pack->levelCount > (length - sizeof(LevelPackHeader)) / sizeof(LevelEntry)) {
+        error = "truncated level table";
+        return false;
+    }
+    const LevelEntry* entries = reinterpret_cast<const LevelEntry*>(pack + 1);
+    levels.clear();
+    levels.reserve(pack->levelCount);
+    for (std::uint32_t i = 0; i < pack->levelCount; ++i) {
+        const LevelEntry& entry = entries[i];
+        std::string where = "level " + std::to_string(i) + ": ";
+        if (entry.offset % alignof(LevelHeader) || entry.offset > length || entry.size > length - entry.offset || entry.size < sizeof(LevelHeader)) {
+            error = where + "bad offset";
+            return false;
+        }
+        const LevelHeader& level = *reinterpret_cast<const LevelHeader*>(base + entry.offset);
+        if (level.width < 3 || level.height < 3 || level.width > MAX_SIDE || level.height > MAX_SIDE
+            || entry.size - sizeof(LevelHeader) < (std::size_t)(level.width + 2) * (level.height + 2) * sizeof(LevelTile)) {
+            error = where + "bad size";
+            return false;
+        }
+        bool pointsOk = inside(level, level.pacman) && inside(level, level.fruitMin) && inside(level, level.fruitMax)
+            && level.fruitMin.x <= level.fruitMax.x && level.fruitMin.y <= level.fruitMax.y
+            && level.tunnelCount >= 0 && level.tunnelCount <= LEVEL_MAX_TUNNELS;
+        for (int g = 0; g < LEVEL_GHOSTS; ++g)
+            pointsOk = pointsOk && inside(level, level.ghostSpawn[g]) && inside(level, level.ghostHome[g]);
+        for (int t = 0; pointsOk && t < level.tunnelCount; ++t) {
+            const LevelTunnel& tunnel = level.tunnels[t];
+            pointsOk = inside(level, { tunnel.leftX, tunnel.y }) && inside(level, { tunnel.rightX, tunnel.y }) && tunnel.leftX + 1 < tunnel.rightX;
+        }
+        if (!pointsOk || level.smallFood < 0 || level.bigFood < 0) {
+            error = where + "position outside the maze";
+            return false;
+        }
+        Level view(&level);
+        const LevelTile* tiles = view.tiles();
+        const int stride = level.width + 2;
+        int smallFood = 0, bigFood = 0;
+        for (int y = 0; y < level.height + 2; ++y)
+            for (int x = 0; x < stride; ++x) {
+                const LevelTile& tile = tiles[(std::size_t)y * stride + x];
+                bool border = y == 0 || x == 0 || y == level.height + 1 || x == stride - 1;
+                if (tile.passable > 1 || (border && tile.passable)) {
+                    error = where + "bad tile";
+                    return false;
+                }
+                smallFood += tile.type == 'o';
+                bigFood += tile.type == 'O';
+            }
+        // Счётчики еды в заголовке - условие победы и порог появления фруктов,
+        // поэтому должны совпадать с точками в клетках
+        if (smallFood != level.smallFood || bigFood != level.bigFood) {
+            error = where + "food counts do not match the pellets in the maze";
+            return false;
+        }
+        auto passable = [&](LevelPoint point) { return tiles[(std::size_t)(point.y + 1) * stride + point.x + 1].passable; };
+        if (!passable(level.pacman)) {
+            error = where + "pacman starts inside a wall";
+            return false;
+        }
+        for (int g = 0; g < LEVEL_GHOSTS; ++g)
+            if (!passable(level.ghostSpawn[g])) {
+                error = where + "ghost " + std::to_string(g) + " starts inside a wall";
+                return false;
+            }
+        levels.push_back(view);
+    }
+    return true;
+}
+
+bool LevelPack::fromAscii(const std::vector<std::string>& sources, std::vector<std::uint8_t>& out, std::string& error)
+{
+    std::size_t offset = sizeof(LevelPackHeader) + sources.size() * sizeof(LevelEntry);
+    out.assign(offset, 0);
+    LevelPackHeader pack;
+    std::memcpy(pack.magic, PACK_MAGIC, 4);
+    pack.version = LEVEL_PACK_VERSION;
+    pack.levelCount = (std::uint32_t)sources.size();
+    pack.reserved = 0;
+    std::memcpy(out.data(), &pack, sizeof(pack));
+
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        LevelHeader level;
+        std::vector<LevelTile> tiles;
+        if (!parseLevel(sources[i], level, tiles, error)) {
+            error = "level " + std::to_string(i) + ": " + error;
+            return false;
+        }
+        offset = (out.size() + 7) & ~(std::size_t)7;
+        LevelEntry entry = { (std::uint32_t)offset, (std::uint32_t)(sizeof(level) + tiles.size() * sizeof(LevelTile)) };
+        out.resize(offset + entry.size, 0);
+        std::memcpy(out.data() + offset, &level, sizeof(level));
+        std::memcpy(out.data() + offset + sizeof(level), tiles.data(), tiles.size() * sizeof(LevelTile));
+        std::memcpy(out.data() + sizeof(LevelPackHeader) + i * sizeof(LevelEntry), &entry, sizeof(entry));
+    }
+    return true;
+}
+
+const char* LevelPack::classicAscii()
+{
+    return CLASSIC_LEVEL;
+}
+
+const LevelPack& LevelPack::builtin()
+{
+    static LevelPack pack;
+    static bool ready = [] {
+        std::string error;
+        if (!pack.view(&CLASSIC_IMAGE, sizeof(CLASSIC_IMAGE), error))
+            return false;
+        // индексы тоже посчитаны при компиляции
+        pack.levels[0] = Level(&pack.levels[0].info(), &CLASSIC_INDEXES_VIEW);
+        return true;
+    }();
+    (void)ready;
+    return pack;
+}
@@ -0,0 +1,158 @@
+﻿#pragma once
+// Пакет уровней: один двоичный файл с любым числом лабиринтов. Файл
+// отображается в память (mmap / MapViewOfFile) и не разбирается: заголовки
+// уровней и клетки читаются прямо из отображения, а Map::load копирует
+// клетки одним memcpy. Смена уровня или новая партия не стоят ни разбора,
+// ни выделения памяти.
+//
+// Формат (little-endian, все поля выровнены):
+//   LevelPackHeader, затем LevelEntry[levelCount] - смещения уровней от
+//   начала файла; каждый уровень - LevelHeader и сразу за ним клетки
+//   (height + 2) * (width + 2) по LevelTile, по строкам, вместе с рамкой.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const int LEVEL_GHOSTS = 4;
+const int LEVEL_MAX_TUNNELS = 4;
+const std::uint32_t LEVEL_PACK_VERSION = 1;
+
+struct LevelPoint {
+    std::int32_t x, y;
+};
+
+// Горизонтальный туннель: шаг влево из (y, leftX) ведёт в (y, rightX) и наоборот
+struct LevelTunnel {
+    std::int32_t y, leftX, rightX;
+};
+
+// Клетка в файле; раскладка совпадает с Tile
+struct LevelTile {
+    char type;
+    std::uint8_t passable;
+};
+
+struct LevelPackHeader {
+    char magic[4];                  // "PMLV"
+    std::uint32_t version;
+    std::uint32_t levelCount;
+    std::uint32_t reserved;
+};
+
+struct LevelEntry {
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+struct LevelHeader {
+    char name[32];
+    std::int32_t width, height;
+    LevelPoint pacman;                          // старт Пакмана
+    LevelPoint ghostSpawn[LEVEL_GHOSTS];        // старт призраков: Blinky, Pinky, Inky, Clyde
+    LevelPoint ghostHome[LEVEL_GHOSTS];         // куда возвращается съеденный призрак
+    std::int32_t tunnelCount;
+    LevelTunnel tunnels[LEVEL_MAX_TUNNELS];
+    std::int32_t smallFood, bigFood;            // число маленьких и больших точек
+    LevelPoint fruitMin, fruitMax;              // область появления фруктов, включительно
+};
+
+// Ходы через туннели - одни правила для Map (при игре) и LevelCompiler.h (при
+// компиляции). direction 2 - влево, 3 - вправо. x после шага: первый туннель
+// ряда, у входа в который стоим, переносит на другой конец, иначе соседняя клетка
+constexpr int tunnelStepX(const LevelHeader& level, int y, int x, int direction) {
+    for (int i = 0; i < level.tunnelCount; ++i) {
+        const LevelTunnel& tunnel = level.tunnels[i];
+        if (tunnel.y == y && direction == 2 && tunnel.leftX == x)
+            return tunnel.rightX;
+        if (tunnel.y == y && direction == 3 && tunnel.rightX == x)
+            return tunnel.leftX;
+    }
+    return direction == 2 ? x - 1 : x + 1;
+}
+// Клетка за входом в туннель: оттуда нельзя уходить вверх и вниз
+constexpr bool isBeyondTunnel(const LevelHeader& level, int y, int x) {
+    for (int i = 0; i < level.tunnelCount; ++i) {
+        const LevelTunnel& tunnel = level.tunnels[i];
+        if (tunnel.y == y && (x < tunnel.leftX || x > tunnel.rightX))
+            return true;
+    }
+    return false;
+}
+
+// Индексы уровня, посчитанные при компиляции (LevelCompiler.h). Есть только у
+// встроенных уровней: Map::load и MazeGraph::build берут их готовыми, а не
+// обходят клетки. Массивы - по номерам клеток с рамкой (Map::cellId), битовые
+// слои - по 64 клетки в слове
+struct LevelIndexes {
+    const std::int32_t* neighbours;     // 4 на клетку: куда ведёт шаг (MazeGraph::step), у рамки -1
+    const std::uint8_t* exits;          // разрешённые ходы (MazeGraph::exitMask)
+    const std::uint64_t* reachable;     // клетки, куда можно дойти от старта Пакмана
+    const std::uint64_t* junctions;     // развилки MazeGraph
+    const std::uint64_t* walls;         // непроходимые клетки вместе с рамкой
+    const std::uint64_t* smallPellets;
+    const std::uint64_t* powerPellets;
+    const std::uint64_t* freeCells;     // пустые клетки области фруктов в начале партии
+    const std::uint64_t* fruitCells;    // клетки области фруктов, которые могут быть пустыми
+};
+
+// Уровень внутри пакета; не владеет памятью и живёт, пока жив пакет
+class Level {
+private:
+    const LevelHeader* header;
+    const LevelIndexes* indexes;        // nullptr, если уровень не встроенный
+public:
+    Level(const LevelHeader* header = nullptr, const LevelIndexes* indexes = nullptr) : header(header), indexes(indexes) {}
+    const LevelHeader& info() const { return *header; }
+    const LevelIndexes* precomputed() const { return indexes; }
+    const LevelTile* tiles() const { return reinterpret_cast<const LevelTile*>(header + 1); }
+    std::size_t tileCount() const { return (std::size_t)(header->height + 2) * (header->width + 2); }
+};
+
+class LevelPack {
+private:
+    const std::uint8_t* base;
+    std::size_t length;
+    std::vector<std::uint8_t> owned;    // пакет, собранный в памяти
+    void* mapping;                      // отображение файла, если пакет открыт из файла
+#ifdef _WIN32
+    void* file;
+    void* mappingHandle;
+#endif
+    std::vector<Level> levels;
+
+    bool index(std::string& error);
+    void close();
+public:
+    LevelPack();
+    ~LevelPack();
+    LevelPack(const LevelPack&) = delete;
+    LevelPack& operator=(const LevelPack&) = delete;
+
+    // false и текст ошибки в error, если файл не читается или повреждён
+    bool open(const std::string& path, std::string& error);
+    // Пакет из уже собранных байтов (см. fromAscii)
+    bool assign(std::vector<std::uint8_t> bytes, std::string& error);
+    // Пакет в чужой памяти без копирования (образ из LevelCompiler.h);
+    // память должна жить, пока открыт пакет
+    bool view(const void* data, std::size_t size, std::string& error);
+
+    int size() const { return (int)levels.size(); }
+    const Level& get(int i) const { return levels[i]; }
+
+    // Собирает пакет из текстовых описаний уровней. Текст - строки
+    // лабиринта ('X' - стена, 'o' и 'O' - точки, остальное проходимо),
+    // пустая строка и параметры "ключ=значения":
+    //   name=classic
+    //   pacman=x y
+    //   ghosts=x1 y1 x2 y2 x3 y3 x4 y4
+    //   homes=x1 y1 x2 y2 x3 y3 x4 y4
+    //   tunnel=y leftX rightX          (можно несколько)
+    //   fruit=minX minY maxX maxY      (по умолчанию весь лабиринт)
+    static bool fromAscii(const std::vector<std::string>& sources, std::vector<std::uint8_t>& out, std::string& error);
+
+    // Встроенный классический лабиринт: образ собран при компиляции, разбора при запуске нет
+    static const LevelPack& builtin();
+    // Его текстовое описание в формате fromAscii
+    static const char* classicAscii();
+};
@@ -0,0 +1,63 @@
+﻿// Сборка пакета уровней из текстовых описаний (формат - см. LevelPack::fromAscii).
+// Использование: PacManLevelPack out.pmlv [--classic] level1.txt [level2.txt ...]
+// --classic добавляет встроенный классический лабиринт на своё место в списке.
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "LevelPack.h"
+#include "Simulation.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " out.pmlv [--classic] level1.txt [level2.txt ...]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> sources;
+    for (int i = 2; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--classic")) {
+            sources.push_back(LevelPack::classicAscii());
+            continue;
+        }
+        std::ifstream in(argv[i]);
+        if (!in) {
+            std::cerr << "Error reading " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+        sources.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<std::uint8_t> bytes;
+    std::string error;
+    if (!LevelPack::fromAscii(sources, bytes, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    // проверяем собранный пакет тем же кодом, что и при загрузке
+    LevelPack pack;
+    if (!pack.assign(bytes, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ofstream out(argv[1], std::ios::binary);
+    out.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+    if (!out) {
+        std::cerr << "Error writing " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < pack.size(); ++i) {
+        const LevelHeader& level = pack.get(i).info();
+        Map map;
+        map.load(pack.get(i));
+        MazeGraph graph;
+        graph.build(map);
+        std::cout << i << ": " << level.name << " " << level.width << "x" << level.height
+            << ", food " << level.smallFood << "+" << level.bigFood << ", tunnels " << level.tunnelCount
+            << ", junctions " << graph.getJunctionCount() << ", corridors " << graph.getCorridorCount() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+﻿#include "MazeGraph.h"
+#include "Simulation.h"
+
+void MazeGraph::build(const Map& map)
+{
+    const int cells = (int)map.cellCount();
+    stride = map.getStride();
+    reachable.resize(cells);
+    junctionIndex.assign(cells, -1);
+    junctions.clear();
+
+    if (const LevelIndexes* precomputed = map.getPrecomputed()) {
+        // встроенный уровень: соседи, ходы, достижимые клетки и развилки посчитаны при компиляции
+        neighbours.assign(precomputed->neighbours, precomputed->neighbours + cells * 4);
+        exits.assign(precomputed->exits, precomputed->exits + cells);
+        reachable.assignWords(precomputed->reachable);
+        for (int w = 0; w < reachable.wordCount(); ++w)
+            for (std::uint64_t bits = precomputed->junctions[w]; bits; bits &= bits - 1) {
+                int cell = w * 64 + lowestBit64(bits);
+                junctionIndex[cell] = (int)junctions.size();
+                junctions.push_back(cell);
+            }
+    }
+    else {
+        neighbours.assign(cells * 4, -1);
+        exits.assign(cells, 0);
+
+        // Соседи и ходы считаются только для клеток лабиринта; рамка остаётся пустой
+        for (int y = 0; y < map.getH(); ++y)
+            for (int x = 0; x < map.getW(); ++x) {
+                int cell = map.cellId(y, x);
+                int* next = &neighbours[cell * 4];
+                next[0] = cell - stride;
+                next[1] = cell + stride;
+                next[2] = map.cellId(y, map.stepX(y, x, 2));
+                next[3] = map.cellId(y, map.stepX(y, x, 3));
+                std::uint8_t mask = 0;
+                bool beyondTunnel = map.isBeyondTunnel(y, x);
+                for (int d = 0; d < 4; ++d)
+                    if (map.getTile(next[d]).isPassable && (d >= 2 || !beyondTunnel))
+                        mask |= 1 << d;
+                exits[cell] = mask;
+            }
+
+        // Граф коридоров строится по клеткам, куда можно дойти от старта Пакмана:
+        // закрытые пустоты за стенами лабиринта в нём не нужны
+        const LevelPoint& start = map.getLevel().pacman;
+        queue.assign(1, map.cellId(start.y, start.x));
+        reachable.set(queue[0]);
+        for (std::size_t head = 0; head < queue.size(); ++head)
+            for (int d = 0; d < 4; ++d) {
+                int next = step(queue[head], d);
+                if (canMove(queue[head], d) && !reachable.test(next)) {
+                    reachable.set(next);
+                    queue.push_back(next);
+                }
+            }
+
+        // Развилки: больше двух ходов или тупик; в остальных проходимых клетках
+        // без разворота остаётся ровно один ход
+        for (int y = 0; y < map.getH(); ++y)
+            for (int x = 0; x < map.getW(); ++x) {
+                int cell = map.cellId(y, x);
+                if (!reachable.test(cell) || !exits[cell])
+                    continue;
+                int count = 0;
+                for (int d = 0; d < 4; ++d)
+                    count += (exits[cell] >> d) & 1;
+                if (count != 2) {
+                    junctionIndex[cell] = (int)junctions.size();
+                    junctions.push_back(cell);
+                }
+            }
+    }
+
+    // Переходы через туннель из достижимых клеток, по возрастанию номера
+    wraps.clear();
+    for (int w = 0; w < reachable.wordCount(); ++w)
+        for (std::uint64_t bits = reachable.data()[w]; bits; bits &= bits - 1) {
+            int cell = w * 64 + lowestBit64(bits);
+            for (int d = 2; d < 4; ++d)
+                if (canMove(cell, d) && step(cell, d) != (d == 2 ? cell - 1 : cell + 1)) {
+                    wraps.push_back(cell);
+                    wraps.push_back(step(cell, d));
+                }
+        }
+
+    // Коридоры: из каждой развилки по каждому ходу идём до следующей развилки;
+    // вынужденные ходы по пути записываются в таблицу follow
+    follow.assign(cells * 4, -1);
+    corridors.clear();
+    corridorStart.assign(junctions.size() + 1, 0);
+    for (int j = 0; j < (int)junctions.size(); ++j) {
+        corridorStart[j] = (int)corridors.size();
+        for (int d = 0; d < 4; ++d) {
+            if (!canMove(junctions[j], d))
+                continue;
+            int cell = step(junctions[j], d);
+            int direction = d;
+            int length = 1;
+            // длина не больше числа клеток: замкнутое кольцо без развилок не зациклит обход
+            while (junctionIndex[cell] < 0 && length <= cells) {
+                int next = forcedDirection(cell, direction);
+                if (next < 0)
+                    break;
+                follow[cell * 4 + direction] = (std::int8_t)next;
+                direction = next;
+                cell = step(cell, direction);
+                length++;
+            }
+            if (junctionIndex[cell] >= 0)
+                corridors.push_back({ junctions[j], cell, length, (std::uint8_t)d, (std::uint8_t)direction });
+        }
+    }
+    corridorStart[junctions.size()] = (int)corridors.size();
+}
+
+void MazeGraph::flood(Bitboard& region, Bitboard& scratch) const
+{
+    // в достижимой области соседние по сетке клетки - это соседи по правилам
+    // ходов: стены, рамка и клетки за входами в туннель в неё не входят.
+    // Поэтому хватает сдвигов, а переходы через туннель добавляются отдельно
+    region &= reachable;
+    for (;;) {
+        scratch = region;
+        scratch.orShifted(region, 1);
+        scratch.orShifted(region, stride);
+        for (std::size_t i = 0; i < wraps.size(); i += 2)
+            if (region.test(wraps[i]))
+                scratch.set(wraps[i + 1]);
+        scratch &= reachable;
+        if (scratch == region)
+            return;
+        region = scratch;
+    }
+}
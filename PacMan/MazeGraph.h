@@ -0,0 +1,86 @@
+﻿#pragma once
+// Граф лабиринта, выведенный из карты при загрузке уровня. Для каждой клетки
+// заранее известны соседи по четырём направлениям (с переходом через туннель)
+// и маска ходов, которые разрешены правилами: туннели и запрет ходить вверх
+// и вниз за входом в туннель учтены здесь один раз, а не в каждом шаге.
+//
+// Поверх таблицы соседей - сжатый граф: развилки (клетки, где без разворота
+// есть больше одного хода, и тупики) и коридоры между ними с длиной в шагах.
+// В клетке коридора ход без разворота всегда один, выбирать нечего: при
+// обходе рёбер графа он записывается в таблицу, и призрак в коридоре идёт по
+// ней, не считая ни цели, ни поля расстояний (corridorDirection).
+#include <cstdint>
+#include <vector>
+#include "Bitboard.h"
+
+class Map;
+
+class MazeGraph {
+public:
+    // Коридор от развилки from до развилки to; направления 0-3 как у InputManager
+    struct Corridor {
+        int from, to;               // номера клеток (Map::cellId)
+        int length;                 // число шагов
+        std::uint8_t firstDirection;    // ход из from
+        std::uint8_t lastDirection;     // последний ход, которым входят в to
+    };
+private:
+    int stride;
+    std::vector<int> neighbours;        // 4 на клетку: куда ведёт шаг, даже в стену
+    std::vector<std::uint8_t> exits;    // маска разрешённых ходов, бит d - направление d
+    std::vector<int> junctionIndex;     // номер развилки по клетке или -1
+    std::vector<int> junctions;         // клетки развилок
+    std::vector<int> corridorStart;     // коридоры развилки i: [corridorStart[i], corridorStart[i + 1])
+    std::vector<Corridor> corridors;
+    Bitboard reachable;                 // клетки, куда можно дойти от старта Пакмана
+    std::vector<int> wraps;             // пары клеток (откуда, куда) переходов через туннель
+    std::vector<int> queue;             // очередь обхода в build(), память переиспользуется
+    std::vector<std::int8_t> follow;    // 4 на клетку: ход по коридору после прихода направлением d или -1
+
+    // Единственный ход без разворота по маске ходов или -1
+    int forcedDirection(int cell, int lastDirection) const {
+        std::uint8_t mask = forwardMask(cell, lastDirection);
+        if (!mask || (mask & (mask - 1)))
+            return -1;
+        return mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : 3;
+    }
+public:
+    static int reverse(int direction) { return direction ^ 1; }     // 0<->1, 2<->3
+
+    MazeGraph() : stride(2) {}
+    // Перестраивает граф под карту; стены в карте во время игры не меняются
+    void build(const Map& map);
+
+    // Клетка после шага из cell в направлении direction (туннель учтён)
+    int step(int cell, int direction) const { return neighbours[cell * 4 + direction]; }
+    std::uint8_t exitMask(int cell) const { return exits[cell]; }
+    bool canMove(int cell, int direction) const { return (exits[cell] >> direction) & 1; }
+    // Разрешённые ходы без разворота; lastDirection < 0 - разворота нет
+    std::uint8_t forwardMask(int cell, int lastDirection) const {
+        return lastDirection >= 0 && lastDirection < 4 ? exits[cell] & ~(1 << reverse(lastDirection)) : exits[cell];
+    }
+    // Ход в клетке коридора, куда пришли направлением lastDirection, или -1,
+    // если нужно выбирать (развилка, приход не вдоль коридора). Там, где
+    // таблица даёт -1, разрешённый ход без разворота тоже может быть один -
+    // выбор по полю расстояний тогда найдёт его же
+    int corridorDirection(int cell, int lastDirection) const {
+        return lastDirection >= 0 && lastDirection < 4 ? follow[cell * 4 + lastDirection] : -1;
+    }
+    const Bitboard& getReachable() const { return reachable; }
+    // Расширяет region до всех клеток, достижимых из неё по правилам ходов:
+    // сдвиги по словам на 1 и на stride бит плюс переходы через туннели.
+    // scratch - рабочая карта того же размера, может быть пустой
+    void flood(Bitboard& region, Bitboard& scratch) const;
+
+    int cellX(int cell) const { return cell % stride - 1; }
+    int cellY(int cell) const { return cell / stride - 1; }
+
+    bool isJunction(int cell) const { return junctionIndex[cell] >= 0; }
+    int getJunctionCount() const { return (int)junctions.size(); }
+    int getJunction(int i) const { return junctions[i]; }
+    int getCorridorCount() const { return (int)corridors.size(); }
+    const Corridor& getCorridor(int i) const { return corridors[i]; }
+    // Коридоры, выходящие из развилки с номером junction
+    const Corridor* corridorsBegin(int junction) const { return corridors.data() + corridorStart[junction]; }
+    const Corridor* corridorsEnd(int junction) const { return corridors.data() + corridorStart[junction + 1]; }
+};
@@ -0,0 +1,112 @@
+﻿#pragma once
+// Планировщик показа кадров: задаёт темп главного цикла, чтобы окно не
+// занимало ядро целиком. Три режима:
+//   VSYNC    - темп задаёт display() с вертикальной синхронизацией;
+//   FIXED    - сон до начала следующего кадра с целевой частотой;
+//   ADAPTIVE - то же, но сон короче на измеренный "пересып" системного
+//              таймера, а остаток кадра добирается yield: частота ровная,
+//              а процессор почти весь кадр спит.
+// Пропущенный кадр (ничего видимого не изменилось) в режиме VSYNC не
+// блокируется в display(), поэтому его длительность планировщик выжидает сам.
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+enum PacingMode {
+    PACING_VSYNC,
+    PACING_FIXED,
+    PACING_ADAPTIVE,
+    PACING_MODE_COUNT
+};
+
+class PresentScheduler {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    PacingMode mode;
+    int targetFps;
+    Clock::duration frameInterval;
+    Clock::time_point deadline;         // когда начинается следующий кадр
+    double oversleepMicros;             // скользящее среднее опоздания пробуждения
+    long long presented, skipped, idleWaits;
+
+    void sleepUntil(Clock::time_point until) {
+        if (until <= Clock::now())
+            return;
+        std::this_thread::sleep_until(until);
+        double late = std::chrono::duration<double, std::micro>(Clock::now() - until).count();
+        oversleepMicros += ((late > 0 ? late : 0) - oversleepMicros) * 0.125;
+    }
+public:
+    explicit PresentScheduler(PacingMode mode = PACING_ADAPTIVE, int targetFps = 60)
+        : mode(mode), targetFps(60), frameInterval(), oversleepMicros(0), presented(0), skipped(0), idleWaits(0) {
+        setTargetFps(targetFps);
+    }
+
+    static const char* modeName(PacingMode mode) {
+        static const char* names[PACING_MODE_COUNT] = { "vsync", "fixed", "adaptive" };
+        return mode >= 0 && mode < PACING_MODE_COUNT ? names[mode] : "?";
+    }
+    // Режим по имени из modeName(); false, если имя неизвестно
+    static bool parseMode(const char* name, PacingMode& mode) {
+        for (int m = 0; m < PACING_MODE_COUNT; ++m)
+            if (std::strcmp(name, modeName((PacingMode)m)) == 0) {
+                mode = (PacingMode)m;
+                return true;
+            }
+        return false;
+    }
+
+    PacingMode getMode() const { return mode; }
+    int getTargetFps() const { return targetFps; }
+    long long getPresented() const { return presented; }
+    long long getSkipped() const { return skipped; }
+    long long getIdleWaits() const { return idleWaits; }
+    void setMode(PacingMode newMode) {
+        mode = newMode;
+        resync();
+    }
+    void setTargetFps(int fps) {
+        targetFps = fps > 0 ? fps : 60;
+        frameInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+        resync();
+    }
+    // Вертикальную синхронизацию окна включает вызывающий, если это нужно
+    bool usesVerticalSync() const { return mode == PACING_VSYNC; }
+
+    // Начать отсчёт кадров заново: после блокирующего ожидания событий или
+    // смены режима догонять пропущенные кадры не нужно
+    void resync() { deadline = Clock::now() + frameInterval; }
+
+    // Отмечает, что цикл заснул в ожидании событий (игра окончена или на паузе)
+    void noteIdleWait() {
+        idleWaits++;
+        resync();
+    }
+
+    // Завершение кадра: presentedFrame - был ли вызван display(). Выжидает
+    // остаток кадра согласно режиму
+    void endFrame(bool presentedFrame) {
+        if (presentedFrame)
+            presented++;
+        else
+            skipped++;
+        if (mode == PACING_VSYNC && presentedFrame) {
+            // display() уже дождался обратного хода луча
+            resync();
+            return;
+        }
+        if (mode == PACING_ADAPTIVE) {
+            Clock::time_point wake = deadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(oversleepMicros));
+            sleepUntil(wake);
+            while (Clock::now() < deadline)
+                std::this_thread::yield();
+        }
+        else
+            sleepUntil(deadline);
+        deadline += frameInterval;
+        // отстали больше чем на кадр (долгий кадр, отладчик): не навёрстываем пачкой
+        if (deadline < Clock::now())
+            resync();
+    }
+};
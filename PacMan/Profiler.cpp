@@ -0,0 +1,183 @@
+﻿#include "Profiler.h"
+
+#ifdef PACMAN_PROFILE
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const int BUCKETS = 1024;           // 16 точных + 60 порядков по 16 делений
+const int RING_SIZE = 1 << 15;      // последних замеров на поток
+
+int bucketOf(std::uint64_t ns) {
+    if (ns < 16)
+        return (int)ns;
+    int msb = 63;
+    while (!(ns >> msb))
+        msb--;
+    return (msb - 3) * 16 + (int)((ns >> (msb - 4)) & 15);
+}
+
+std::uint64_t bucketValue(int bucket) {
+    if (bucket < 16)
+        return (std::uint64_t)bucket;
+    int msb = bucket / 16 + 3;
+    return (std::uint64_t)(16 + bucket % 16) << (msb - 4);
+}
+
+struct TraceEvent {
+    std::uint64_t start, duration;
+    int phase;
+};
+
+// Данные одного потока: пишет только владелец, остальные только читают
+struct ThreadData {
+    int tid;
+    std::atomic<std::uint32_t> histogram[Profiler::MAX_PHASES][BUCKETS];
+    std::atomic<std::uint64_t> maxNs[Profiler::MAX_PHASES];
+    TraceEvent ring[RING_SIZE];
+    std::atomic<std::uint64_t> written;
+
+    ThreadData(int tid) : tid(tid), written(0) {
+        for (int p = 0; p < Profiler::MAX_PHASES; ++p) {
+            for (int b = 0; b < BUCKETS; ++b)
+                histogram[p][b].store(0, std::memory_order_relaxed);
+            maxNs[p].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+std::mutex registryMutex;
+const char* phaseNames[Profiler::MAX_PHASES];
+std::atomic<int> phaseCount(0);
+std::vector<std::unique_ptr<ThreadData>> threads;   // живут до конца процесса
+const std::uint64_t epoch = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+
+ThreadData& currentThread() {
+    thread_local ThreadData* data = nullptr;
+    if (!data) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threads.push_back(std::unique_ptr<ThreadData>(new ThreadData((int)threads.size() + 1)));
+        data = threads.back().get();
+    }
+    return *data;
+}
+
+}
+
+int Profiler::registerPhase(const char* name)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    int count = phaseCount.load();
+    for (int i = 0; i < count; ++i)
+        if (!std::strcmp(phaseNames[i], name))
+            return i;
+    if (count == MAX_PHASES)
+        return MAX_PHASES - 1;  // переполнение: складываем в последнюю фазу
+    phaseNames[count] = name;
+    phaseCount.store(count + 1);
+    return count;
+}
+
+int Profiler::getPhaseCount()
+{
+    return phaseCount.load();
+}
+
+std::uint64_t Profiler::now()
+{
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - epoch;
+}
+
+void Profiler::record(int phase, std::uint64_t start, std::uint64_t end)
+{
+    ThreadData& data = currentThread();
+    std::uint64_t duration = end - start;
+    std::atomic<std::uint32_t>& bucket = data.histogram[phase][bucketOf(duration)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (duration > data.maxNs[phase].load(std::memory_order_relaxed))
+        data.maxNs[phase].store(duration, std::memory_order_relaxed);
+
+    std::uint64_t index = data.written.load(std::memory_order_relaxed);
+    TraceEvent& event = data.ring[index & (RING_SIZE - 1)];
+    event.start = start;
+    event.duration = duration;
+    event.phase = phase;
+    data.written.store(index + 1, std::memory_order_release);
+}
+
+Profiler::PhaseStats Profiler::getStats(int phase)
+{
+    static std::uint64_t merged[BUCKETS];
+    std::lock_guard<std::mutex> lock(registryMutex);
+    PhaseStats stats = { phaseNames[phase], 0, 0, 0, 0 };
+    std::uint64_t maxNs = 0;
+    std::memset(merged, 0, sizeof(merged));
+    for (const auto& data : threads) {
+        for (int b = 0; b < BUCKETS; ++b)
+            merged[b] += data->histogram[phase][b].load(std::memory_order_relaxed);
+        std::uint64_t m = data->maxNs[phase].load(std::memory_order_relaxed);
+        if (m > maxNs)
+            maxNs = m;
+    }
+    for (int b = 0; b < BUCKETS; ++b)
+        stats.count += merged[b];
+    if (!stats.count)
+        return stats;
+
+    std::uint64_t p50Rank = (stats.count + 1) / 2, p99Rank = stats.count - stats.count / 100, seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        if (!merged[b])
+            continue;
+        if (seen < p50Rank && seen + merged[b] >= p50Rank)
+            stats.p50Us = bucketValue(b) / 1000.0;
+        if (seen < p99Rank && seen + merged[b] >= p99Rank)
+            stats.p99Us = bucketValue(b) / 1000.0;
+        seen += merged[b];
+    }
+    stats.maxUs = maxNs / 1000.0;
+    return stats;
+}
+
+void Profiler::resetStats()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& data : threads)
+        for (int p = 0; p < MAX_PHASES; ++p) {
+            for (int b = 0; b < BUCKETS; ++b)
+                data->histogram[p][b].store(0, std::memory_order_relaxed);
+            data->maxNs[p].store(0, std::memory_order_relaxed);
+        }
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& data : threads) {
+        std::uint64_t written = data->written.load(std::memory_order_acquire);
+        std::uint64_t begin = written > (std::uint64_t)RING_SIZE ? written - RING_SIZE : 0;
+        for (std::uint64_t i = begin; i < written; ++i) {
+            const TraceEvent& event = data->ring[i & (RING_SIZE - 1)];
+            out << (first ? "" : ",\n") << "{\"name\":\"" << phaseNames[event.phase]
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << data->tid
+                << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return (bool)out;
+}
+
+#endif
@@ -0,0 +1,53 @@
+﻿#pragma once
+// Профилировщик фаз кадра. PROFILE_SCOPE("имя") замеряет время до конца
+// блока; замеры пишутся в кольцевой буфер своего потока и в гистограмму
+// задержек фазы (логарифмические корзины с 16 делениями, как в HDR
+// Histogram, погрешность не больше 1/16). Без PACMAN_PROFILE макрос пустой,
+// а Profiler.cpp не содержит кода.
+#include <cstdint>
+#include <string>
+
+class Profiler {
+public:
+    static constexpr int MAX_PHASES = 32;
+
+    struct PhaseStats {
+        const char* name;
+        std::uint64_t count;
+        double p50Us, p99Us, maxUs;
+    };
+
+    // Номер фазы по имени; одинаковые имена дают один номер
+    static int registerPhase(const char* name);
+    static int getPhaseCount();
+    // Монотонное время в наносекундах
+    static std::uint64_t now();
+    static void record(int phase, std::uint64_t start, std::uint64_t end);
+
+    // Сводка по всем потокам. Читает счётчики без блокировок: значения
+    // могут отставать на несколько замеров, но не рвутся.
+    static PhaseStats getStats(int phase);
+    static void resetStats();
+    // Последние замеры всех потоков в формате Chrome trace_event
+    // (chrome://tracing, Perfetto). Лучше вызывать, пока рабочие потоки стоят.
+    static bool writeChromeTrace(const std::string& path);
+
+    class ScopedTimer {
+    private:
+        int phase;
+        std::uint64_t start;
+    public:
+        ScopedTimer(int phase) : phase(phase), start(Profiler::now()) {}
+        ~ScopedTimer() { Profiler::record(phase, start, Profiler::now()); }
+    };
+};
+
+#ifdef PACMAN_PROFILE
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_CONCAT(profilePhase_, __LINE__) = Profiler::registerPhase(name); \
+    Profiler::ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(PROFILE_CONCAT(profilePhase_, __LINE__))
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
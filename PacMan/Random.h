@@ -0,0 +1,30 @@
+﻿#pragma once
+// Генератор случайных чисел одной партии (xorshift64*). В отличие от rand()
+// у каждой партии своё состояние, поэтому партии можно гонять в разных
+// потоках, и одно и то же зерно всегда даёт одну и ту же игру.
+#include <cstdint>
+
+class Random {
+private:
+    std::uint64_t state;
+public:
+    explicit Random(std::uint64_t seed = 1) { setSeed(seed); }
+    void setSeed(std::uint64_t seed) {
+        // splitmix64: близкие зёрна дают несвязанные последовательности, ноль недопустим
+        std::uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        state = (z ^ (z >> 31)) | 1;
+    }
+    std::uint64_t getState() const { return state; }
+    // Продолжить ровно с сохранённого состояния (getState), без перемешивания
+    void setState(std::uint64_t value) { state = value ? value : 1; }
+    std::uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+    // Равномерно в [0, n) для небольших n
+    int nextInt(int n) { return (int)((next() >> 32) % (std::uint64_t)n); }
+};
@@ -0,0 +1,251 @@
+﻿#include "Replay.h"
+#include "Simulation.h"
+#include "Snapshot.h"
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char MAGIC[4] = { 'P', 'M', 'R', 'P' };
+// 2 - у призраков свои генераторы и одновременное обновление, старые записи не совпадут
+// 3 - фрукт выбирается из индекса пустых клеток
+// 4 - в контрольную сумму входят клетки оставшихся точек
+// 5 - пустая клетка для фрукта выбирается по рангу в битовой карте
+// 6 - пустая клетка для фрукта выбирается с отказами из клеток области фруктов
+// 7 - встреча с призраком у входа в туннель учитывает клетку на другом его конце
+// 8 - в заголовке отпечаток уровня и где этот уровень искать
+const std::uint8_t VERSION = 8;
+
+void putVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((std::uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((std::uint8_t)value);
+}
+
+bool getVarint(const std::uint8_t*& p, const std::uint8_t* end, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end)
+            return false;
+        std::uint8_t byte = *p++;
+        value |= (std::uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+}
+
+Replay::Replay()
+    : level(0), levelIndex(0), seed(1), startX(0), startY(0), checksumInterval(1),
+    steps(0), lastEventStep(0), currentCode(0), maxSteps(0), full(false)
+{
+}
+
+Replay::Replay(const Level& recordedLevel, const std::string& source, int index, std::uint64_t seed, int startX, int startY,
+    int checksumInterval)
+    : level(levelFingerprint(recordedLevel)), levelSource(source), levelIndex(index), seed(seed), startX(startX), startY(startY),
+    checksumInterval(checksumInterval > 0 ? checksumInterval : 1), steps(0), lastEventStep(0), currentCode(0), maxSteps(0), full(false)
+{
+}
+
+void Replay::setLimit(long long limitSteps, std::size_t eventBytes)
+{
+    maxSteps = limitSteps > 0 ? limitSteps : 0;
+    if (!maxSteps)
+        return;
+    events.reserve(eventBytes);
+    checksums.reserve((std::size_t)(maxSteps / checksumInterval) + 1);
+}
+
+bool Replay::hasRoom() const
+{
+    // varint события не длиннее 10 байт; за такт бывает смена направления, за ней сброс
+    const std::size_t EVENT_BYTES = 2 * 10;
+    return !maxSteps || (steps < maxSteps && events.size() + EVENT_BYTES <= events.capacity()
+        && checksums.size() < checksums.capacity());
+}
+
+void Replay::addEvent(int code)
+{
+    putVarint(events, ((std::uint64_t)(steps - lastEventStep) << 3) | (std::uint64_t)code);
+    lastEventStep = steps;
+}
+
+void Replay::recordStep(int direction, const Simulation& simulation)
+{
+    if (full || !hasRoom()) {
+        full = true;
+        return;
+    }
+    int code = direction + 1;
+    if (code != currentCode) {
+        addEvent(code);
+        currentCode = code;
+    }
+    steps++;
+    if (steps % checksumInterval == 0)
+        checksums.push_back((std::uint32_t)simulation.checksum());
+}
+
+void Replay::recordReset()
+{
+    // место под сброс оставлено проверкой hasRoom() в recordStep
+    if (full)
+        return;
+    addEvent(RESET_CODE);
+}
+
+void Replay::write(std::vector<std::uint8_t>& out) const
+{
+    out.assign(MAGIC, MAGIC + 4);
+    out.push_back(VERSION);
+    putVarint(out, seed);
+    putVarint(out, level);
+    putVarint(out, (std::uint64_t)levelIndex);
+    putVarint(out, levelSource.size());
+    out.insert(out.end(), levelSource.begin(), levelSource.end());
+    putVarint(out, (std::uint64_t)startX);
+    putVarint(out, (std::uint64_t)startY);
+    putVarint(out, (std::uint64_t)checksumInterval);
+    putVarint(out, (std::uint64_t)steps);
+    putVarint(out, events.size());
+    out.insert(out.end(), events.begin(), events.end());
+    putVarint(out, checksums.size());
+    for (std::uint32_t sum : checksums)
+        for (int i = 0; i < 4; ++i)
+            out.push_back((std::uint8_t)(sum >> (i * 8)));
+}
+
+bool Replay::save(const std::string& path) const
+{
+    std::vector<std::uint8_t> out;
+    write(out);
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)out.data(), (std::streamsize)out.size());
+    return (bool)file;
+}
+
+bool Replay::read(const std::uint8_t* data, std::size_t size)
+{
+    const std::uint8_t* p = data;
+    const std::uint8_t* end = p + size;
+    if (size < 5 || std::memcmp(p, MAGIC, 4) || p[4] != VERSION)
+        return false;
+    p += 5;
+
+    // зерно, отпечаток уровня, номер уровня, длина источника
+    std::uint64_t identity[4];
+    for (std::uint64_t& value : identity)
+        if (!getVarint(p, end, value))
+            return false;
+    if (identity[2] > (std::uint64_t)INT_MAX || identity[3] > MAX_SOURCE || identity[3] > (std::uint64_t)(end - p))
+        return false;
+    const std::uint8_t* source = p;
+    p += identity[3];
+
+    // startX, startY, интервал сумм, число тактов, длина журнала
+    std::uint64_t values[5];
+    for (std::uint64_t& value : values)
+        if (!getVarint(p, end, value))
+            return false;
+    // старт сверяет с уровнем verify(), здесь - только что он помещается в int
+    if (values[0] > (std::uint64_t)INT_MAX || values[1] > (std::uint64_t)INT_MAX)
+        return false;
+    if (!values[2] || values[2] > (std::uint64_t)INT_MAX || values[3] > (std::uint64_t)LLONG_MAX)
+        return false;
+    if (values[4] > (std::uint64_t)(end - p))
+        return false;
+
+    // журнал: каждое событие читается, код из допустимых, такты не дальше записанных
+    const std::uint8_t* log = p;
+    const std::uint8_t* logEnd = p + values[4];
+    std::uint64_t eventStep = 0;
+    while (log != logEnd) {
+        std::uint64_t event;
+        if (!getVarint(log, logEnd, event) || (event & 7) > RESET_CODE || (event >> 3) > values[3] - eventStep)
+            return false;
+        eventStep += event >> 3;
+    }
+    p = logEnd;
+    std::uint64_t count;
+    if (!getVarint(p, end, count) || count != values[3] / values[2] || count > (std::uint64_t)(end - p) / 4
+        || (std::uint64_t)(end - p) != count * 4)
+        return false;
+
+    seed = identity[0];
+    level = identity[1];
+    levelIndex = (int)identity[2];
+    levelSource.assign((const char*)source, (std::size_t)identity[3]);
+    startX = (int)values[0];
+    startY = (int)values[1];
+    checksumInterval = (int)values[2];
+    steps = (long long)values[3];
+    events.assign(logEnd - values[4], logEnd);
+    checksums.resize(count);
+    for (std::uint32_t& sum : checksums) {
+        sum = (std::uint32_t)p[0] | (std::uint32_t)p[1] << 8 | (std::uint32_t)p[2] << 16 | (std::uint32_t)p[3] << 24;
+        p += 4;
+    }
+    // если запись продолжат, первым пойдёт явное событие направления
+    lastEventStep = steps;
+    currentCode = -1;
+    maxSteps = 0;
+    full = false;
+    return true;
+}
+
+bool Replay::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::vector<std::uint8_t> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return read(in.data(), in.size());
+}
+
+long long Replay::verify(const Level& playLevel) const
+{
+    const LevelHeader& info = playLevel.info();
+    if (levelFingerprint(playLevel) != level || startX < 0 || startX >= info.width || startY < 0 || startY >= info.height
+        || !playLevel.tiles()[(startY + 1) * (info.width + 2) + startX + 1].passable)
+        return WRONG_LEVEL;
+    Simulation simulation(playLevel, startX, startY, seed);
+    const std::uint8_t* p = events.data();
+    const std::uint8_t* end = p + events.size();
+    std::size_t nextChecksum = 0;
+    long long step = 0;
+    int direction = -1;
+
+    auto runUntil = [&](long long until) {
+        for (; step < until; ++step) {
+            simulation.step(direction);
+            if ((step + 1) % checksumInterval == 0) {
+                if (nextChecksum >= checksums.size() || checksums[nextChecksum++] != (std::uint32_t)simulation.checksum())
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    while (p != end) {
+        std::uint64_t event;
+        if (!getVarint(p, end, event))
+            return step;
+        if (!runUntil(step + (long long)(event >> 3)))
+            return step;
+        int code = (int)(event & 7);
+        if (code == RESET_CODE)
+            simulation.reset();
+        else
+            direction = code - 1;
+    }
+    if (!runUntil(steps))
+        return step;
+    return -1;
+}
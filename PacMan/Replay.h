@@ -0,0 +1,99 @@
+﻿#pragma once
+// Запись партии для воспроизведения: уровень, зерно, стартовая клетка и журнал ввода.
+// Ввод меняется редко, поэтому хранятся только смены направления: каждое
+// событие - одно varint-число (тактов с прошлого события << 3) | код, где
+// код - направление + 1 (0..4) или RESET_CODE. Обычно это 1-2 байта на
+// нажатие. После каждого checksumInterval-го такта (по умолчанию после
+// каждого) запоминаются младшие 32 бита Simulation::checksum(), по ним
+// verify() находит расхождение с точностью до checksumInterval тактов. Реже
+// суммы пишутся только по запросу: например, TICKS_PER_SECOND - раз в
+// секунду игры, запись в несколько раз короче, но такт расхождения известен
+// лишь с точностью до секунды.
+//
+// Уровень записи опознаётся по levelFingerprint(): verify() проигрывает
+// запись только на уровне с тем же отпечатком. Где этот уровень взять,
+// подсказывает источник - путь к пакету уровней, как он был задан при записи,
+// и номер уровня в нём; пустой источник - встроенный лабиринт.
+//
+// setLimit() делает запись ограниченной: буферы резервируются заранее, а когда
+// следующий такт не влез бы в них, запись останавливается целиком (дальнейшие
+// такты и сбросы не пишутся). Так запись всей сессии в игре не выделяет память
+// по ходу и не растёт без конца.
+//
+// Формат файла: "PMRP", версия (1 байт), затем varint: зерно, отпечаток
+// уровня, номер уровня, длина источника и сам источник (байты пути), startX,
+// startY, checksumInterval, число тактов, длина журнала в байтах, сам
+// журнал, число контрольных сумм и суммы по 4 байта (little-endian).
+// read() проверяет все поля до использования: номер уровня, старт и
+// интервал от 0 (интервал - от 1) до INT_MAX, источник не длиннее
+// MAX_SOURCE, журнал разбирается целиком и не длиннее записанных тактов,
+// сумм ровно тактов / интервал, после них в файле ничего нет. Старт внутри
+// лабиринта и проходим - это verify() проверяет по уровню до запуска мира.
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Level;
+class Simulation;
+
+class Replay {
+private:
+    static constexpr int RESET_CODE = 5;
+
+    std::uint64_t level;        // levelFingerprint() уровня записи
+    std::string levelSource;    // путь к пакету уровней или "" - встроенный лабиринт
+    int levelIndex;
+    std::uint64_t seed;
+    int startX, startY;
+    int checksumInterval;
+    std::vector<std::uint8_t> events;
+    std::vector<std::uint32_t> checksums;
+    long long steps;            // записано тактов (вызовов step)
+    long long lastEventStep;
+    int currentCode;
+    long long maxSteps;         // 0 - без ограничения
+    bool full;                  // предел достигнут, запись остановлена
+
+    void addEvent(int code);
+    // Влезут ли в ограниченную запись ещё один такт и два события
+    bool hasRoom() const;
+public:
+    static constexpr int DEFAULT_CHECKSUM_INTERVAL = 1;
+
+    static constexpr std::size_t MAX_SOURCE = 4096;
+    // verify(): уровень не тот, на котором сделана запись, или старт не на проходимой клетке
+    static constexpr long long WRONG_LEVEL = -2;
+
+    // Пустая запись; для read() и load()
+    Replay();
+    // Запись партий на уровне level; source и index - где его найти при проигрывании
+    Replay(const Level& level, const std::string& source, int index, std::uint64_t seed, int startX, int startY,
+        int checksumInterval = DEFAULT_CHECKSUM_INTERVAL);
+
+    // Ограничивает запись steps тактами и eventBytes байтами журнала ввода и
+    // сразу резервирует под них память
+    void setLimit(long long steps, std::size_t eventBytes);
+    bool isFull() const { return full; }
+
+    // Запись: вызывать после каждого Simulation::step и при каждом reset()
+    void recordStep(int direction, const Simulation& simulation);
+    void recordReset();
+
+    std::uint64_t getSeed() const { return seed; }
+    const std::string& getLevelSource() const { return levelSource; }
+    int getLevelIndex() const { return levelIndex; }
+    long long getSteps() const { return steps; }
+    std::size_t getEventBytes() const { return events.size(); }
+
+    void write(std::vector<std::uint8_t>& out) const;
+    // false, если данные не запись этой версии или не проходят проверку;
+    // тогда сама запись не меняется
+    bool read(const std::uint8_t* data, std::size_t size);
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // Проигрывает запись на новом мире уровня level с максимальной скоростью.
+    // Возвращает -1, если все контрольные суммы совпали, WRONG_LEVEL, если
+    // запись сделана не на этом уровне, иначе номер первого такта с расхождением.
+    long long verify(const Level& level) const;
+};
@@ -0,0 +1,757 @@
+﻿#include "Simulation.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "GhostPolicies.h"
+#include <algorithm>
+#include <climits>
+
+void Map::load(const Level& source) {
+    level = &source.info();
+    precomputed = source.precomputed();
+    H = level->height;
+    W = level->width;
+    stride = W + 2;
+    const Tile* tiles = reinterpret_cast<const Tile*>(source.tiles());
+    Mase.assign(tiles, tiles + source.tileCount());
+    if (indexedLevel != level) {
+        indexes.freeCells.resize((int)Mase.size());
+        indexes.freeCount = 0;
+        indexes.pellets.reset((int)Mase.size());
+        indexes.walls.resize((int)Mase.size());
+        indexes.smallPellets.resize((int)Mase.size());
+        indexes.powerPellets.resize((int)Mase.size());
+        fruitCells.clear();
+        if (precomputed) {
+            // слои готовы; множество точек и список клеток фруктов - по возрастанию номера, как при обходе
+            indexes.walls.assignWords(precomputed->walls);
+            indexes.smallPellets.assignWords(precomputed->smallPellets);
+            indexes.powerPellets.assignWords(precomputed->powerPellets);
+            indexes.freeCells.assignWords(precomputed->freeCells);
+            indexes.freeCount = indexes.freeCells.count();
+            for (int w = 0; w < indexes.walls.wordCount(); ++w) {
+                for (std::uint64_t bits = precomputed->smallPellets[w] | precomputed->powerPellets[w]; bits; bits &= bits - 1)
+                    indexes.pellets.insert(w * 64 + lowestBit64(bits));
+                for (std::uint64_t bits = precomputed->fruitCells[w]; bits; bits &= bits - 1)
+                    fruitCells.push_back(w * 64 + lowestBit64(bits));
+            }
+        }
+        else {
+            for (std::size_t cell = 0; cell < Mase.size(); ++cell)
+                indexes.walls.assign((int)cell, !Mase[cell].isPassable);
+            for (int y = 0; y < H; ++y)
+                for (int x = 0; x < W; ++x) {
+                    const Tile& tile = Mase[cellId(y, x)];
+                    index(y, x, tile.type);
+                    if (isFruitArea(y, x) && (tile.isPassable || tile.type == ' '))
+                        fruitCells.push_back(cellId(y, x));
+                }
+        }
+        loadedIndexes = indexes;
+        indexedLevel = level;
+    }
+    else
+        indexes = loadedIndexes;
+}
+
+void Fruit::createFruit(Map& map, int foodLeft, int foodTotal, Random& random) {
+    if ((foodLeft == foodTotal - FRUIT_AFTER_EATEN[0] || foodLeft == foodTotal - FRUIT_AFTER_EATEN[1]) && !isActive)
+    {
+        // случайная пустая клетка из индекса карты, без перебора занятых;
+        // если свободных клеток нет, фрукт не появляется
+        int cell = map.sampleFreeCell(random);
+        if (cell >= 0) {
+            x = map.cellX(cell);
+            y = map.cellY(cell);
+            isActive = true;
+        }
+    }
+    if (isActive)
+    {
+        map.setTile(y, x, 'F');
+    }
+}
+
+void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, GhostStore& ghosts, const MazeGraph& graph, int direction)
+{
+    // Допустимые ходы и клетка после шага (с туннелем) берутся из графа лабиринта
+    if (direction >= 0 && direction < 4 && graph.canMove(map.cellId(nextY, nextX), direction)) {
+        nextDirection = direction;
+        nextX = x;
+        nextY = y;
+    }
+
+    speed = speedPerTick(PACMAN_SPEED);
+    score += speed;
+    if (score >= MOVE_STEP)
+    {
+        prevX = x;
+        prevY = y;
+        int cell = map.cellId(nextY, nextX);
+        if (graph.canMove(cell, nextDirection)) {
+            int next = graph.step(cell, nextDirection);
+            nextX = graph.cellX(next);
+            nextY = graph.cellY(next);
+        }
+        score -= MOVE_STEP;
+    }
+
+    const Tile& target = map.Mase[map.cellId(nextY, nextX)];
+    if (target.isPassable && nextY != 0 && nextX != 0)
+    {
+        if (target.type == smallFood.getType())
+        {
+            addPoints(smallFood.point);
+            smallFood.decreaseCount();
+        }
+        if (target.type == bigFood.getType())
+        {
+            addPoints(bigFood.point);
+            bigFood.decreaseCount();
+            setGhostsFrightened(ghosts, (int)(FRIGHTENED_SECONDS * TICKS_PER_SECOND));
+        }
+        if (fruit.isActive && nextX == fruit.x && nextY == fruit.y)
+        {
+            addPoints(fruit.points);
+            fruit.isActive = false;;
+        }
+        map.setTile(y, x, ' ');
+        map.setTile(nextY, nextX, 'P');
+        x = nextX;
+        y = nextY;
+    }
+}
+
+int Pacman::WonOrLost(const Food& smallFood, const Food& bigFood)
+{
+    int f = 0;
+    if (smallFood.count + bigFood.count == 0)
+        f = 1;
+    else if (!getLives())
+        f = 2;
+    return f;
+}
+
+void Pacman::setGhostsFrightened(GhostStore& ghosts, int duration) {
+    for (int i = 0; i < ghosts.size(); ++i)
+    {
+        ghosts.state[i] = Ghost::FRIGHTENED;
+        ghosts.frightenedTimer[i] = duration;
+    }
+}
+
+namespace {
+
+// Смещение клетки на шаг в направлении 0-3 (вверх, вниз, влево, вправо)
+const int DIRECTION_DX[4] = { 0, 0, -1, 1 };
+const int DIRECTION_DY[4] = { -1, 1, 0, 0 };
+
+// С какого числа призраков обновление делится между потоками пула
+const int PARALLEL_GHOSTS = 256;
+const int PARALLEL_GRAIN = 64;
+
+// Направление к цели по полю расстояний: из разрешённых ходов без разворота
+// ближайший к цели, при равенстве - первый в порядке вправо, вверх, влево, вниз.
+// В коридоре ход один, поле не нужно, и сюда призрак не попадает (moveGhostAs).
+int chaseDirection(const MazeGraph& graph, const DistanceField& field, int cell, int direction, int lastDirection)
+{
+    static const int ORDER[4] = { 3, 0, 2, 1 };
+    std::uint8_t allowed = graph.forwardMask(cell, lastDirection);
+    int minDistance = INT_MAX;
+    for (int d : ORDER)
+        if ((allowed >> d) & 1) {
+            int distance = field.at(graph.step(cell, d));
+            if (distance <= minDistance) {
+                minDistance = distance;
+                direction = d;
+            }
+        }
+    return direction;
+}
+
+// Случайное разрешённое направление без разворота; разворот разрешён
+// только в тупике, где иначе идти некуда
+int randomDirection(const MazeGraph& graph, Random& random, int cell, int direction, int lastDirection)
+{
+    std::uint8_t allowed = graph.forwardMask(cell, lastDirection);
+    if (!allowed)
+        allowed = graph.exitMask(cell);
+    if (!allowed)
+        return direction;   // замурован со всех сторон
+    int newDirection;
+    do {
+        newDirection = random.nextInt(4);
+    } while (!(allowed & (1 << newDirection)));
+    return newDirection;
+}
+
+}
+
+template <class Behaviour>
+void Simulation::moveGhostAs(int i, bool endgame)
+{
+    const int cell = map.cellId(ghosts.y[i], ghosts.x[i]);
+    int direction = ghosts.direction[i];
+    int speed;
+    bool chasing = true;
+    if (ghosts.state[i] != Ghost::FRIGHTENED || Behaviour::ignoresFright(endgame))
+        speed = Behaviour::chaseSpeed(endgame);
+    else {
+        //случайное движение
+        chasing = false;
+        if (--ghosts.frightenedTimer[i] <= 0) {
+            ghosts.state[i] = Ghost::NORMAL;
+            frightEnded[i] = 1;     // все призраки вернутся на места после шагов этого такта
+        }
+        speed = speedPerTick(GHOST_FRIGHTENED_SPEED);
+    }
+
+    if (chasing) {
+        // в коридоре идём по ребру графа; цель и поле считаются только для выбора
+        int corridor = graph.corridorDirection(cell, ghosts.lastDirection[i]);
+        direction = corridor >= 0 ? corridor
+                                  : chaseDirection(graph, distances.find(targetCells[i]), cell, direction, ghosts.lastDirection[i]);
+    }
+
+    int score = ghosts.score[i] + speed;
+    if (score >= MOVE_STEP)
+    {
+        if (!chasing)
+            direction = randomDirection(graph, ghosts.random[i], cell, direction, ghosts.lastDirection[i]);
+        // Двигаемся в выбранном направлении
+        ghosts.prevX[i] = ghosts.x[i];
+        ghosts.prevY[i] = ghosts.y[i];
+        if (direction >= 0 && direction < 4) {
+            int next = graph.step(cell, direction);
+            ghosts.x[i] = graph.cellX(next);
+            ghosts.y[i] = graph.cellY(next);
+        }
+        score -= MOVE_STEP;
+        ghosts.lastDirection[i] = direction;
+    }
+    ghosts.score[i] = score;
+    ghosts.speed[i] = speed;
+    ghosts.direction[i] = direction;
+}
+
+void Simulation::moveGhost(int i, bool endgame)
+{
+    withBehaviour((GhostArchetype)ghosts.archetype[i], [this, i, endgame](auto behaviour) {
+        moveGhostAs<decltype(behaviour)>(i, endgame);
+    });
+}
+
+void Simulation::moveGhosts()
+{
+    const int n = ghosts.size();
+    const bool endgame = getFoodLeft() < 20;  //если в лабиринте осталось меньше 20 точек
+    targetCells.resize(n);
+    frightEnded.assign(n, 0);
+    neededTargets.clear();
+    neededTargets.reserve(n);   // цели нужны не каждый такт: память сразу на всех призраков
+
+    // 1. Цели по положениям на начало такта - только у тех, кому на этом такте
+    // выбирать ход: призрак в коридоре идёт по нему без цели и поля расстояний
+    {
+        PROFILE_SCOPE("GhostTargets");
+        const int px = pacman.getX(), py = pacman.getY();
+        int dx = 0, dy = 0;
+        if (pacman.getNextDirection() >= 0 && pacman.getNextDirection() < 4) {
+            dx = DIRECTION_DX[pacman.getNextDirection()];
+            dy = DIRECTION_DY[pacman.getNextDirection()];
+        }
+        // путь по лабиринту от Пакмана до Клайда; поле до Пакмана общее с Blinky
+        const TargetContext context = { map, ghosts, distances.get(map, px, py), px, py, dx, dy };
+        for (int i = 0; i < n; ++i)
+            withBehaviour((GhostArchetype)ghosts.archetype[i], [&](auto behaviour) {
+                typedef decltype(behaviour) Behaviour;
+                targetCells[i] = -1;
+                if (ghosts.state[i] == Ghost::FRIGHTENED && !Behaviour::ignoresFright(endgame))
+                    return;
+                if (graph.corridorDirection(map.cellId(ghosts.y[i], ghosts.x[i]), ghosts.lastDirection[i]) >= 0)
+                    return;
+                int x, y;
+                Behaviour::target(context, i, x, y);
+                targetCells[i] = distances.snap(map, x, y);
+                neededTargets.push_back(targetCells[i]);
+            });
+    }
+
+    // 2. Поля расстояний для всех различных целей; дальше кэш только читается
+    {
+        PROFILE_SCOPE("DistanceFields");
+        std::sort(neededTargets.begin(), neededTargets.end());
+        neededTargets.erase(std::unique(neededTargets.begin(), neededTargets.end()), neededTargets.end());
+        distances.prepare(map, neededTargets);
+    }
+
+    // 3. Шаги призраков независимы друг от друга
+    {
+        PROFILE_SCOPE("GhostMove");
+        if (pool && n >= PARALLEL_GHOSTS)
+            pool->parallelFor(0, n, PARALLEL_GRAIN, [this, endgame](int i) { moveGhost(i, endgame); });
+        else
+            for (int i = 0; i < n; ++i)
+                moveGhost(i, endgame);
+    }
+
+    // 4. Конец испуга хотя бы у одного призрака возвращает всех на места
+    if (std::find(frightEnded.begin(), frightEnded.end(), 1) != frightEnded.end())
+        respawnGhosts();
+}
+
+Simulation::Simulation(const Level& level, int pacmanStartX, int pacmanStartY, std::uint64_t seed) : level(level),
+    pacmanStartX(pacmanStartX), pacmanStartY(pacmanStartY),
+    smallFood(level.info().smallFood, 5, 'o'), bigFood(level.info().bigFood, 10, 'O'), fruitIndex(0),
+    pacman(pacmanStartX, pacmanStartY, pacmanStartX, pacmanStartY, 0, 3, 3, 0), random(seed), record(0), pool(nullptr), tickCount(0), episode(0)
+{
+    eatenCells.reserve(smallFood.getCount() + bigFood.getCount());
+    indexLevel();
+
+    //массив фруктов
+    fruitArray[0] = Fruit(20);
+    fruitArray[1] = Fruit(30);
+    fruitArray[2] = Fruit(40);
+    fruitArray[3] = Fruit(50);
+    fruitArray[4] = Fruit(60);
+
+    createGhosts();
+}
+
+Simulation::Simulation(const Level& level, std::uint64_t seed)
+    : Simulation(level, level.info().pacman.x, level.info().pacman.y, seed)
+{
+}
+
+Simulation::Simulation(int pacmanStartX, int pacmanStartY, std::uint64_t seed)
+    : Simulation(LevelPack::builtin().get(0), pacmanStartX, pacmanStartY, seed)
+{
+}
+
+void Simulation::load(const Level& newLevel, std::uint64_t seed)
+{
+    // Тот же уровень (следующая партия в пакете из одного уровня или та же
+    // карта в другом пакете): граф и поля расстояний уже построены, карту
+    // перезапишет reset()
+    bool sameLevel = levelFingerprint(newLevel) == levelHash
+        && pacmanStartX == newLevel.info().pacman.x && pacmanStartY == newLevel.info().pacman.y;
+    level = newLevel;
+    pacmanStartX = level.info().pacman.x;
+    pacmanStartY = level.info().pacman.y;
+    eatenCells.reserve(level.info().smallFood + level.info().bigFood);
+    if (!sameLevel)
+        indexLevel();
+    reset();
+    // в отличие от reset() призраки создаются заново: лишние пропадают,
+    // направления и генераторы те же, что у нового мира
+    random.setSeed(seed);
+    createGhosts();
+}
+
+void Simulation::indexLevel()
+{
+    // всё, что выводится из уровня один раз и не меняется за партию
+    map.load(level);
+    graph.build(map);
+    distances.init(map, pacmanStartX, pacmanStartY);
+    levelHash = levelFingerprint(level);
+    levelPellets = map.getSmallPellets();
+    levelPellets |= map.getPowerPellets();
+    levelSmallPellets = map.getSmallPellets();
+}
+
+void Simulation::createGhosts()
+{
+    ghosts.clear();
+    addGhost(BLINKY);
+    addGhost(PINKY);
+    addGhost(INKY);
+    addGhost(CLYDE);
+}
+
+GhostHandle Simulation::addGhost(GhostArchetype type)
+{
+    const int i = ghosts.size();
+    const LevelPoint& spawn = level.info().ghostSpawn[i % LEVEL_GHOSTS];
+    const LevelPoint& home = level.info().ghostHome[i % LEVEL_GHOSTS];
+    GhostHandle handle = ghosts.create(type, spawn.x, spawn.y, home.x, home.y, random.getState());
+    // столкнуться за такт могут все призраки сразу: запас, чтобы такт не выделял память
+    hits.reserve(ghosts.size());
+    if (type == INKY)
+        for (int j = 0; j < i; ++j)
+            if (ghosts.archetype[j] == BLINKY) {
+                ghosts.partner[i] = ghosts.handleAt(j);
+                break;
+            }
+    return handle;
+}
+
+void Simulation::respawnGhosts()
+{
+    for (int i = 0; i < ghosts.size(); ++i)
+        ghosts.respawn(i, ghosts.spawnX[i], ghosts.spawnY[i]);
+}
+
+void Simulation::reset()
+{
+    // сброс карты
+    map.load(level);
+
+    // сброс еды
+    smallFood = Food(level.info().smallFood, 5, 'o');
+    bigFood = Food(level.info().bigFood, 10, 'O');
+
+    // сброс фруктов
+    for (int i = 0; i < 5; ++i)
+        fruitArray[i] = Fruit(20 + 10 * i);
+    fruitIndex = 0;
+
+    // сброс Pacman
+    pacman.setX(pacmanStartX);
+    pacman.setY(pacmanStartY);
+    pacman.setNextX(pacmanStartX);
+    pacman.setNextY(pacmanStartY);
+    pacman.setNextDirection(3);
+    int* pointsPtr = pacman.getPointsPointer();
+    *pointsPtr = 0;                                              // Изменяем значение points через указатель
+    int& livesRef = pacman.getLivesReference();
+    livesRef = 3;                                              // Изменяем значение lives через ссылку
+    pacman.setScore(0);
+
+    // сброс призраков
+    respawnGhosts();
+    for (int i = 0; i < ghosts.size(); ++i) {
+        ghosts.state[i] = Ghost::NORMAL;
+        ghosts.frightenedTimer[i] = 0;
+    }
+    // карта только что загружена заново: точку в стартовой клетке Пакман съест
+    // на первом такте, как и в новом мире
+    tickCount = 0;
+    eatenCells.clear();
+    episode++;
+}
+
+int Simulation::collideGhosts()
+{
+    // клетка, в которую Пакман направляется; шаг по графу, как в PacmanMove,
+    // чтобы у входа в туннель это была клетка на другом его конце
+    int nextX = pacman.getX(), nextY = pacman.getY();
+    const int nextDirection = pacman.getNextDirection();
+    if (nextDirection >= 0 && nextDirection < 4) {
+        int next = graph.step(map.cellId(nextY, nextX), nextDirection);
+        nextX = graph.cellX(next);
+        nextY = graph.cellY(next);
+    }
+    ghostHash.build(ghosts.x.data(), ghosts.y.data(), ghosts.size(), map.getW(), map.getH());
+    if (!detectCollisions(ghosts, ghostHash, pacman.getX(), pacman.getY(), nextX, nextY, hits))
+        return 0;
+    return resolveCollisions(ghosts, hits, pacman);
+}
+
+namespace {
+// FNV-1a по байтам 64-битных слов
+struct StateHash {
+    std::uint64_t value = 0xCBF29CE484222325ull;
+    void add(std::int64_t word) {
+        for (int i = 0; i < 8; ++i) {
+            value ^= (std::uint64_t)(word >> (i * 8)) & 0xFF;
+            value *= 0x100000001B3ull;
+        }
+    }
+};
+}
+
+const Bitboard& Simulation::occupancy()
+{
+    occupied.resize((int)map.cellCount());
+    occupied.set(map.cellId(pacman.getY(), pacman.getX()));
+    for (int i = 0; i < ghosts.size(); ++i)
+        occupied.set(map.cellId(ghosts.y[i], ghosts.x[i]));
+    return occupied;
+}
+
+const Bitboard& Simulation::reachablePellets()
+{
+    reachable.resize((int)map.cellCount());
+    reachable.set(map.cellId(pacman.getY(), pacman.getX()));
+    graph.flood(reachable, floodScratch);
+    Bitboard& pellets = floodScratch;
+    pellets = map.getSmallPellets();
+    pellets |= map.getPowerPellets();
+    reachable &= pellets;
+    return reachable;
+}
+
+std::uint64_t Simulation::checksum() const
+{
+    StateHash hash;
+    hash.add(tickCount);
+    hash.add(pacman.getX()); hash.add(pacman.getY());
+    hash.add(pacman.getNextX()); hash.add(pacman.getNextY());
+    hash.add(pacman.getScore()); hash.add(pacman.getNextDirection());
+    hash.add(pacman.getLives()); hash.add(pacman.getPoints());
+    hash.add(ghosts.size());
+    for (int i = 0; i < ghosts.size(); ++i) {
+        hash.add(ghosts.archetype[i]);
+        hash.add(ghosts.x[i]); hash.add(ghosts.y[i]); hash.add(ghosts.score[i]);
+        hash.add(ghosts.direction[i]); hash.add(ghosts.lastDirection[i]);
+        hash.add(ghosts.state[i]); hash.add(ghosts.frightenedTimer[i]);
+        hash.add((std::int64_t)ghosts.random[i].getState());
+    }
+    hash.add(smallFood.getCount()); hash.add(bigFood.getCount());
+    // сами точки, а не только их число: разные съеденные клетки дают разный хэш
+    for (int i = 0; i < map.getSmallPellets().wordCount(); ++i)
+        hash.add((std::int64_t)(map.getSmallPellets().data()[i] ^ map.getPowerPellets().data()[i]));
+    const Fruit& fruit = fruitArray[fruitIndex];
+    hash.add(fruitIndex); hash.add(fruit.getIsActive()); hash.add(fruit.getX()); hash.add(fruit.getY());
+    hash.add((std::int64_t)random.getState());
+    return hash.value;
+}
+
+bool Simulation::clone(GameSnapshot& s) const
+{
+    const Bitboard& small = map.getSmallPellets();
+    const Bitboard& power = map.getPowerPellets();
+    if (ghosts.size() > SNAPSHOT_GHOSTS || small.wordCount() > SNAPSHOT_WORDS)
+        return false;
+
+    s = GameSnapshot();
+    s.level = levelHash;
+    s.random = random.getState();
+    s.tickCount = tickCount;
+    s.episode = episode;
+    s.record = record;
+    s.pacmanScore = pacman.getScore();
+    s.pacmanSpeed = pacman.getSpeed();
+    s.pacmanPoints = pacman.getPoints();
+    s.pacmanX = (std::int16_t)pacman.getX();
+    s.pacmanY = (std::int16_t)pacman.getY();
+    s.pacmanNextX = (std::int16_t)pacman.getNextX();
+    s.pacmanNextY = (std::int16_t)pacman.getNextY();
+    s.pacmanPrevX = (std::int16_t)pacman.getPrevX();
+    s.pacmanPrevY = (std::int16_t)pacman.getPrevY();
+    s.pacmanDirection = (std::int8_t)pacman.getNextDirection();
+    s.pacmanLives = (std::int8_t)pacman.getLives();
+    s.smallFood = (std::int16_t)smallFood.getCount();
+    s.bigFood = (std::int16_t)bigFood.getCount();
+    s.fruitIndex = (std::int8_t)fruitIndex;
+    for (int i = 0; i < SNAPSHOT_FRUITS; ++i) {
+        const Fruit& fruit = fruitArray[i];
+        s.fruits[i] = { (std::int16_t)fruit.getX(), (std::int16_t)fruit.getY(), (std::int16_t)fruit.getPoints(), (std::uint8_t)fruit.getIsActive(), 0 };
+    }
+    const Fruit& fruit = fruitArray[fruitIndex];
+    s.pacmanTile = map.getTile(pacman.getY(), pacman.getX()).type == 'P';
+    s.fruitTile = fruit.getIsActive() && map.getTile(fruit.getY(), fruit.getX()).type == 'F';
+
+    s.ghostCount = (std::int8_t)ghosts.size();
+    for (int i = 0; i < ghosts.size(); ++i) {
+        SnapshotGhost& g = s.ghosts[i];
+        g.random = ghosts.random[i].getState();
+        g.score = ghosts.score[i];
+        g.speed = ghosts.speed[i];
+        g.frightenedTimer = ghosts.frightenedTimer[i];
+        g.x = (std::int16_t)ghosts.x[i];
+        g.y = (std::int16_t)ghosts.y[i];
+        g.prevX = (std::int16_t)ghosts.prevX[i];
+        g.prevY = (std::int16_t)ghosts.prevY[i];
+        g.direction = (std::int8_t)ghosts.direction[i];
+        g.lastDirection = (std::int8_t)ghosts.lastDirection[i];
+        g.state = ghosts.state[i];
+        g.archetype = ghosts.archetype[i];
+    }
+    for (int w = 0; w < small.wordCount(); ++w)
+        s.pellets[w] = small.data()[w] | power.data()[w];
+    return true;
+}
+
+bool Simulation::fitsLevel(const GameSnapshot& s) const
+{
+    // как и в clone(): лабиринт больше снимка не восстанавливается
+    if (s.level != levelHash || levelPellets.wordCount() > SNAPSHOT_WORDS)
+        return false;
+    const int W = map.getW(), H = map.getH();
+    const LevelTile* tiles = level.tiles();
+    auto inside = [W, H](int x, int y) { return x >= 0 && x < W && y >= 0 && y < H; };
+    auto passable = [this, tiles, &inside](int x, int y) { return inside(x, y) && tiles[map.cellId(y, x)].passable; };
+    if (!passable(s.pacmanX, s.pacmanY) || !passable(s.pacmanNextX, s.pacmanNextY) || !inside(s.pacmanPrevX, s.pacmanPrevY))
+        return false;
+    for (const SnapshotFruit& fruit : s.fruits)
+        if (!inside(fruit.x, fruit.y))
+            return false;
+    for (int i = 0; i < s.ghostCount; ++i) {
+        const SnapshotGhost& g = s.ghosts[i];
+        if (!inside(g.x, g.y) || !inside(g.prevX, g.prevY))
+            return false;
+    }
+    // Точки - подмножество точек уровня, их число сходится со счётчиками еды.
+    // Счётчики мира сходятся с его картой, поэтому число точек снимка считается
+    // только по словам, в которых снимок отличается от карты
+    const int words = levelPellets.wordCount();
+    const std::uint64_t* small = map.getSmallPellets().data();
+    const std::uint64_t* power = map.getPowerPellets().data();
+    int smallCount = smallFood.getCount(), totalCount = smallCount + bigFood.getCount();
+    std::uint64_t outside = 0;
+    for (int w = 0; w < SNAPSHOT_WORDS; ++w) {
+        if (w >= words) {
+            outside |= s.pellets[w];
+            continue;
+        }
+        outside |= s.pellets[w] & ~levelPellets.data()[w];
+        std::uint64_t current = small[w] | power[w];
+        std::uint64_t diff = current ^ s.pellets[w];
+        if (!diff)
+            continue;
+        std::uint64_t added = diff & s.pellets[w], removed = diff & current;
+        smallCount += popcount64(added & levelSmallPellets.data()[w]) - popcount64(removed & levelSmallPellets.data()[w]);
+        totalCount += popcount64(added) - popcount64(removed);
+    }
+    if (outside || smallCount != s.smallFood || totalCount - smallCount != s.bigFood)
+        return false;
+    // Пакман и фрукт стоят на клетках без точек и не на одной клетке
+    auto hasPellet = [this, &s](int x, int y) {
+        int cell = map.cellId(y, x);
+        return (s.pellets[cell >> 6] >> (cell & 63)) & 1;
+    };
+    const SnapshotFruit& fruit = s.fruits[s.fruitIndex];
+    if (s.pacmanTile && hasPellet(s.pacmanX, s.pacmanY))
+        return false;
+    if (s.fruitTile && (hasPellet(fruit.x, fruit.y) || !passable(fruit.x, fruit.y)
+        || (s.pacmanTile && fruit.x == s.pacmanX && fruit.y == s.pacmanY)))
+        return false;
+    return true;
+}
+
+bool Simulation::restore(const GameSnapshot& s)
+{
+    std::string error;
+    if (!checkSnapshot(s, error) || !fitsLevel(s))
+        return false;
+
+    // Карта: сначала убираем Пакмана и фрукт, потом переставляем точки,
+    // которые отличаются от снимка, и ставим Пакмана и фрукт из снимка
+    const Fruit& oldFruit = fruitArray[fruitIndex];
+    if (oldFruit.getIsActive() && map.getTile(oldFruit.getY(), oldFruit.getX()).type == 'F')
+        map.setTile(oldFruit.getY(), oldFruit.getX(), ' ');
+    if (map.getTile(pacman.getY(), pacman.getX()).type == 'P')
+        map.setTile(pacman.getY(), pacman.getX(), ' ');
+    const Bitboard& small = map.getSmallPellets();
+    const Bitboard& power = map.getPowerPellets();
+    const LevelTile* tiles = level.tiles();
+    eatenCells.clear();
+    for (int w = 0; w < small.wordCount(); ++w) {
+        std::uint64_t diff = (small.data()[w] | power.data()[w]) ^ s.pellets[w];
+        while (diff) {
+            int cell = w * 64 + lowestBit64(diff);
+            diff &= diff - 1;
+            bool present = (s.pellets[w] >> (cell & 63)) & 1;
+            map.setTile(map.cellY(cell), map.cellX(cell), present ? tiles[cell].type : ' ');
+        }
+        std::uint64_t eaten = levelPellets.data()[w] & ~s.pellets[w];
+        while (eaten) {
+            eatenCells.push_back(w * 64 + lowestBit64(eaten));
+            eaten &= eaten - 1;
+        }
+    }
+
+    for (int i = 0; i < SNAPSHOT_FRUITS; ++i) {
+        const SnapshotFruit& f = s.fruits[i];
+        fruitArray[i] = Fruit(f.points);
+        fruitArray[i].setPosition(f.x, f.y);
+        fruitArray[i].setIsActive(f.isActive != 0);
+    }
+    fruitIndex = s.fruitIndex;
+    if (s.fruitTile)
+        map.setTile(s.fruits[fruitIndex].y, s.fruits[fruitIndex].x, 'F');
+    if (s.pacmanTile)
+        map.setTile(s.pacmanY, s.pacmanX, 'P');
+
+    smallFood = Food(s.smallFood, 5, 'o');
+    bigFood = Food(s.bigFood, 10, 'O');
+    pacman.setX(s.pacmanX);
+    pacman.setY(s.pacmanY);
+    pacman.setPrev(s.pacmanPrevX, s.pacmanPrevY);
+    pacman.setNextX(s.pacmanNextX);
+    pacman.setNextY(s.pacmanNextY);
+    pacman.setNextDirection(s.pacmanDirection);
+    pacman.setScore(s.pacmanScore);
+    pacman.setSpeed(s.pacmanSpeed);
+    pacman.setLives(s.pacmanLives);
+    pacman.setPoints(s.pacmanPoints);
+
+    // Призраки: тот же состав переписывается на месте, иначе создаётся заново
+    bool sameGhosts = ghosts.size() == s.ghostCount;
+    for (int i = 0; sameGhosts && i < s.ghostCount; ++i)
+        sameGhosts = ghosts.archetype[i] == s.ghosts[i].archetype;
+    if (!sameGhosts) {
+        ghosts.clear();
+        for (int i = 0; i < s.ghostCount; ++i)
+            addGhost(static_cast<GhostArchetype>(s.ghosts[i].archetype));
+    }
+    for (int i = 0; i < s.ghostCount; ++i) {
+        const SnapshotGhost& g = s.ghosts[i];
+        ghosts.random[i] = Random();
+        ghosts.random[i].setState(g.random);
+        ghosts.score[i] = g.score;
+        ghosts.speed[i] = g.speed;
+        ghosts.frightenedTimer[i] = g.frightenedTimer;
+        ghosts.x[i] = g.x;
+        ghosts.y[i] = g.y;
+        ghosts.prevX[i] = g.prevX;
+        ghosts.prevY[i] = g.prevY;
+        ghosts.direction[i] = g.direction;
+        ghosts.lastDirection[i] = g.lastDirection;
+        ghosts.state[i] = g.state;
+    }
+
+    random.setState(s.random);
+    tickCount = s.tickCount;
+    episode = s.episode;
+    record = s.record;
+    return true;
+}
+
+int Simulation::step(int direction)
+{
+    if (!fruitArray[fruitIndex].getIsActive())
+    {
+        fruitIndex = random.nextInt(5);
+    }
+    fruitArray[fruitIndex].createFruit(map, getFoodLeft(), getFoodTotal(), random);
+    int result = pacman.WonOrLost(smallFood, bigFood);
+    if (result)
+    {
+        if (pacman.getPoints() > record)
+            record = pacman.getPoints();
+        return result;
+    }
+
+    {
+        PROFILE_SCOPE("PacmanMove");
+        int foodBefore = getFoodLeft();
+        pacman.PacmanMove(map, smallFood, bigFood, fruitArray[fruitIndex], ghosts, graph, direction);
+        if (getFoodLeft() != foodBefore)
+            eatenCells.push_back(map.cellId(pacman.getY(), pacman.getX()));
+    }
+    moveGhosts();
+    int caught;
+    {
+        PROFILE_SCOPE("Collisions");
+        caught = collideGhosts();
+    }
+    if (caught)
+    {
+        if (pacman.getLives())
+        {
+            respawnGhosts();
+            map.setTile(pacman.getY(), pacman.getX(), ' ');
+            map.setTile(pacmanStartY, pacmanStartX, 'P');
+            pacman.setX(pacmanStartX);
+            pacman.setY(pacmanStartY);
+            pacman.setNextX(pacmanStartX);
+            pacman.setNextY(pacmanStartY);
+            pacman.setScore(0);
+            pacman.setNextDirection(3);
+        }
+    }
+    tickCount++;
+    return 0;
+}
@@ -0,0 +1,490 @@
+﻿#pragma once
+// Ядро симуляции Pac-Man: карта, еда, фрукты, Пакман, призраки и столкновения.
+// Не зависит ни от SFML, ни от Win32, поэтому собирается и под Linux без окна.
+#include <string>
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <type_traits>
+#include <iostream>
+#include "DistanceField.h"
+#include "MazeGraph.h"
+#include "Collision.h"
+#include "Random.h"
+#include "LevelPack.h"
+#include "GhostStore.h"
+#include "SpatialHash.h"
+#include "CellSet.h"
+#include "Bitboard.h"
+#include "Snapshot.h"
+
+// Симуляция идёт фиксированными тактами независимо от частоты кадров
+const int TICKS_PER_SECOND = 120;
+// Прогресс, накопив который, сущность переходит на соседнюю клетку
+const int MOVE_STEP = 1 << 16;
+// Скорости в клетках в секунду
+const float PACMAN_SPEED = 8.0f;
+const float GHOST_SPEED = 8.0f;
+const float GHOST_FRIGHTENED_SPEED = 3.0f;
+const float PINKY_ENDGAME_SPEED = 12.0f;
+// Длительность испуга призраков после большой точки
+const float FRIGHTENED_SECONDS = 2.5f;
+// Фрукт появляется, когда съедено столько точек
+const int FRUIT_AFTER_EATEN[] = { 70, 170 };
+
+inline int speedPerTick(float tilesPerSecond) { return (int)(tilesPerSecond * MOVE_STEP / TICKS_PER_SECOND); }
+
+class Food;
+class Map;
+class Fruit;
+class Ghost;
+class ThreadPool;
+
+class Tile {
+public:
+    char type;
+    bool isPassable;
+    Tile(char type = ' ', bool isPassable = true) : type(type), isPassable(isPassable) {}
+
+    friend std::ostream& operator<<(std::ostream& os, const Tile& tile) {
+        os << "Type: " << tile.type << ", Passable: " << (tile.isPassable ? "true" : "false");
+        return os;
+    }
+};
+
+class InputManager {
+public:
+    virtual ~InputManager() = default;
+    virtual int getDirection() = 0;  // 0: вверх, 1: вниз, 2: влево, 3: вправо, -1: нет ввода
+};
+
+class Pacman {
+private:
+    int x, y, nextX, nextY, score, nextDirection, lives, points;
+    int prevX, prevY, speed;  // клетка до последнего шага и прирост прогресса за такт
+public:
+    ~Pacman() {};
+    Pacman(int x, int y, int nextX, int nextY, int score, int nextDirection, int lives, int points) : x(x), y(y), nextX(nextX), nextY(nextY), score(score), nextDirection(nextDirection), lives(lives), points(points), prevX(x), prevY(y), speed(0) {};
+    int getX() const { return x; }
+    int getY() const { return y; }
+    int getPrevX() const { return prevX; }
+    int getPrevY() const { return prevY; }
+    // Доля пути от предыдущей клетки к текущей; alpha - доля такта, прошедшая с его начала
+    float getStepFraction(float alpha) const { float f = (score + alpha * speed) / MOVE_STEP; return f < 1.0f ? f : 1.0f; }
+    int getPoints() const { return points; }
+    int getLives() const { return lives; }
+    int getNextDirection() const { return nextDirection; }
+    int getNextX() const { return nextX; }
+    int getNextY() const { return nextY; }
+    int getScore() const { return score; }
+    int getSpeed() const { return speed; }
+    void setX(int a) { x = a; prevX = a; }
+    void setY(int a) { y = a; prevY = a; }
+    void setNextX(int a) { nextX = a; }
+    void setNextY(int a) { nextY = a; }
+    void setScore(int a) { score = a; }
+    void setLives(int a) { lives = a; }
+    void setPoints(int a) { points = a; }
+    void setNextDirection(int a) { nextDirection = a; }
+    void setPrev(int a, int b) { prevX = a; prevY = b; }
+    void setSpeed(int a) { speed = a; }
+    void loseLife() { lives--; }
+    void addPoints(int points) { this->points += points; }
+    int* getPointsPointer() {
+        return &points;
+    }
+    int& getLivesReference() {
+        return lives;
+    }
+
+    void PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, GhostStore& ghosts, const MazeGraph& graph, int direction);
+
+    // 0 - игра продолжается, 1 - победа, 2 - поражение
+    int WonOrLost(const Food& smallFood, const Food& bigFood);
+    friend std::ostream& operator<<(std::ostream& os, const Pacman& pacman) {
+        os << "Pacman: x=" << pacman.x << ", y=" << pacman.y << ", score=" << pacman.score << ", lives=" << pacman.lives << ", points=" << pacman.points;
+        return os;
+    }
+
+    void setGhostsFrightened(GhostStore& ghosts, int duration);
+};
+
+class Food {
+private:
+    int count;
+    int point;
+    char type;
+public:
+    ~Food() {};
+    Food(int count, int point, char type) : count(count), point(point), type(type) {}
+    int getCount() const { return count; }
+    int getPoint() const { return point; }
+    char getType() const { return type; }
+    void decreaseCount() { count--; }
+    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, GhostStore& ghosts, const MazeGraph& graph, int direction);
+    friend int Pacman::WonOrLost(const Food& smallFood, const Food& bigFood);
+    friend std::ostream& operator<<(std::ostream& os, const Food& food) {
+        os << "Food: count=" << food.count << ", point=" << food.point << ", type=" << food.type;
+        return os;
+    }
+};
+
+// Аллокатор с выравниванием по строке кэша для плоских массивов карты
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, Alignment>; };
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, std::size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+static_assert(std::is_trivially_copyable<Tile>::value, "Map tiles must stay memcpy-able");
+static_assert(sizeof(Tile) == sizeof(LevelTile), "Tile must match the level pack layout");
+
+// Клетка рамки вокруг лабиринта: непроходима и никогда не рисуется
+const Tile SENTINEL_TILE('#', false);
+
+class Map {
+private:
+    int H, W;
+    int stride;  // длина строки вместе с рамкой, W + 2
+    // Все клетки одним непрерывным блоком, по строкам, с рамкой в одну клетку
+    // по периметру: соседа любой клетки лабиринта можно читать без проверок границ
+    std::vector<Tile, AlignedAllocator<Tile, 64>> Mase;
+    const LevelHeader* level;   // туннели, точки появления; память принадлежит пакету уровней
+    const LevelIndexes* precomputed;    // индексы встроенного уровня или nullptr
+    // Индексы, которые обновляются при каждом setTile
+    struct Indexes {
+        Bitboard freeCells;     // пустые клетки в области появления фруктов
+        int freeCount = 0;
+        CellSet pellets;        // клетки с точками, маленькими и большими
+        // Слои по битам (номер бита - cellId); стены не меняются после load()
+        Bitboard walls;
+        Bitboard smallPellets;
+        Bitboard powerPellets;
+    };
+    Indexes indexes;
+    // Индексы только что загруженного уровня: повторная загрузка того же
+    // уровня (сброс партии) копирует их, а не строит заново
+    Indexes loadedIndexes;
+    const LevelHeader* indexedLevel;
+    // Клетки области фруктов, которые могут быть пустыми (проходимые или пустые
+    // в уровне), по возрастанию номера; не меняются после load()
+    std::vector<int> fruitCells;
+    // Сколько раз sampleFreeCell тянет клетку из fruitCells, прежде чем взять по рангу
+    static const int SAMPLE_ATTEMPTS = 32;
+
+    bool isFruitArea(int y, int x) const {
+        return x >= level->fruitMin.x && x <= level->fruitMax.x && y >= level->fruitMin.y && y <= level->fruitMax.y;
+    }
+    void index(int y, int x, char type) {
+        int cell = cellId(y, x);
+        bool free = type == ' ' && isFruitArea(y, x);
+        if (free != indexes.freeCells.test(cell)) {
+            indexes.freeCells.assign(cell, free);
+            indexes.freeCount += free ? 1 : -1;
+        }
+        if (type == 'o' || type == 'O') indexes.pellets.insert(cell); else indexes.pellets.erase(cell);
+        indexes.smallPellets.assign(cell, type == 'o');
+        indexes.powerPellets.assign(cell, type == 'O');
+    }
+public:
+    ~Map() {};
+    Map() : H(0), W(0), stride(2), level(nullptr), precomputed(nullptr), indexedLevel(nullptr) {}
+    // Клетки уровня копируются целиком; при том же размере без выделения памяти.
+    // Индексы встроенного уровня берутся из Level::precomputed
+    void load(const Level& source);
+    const LevelHeader& getLevel() const { return *level; }
+    const LevelIndexes* getPrecomputed() const { return precomputed; }
+    int getH() const { return H; }
+    int getW() const { return W; }
+    int getStride() const { return stride; }
+    // Линейный номер клетки; соседи: cell - stride, cell + stride, cell - 1, cell + 1
+    int cellId(int y, int x) const { return (y + 1) * stride + (x + 1); }
+    const Tile& getTile(int cell) const { return Mase[cell]; }
+    Tile getTile(int y, int x) const { return Mase[cellId(y, x)]; }
+    void setTile(int y, int x, Tile tile) { Mase[cellId(y, x)] = tile; index(y, x, tile.type); }
+    int cellX(int cell) const { return cell % stride - 1; }
+    int cellY(int cell) const { return cell / stride - 1; }
+    const Bitboard& getFreeCells() const { return indexes.freeCells; }
+    const std::vector<int>& getFruitCells() const { return fruitCells; }
+    int getFreeCount() const { return indexes.freeCount; }
+    // Равновероятно любая пустая клетка области фруктов или -1. Выборка с
+    // отказами из неизменного списка fruitCells: в среднем fruitCells.size() /
+    // getFreeCount() попыток по одной проверке бита, без прохода по словам.
+    // Если не повезло SAMPLE_ATTEMPTS раз подряд, клетка берётся по рангу в
+    // битовой карте. Выбор зависит только от набора пустых клеток, а не от
+    // порядка, в котором они освобождались, поэтому восстановленный из снимка
+    // мир выбирает ту же клетку, что и исходный
+    int sampleFreeCell(Random& random) const {
+        if (!indexes.freeCount)
+            return -1;
+        for (int attempt = 0; attempt < SAMPLE_ATTEMPTS; ++attempt) {
+            int cell = fruitCells[random.nextInt((int)fruitCells.size())];
+            if (indexes.freeCells.test(cell))
+                return cell;
+        }
+        return indexes.freeCells.select(random.nextInt(indexes.freeCount));
+    }
+    const CellSet& getPellets() const { return indexes.pellets; }
+    const Bitboard& getWalls() const { return indexes.walls; }
+    const Bitboard& getSmallPellets() const { return indexes.smallPellets; }
+    const Bitboard& getPowerPellets() const { return indexes.powerPellets; }
+    // Сырые данные для копирования целиком, (H + 2) * stride клеток
+    const Tile* data() const { return Mase.data(); }
+    std::size_t cellCount() const { return Mase.size(); }
+    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, GhostStore& ghosts, const MazeGraph& graph, int direction);
+
+    // Туннели: direction 2 - влево, 3 - вправо, как у InputManager
+    bool isTunnelMouth(int y, int x, int direction) const {
+        for (int i = 0; i < level->tunnelCount; ++i) {
+            const LevelTunnel& tunnel = level->tunnels[i];
+            if (tunnel.y == y && (direction == 2 ? tunnel.leftX : tunnel.rightX) == x)
+                return true;
+        }
+        return false;
+    }
+    // x после шага влево или вправо с учётом туннеля
+    int stepX(int y, int x, int direction) const { return tunnelStepX(*level, y, x, direction); }
+    // Клетка за входом в туннель: оттуда нельзя уходить вверх и вниз
+    bool isBeyondTunnel(int y, int x) const { return ::isBeyondTunnel(*level, y, x); }
+    // Клетка на другом конце туннеля или -1; для поиска в ширину
+    int tunnelExit(int cell) const {
+        for (int i = 0; i < level->tunnelCount; ++i) {
+            const LevelTunnel& tunnel = level->tunnels[i];
+            if (cell == cellId(tunnel.y, tunnel.leftX))
+                return cellId(tunnel.y, tunnel.rightX);
+            if (cell == cellId(tunnel.y, tunnel.rightX))
+                return cellId(tunnel.y, tunnel.leftX);
+        }
+        return -1;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Map& map) {
+        os << "Map: H=" << map.H << ", W=" << map.W << "\n";
+        for (int i = 0; i < map.H; i++) {
+            for (int j = 0; j < map.W; j++) {
+                os << map.Mase[map.cellId(i, j)].type;
+            }
+            os << "\n";
+        }
+        return os;
+    }
+};
+
+class Fruit {
+private:
+    int x;
+    int y;
+    int points;
+    bool isActive;
+public:
+    Fruit() : x(0), y(0), points(0), isActive(false) {};
+    Fruit(int points) : x(0), y(0), points(points), isActive(false) {}
+    int getX() const { return x; }
+    int getY() const { return y; }
+    int getPoints() const { return points; }
+    void setIsActive(bool active) { isActive = active; }
+    void setPosition(int a, int b) { x = a; y = b; }
+    bool getIsActive() const { return isActive; }
+    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, GhostStore& ghosts, const MazeGraph& graph, int direction);
+
+    // foodLeft - сколько точек осталось в лабиринте, foodTotal - сколько было в начале
+    void createFruit(Map& map, int foodLeft, int foodTotal, Random& random);
+    friend std::ostream& operator<<(std::ostream& os, const Fruit& fruit) {
+        os << "Fruit: x=" << fruit.x << ", y=" << fruit.y << ", points=" << fruit.points << ", isActive=" << fruit.isActive;
+        return os;
+    }
+};
+
+class Ghost {
+public:
+    enum GhostState {
+        NORMAL,
+        FRIGHTENED,
+        EATEN
+    };
+protected:                       //модификатор protected
+    GhostState currentState;
+    int frightenedTimer;  // таймер для режима испуга
+    int x, y, score, direction, lastDirection;
+    int prevX, prevY, speed;  // клетка до последнего шага и прирост прогресса за такт
+public:
+    Ghost() {};
+    ~Ghost() {};
+    Ghost(int x, int y, int score, int direction, int lastDirection) : currentState(NORMAL), frightenedTimer(0), x(x), y(y), score(score), direction(direction), lastDirection(lastDirection), prevX(x), prevY(y), speed(0) {};
+    // Снимок призрака i из хранилища
+    Ghost(const GhostStore& ghosts, int i) : currentState((GhostState)ghosts.state[i]), frightenedTimer(ghosts.frightenedTimer[i]),
+        x(ghosts.x[i]), y(ghosts.y[i]), score(ghosts.score[i]), direction(ghosts.direction[i]), lastDirection(ghosts.lastDirection[i]),
+        prevX(ghosts.prevX[i]), prevY(ghosts.prevY[i]), speed(ghosts.speed[i]) {}
+    int getX() const { return x; }
+    int getY() const { return y; }
+    int getPrevX() const { return prevX; }
+    int getPrevY() const { return prevY; }
+    float getStepFraction(float alpha) const { float f = (score + alpha * speed) / MOVE_STEP; return f < 1.0f ? f : 1.0f; }
+    int getScore() const { return score; }
+    int getDirection() const { return direction; }
+    int getLastDirection() const { return lastDirection; }
+    GhostState getCurrentState() const { return currentState; }
+    int getFrightenedTimer() const { return frightenedTimer; }
+    void setGhostState(GhostState state, int duration) {
+        currentState = state;
+        frightenedTimer = duration;
+    }
+    void setAll(int a, int b, int c, int d, int e) { x = a, y = b, score = c, direction = d, lastDirection = e; prevX = a, prevY = b; }
+
+    // Перегрузка оператора + (сложение)
+    Ghost operator+(const Ghost& other) const {
+        return Ghost(
+            (x + other.x) / 2, // Среднее арифметическое x
+            (y + other.y) / 2, // Среднее арифметическое y
+            0, //сбрасываем score
+            direction,
+            lastDirection
+        );
+    }
+
+    // Перегрузка префиксного оператора ++
+    Ghost& operator++() {
+        x++;
+        prevX = x;
+        return *this;
+    }
+
+    // Перегрузка постфиксного оператора ++
+    Ghost operator++(int) {
+        Ghost temp = *this;
+        x++;
+        prevX = x;
+        return temp;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const Ghost& ghost) {
+        os << "Ghost: x=" << ghost.x << ", y=" << ghost.y << ", score=" << ghost.score << ", direction=" << ghost.direction << ", lastDirection=" << ghost.lastDirection;
+        return os;
+    }
+};
+
+// Одна партия целиком ("мир"): владеет картой, едой, фруктами, Пакманом,
+// призраками, генератором случайных чисел и рекордом. Общих статических
+// данных нет, поэтому несколько партий могут идти одновременно в разных потоках.
+// step() продвигает игру на один такт без какой-либо отрисовки.
+//
+// Призраков сколько угодно (GhostStore). За такт они обновляются
+// одновременно: цели считаются по положениям на начало такта, поля
+// расстояний готовятся заранее, а сами шаги независимы и при заданном
+// пуле потоков (setThreadPool) идут параллельно с одинаковым результатом.
+class Simulation {
+private:
+    Level level;
+    int pacmanStartX, pacmanStartY;
+    Map map;
+    MazeGraph graph;                // соседи клеток и коридоры, строится при загрузке уровня
+    Food smallFood;
+    Food bigFood;
+    Fruit fruitArray[5];
+    int fruitIndex;
+    Pacman pacman;
+    GhostStore ghosts;
+    DistanceFieldCache distances;   // общие для всех призраков поля расстояний
+    SpatialHash ghostHash;          // призраки по корзинам сетки, для столкновений
+    Random random;
+    int record;                     // лучший счёт за все партии этого мира
+    ThreadPool* pool;               // для параллельного обновления призраков, может быть nullptr
+    std::uint64_t levelHash;        // levelFingerprint(level), для проверки снимков
+    Bitboard levelPellets;          // точки уровня до начала партии
+    Bitboard levelSmallPellets;     // из них маленькие
+    Bitboard occupied;              // результат occupancy()
+    Bitboard reachable;             // результат reachablePellets()
+    Bitboard floodScratch;
+
+    // Рабочие массивы такта, по номеру призрака; память переиспользуется
+    std::vector<int> targetCells;
+    std::vector<int> neededTargets;
+    std::vector<std::uint8_t> frightEnded;
+    std::vector<int> hits;
+
+    void createGhosts();
+    void indexLevel();
+    void respawnGhosts();
+    void moveGhosts();
+    // Шаг призрака i: выбор политик его архетипа (GhostPolicies.h) и общее ядро движения
+    void moveGhost(int i, bool endgame);
+    template <class Behaviour>
+    void moveGhostAs(int i, bool endgame);
+    int collideGhosts();
+    // Согласуется ли снимок с уровнем этого мира: координаты внутри лабиринта,
+    // Пакман на проходимой клетке, точки только там, где они были, и их число
+    // совпадает со счётчиками
+    bool fitsLevel(const GameSnapshot& snapshot) const;
+    long long tickCount;
+    long long episode;              // номер партии, растёт при каждом reset()
+    std::vector<int> eatenCells;    // клетки съеденных за партию точек, по порядку
+public:
+    Simulation(const Level& level, int pacmanStartX, int pacmanStartY, std::uint64_t seed);
+    Simulation(const Level& level, std::uint64_t seed = 1);
+    // Встроенный классический лабиринт со своей стартовой клеткой Пакмана
+    Simulation(int pacmanStartX, int pacmanStartY, std::uint64_t seed = 1);
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Пул для обновления призраков; без пула всё идёт в вызывающем потоке
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+    // Дополнительный призрак; spawn и дом берутся из уровня по номеру призрака
+    GhostHandle addGhost(GhostArchetype type);
+
+    void reset();
+    // Новая партия на другом уровне; состояние такое же, как у только что созданного мира
+    void load(const Level& level, std::uint64_t seed);
+    // Новое зерно действует с текущего такта; вместе с reset() начинает воспроизводимую партию
+    void setSeed(std::uint64_t seed) { random.setSeed(seed); }
+    // Один такт игры; direction как у InputManager::getDirection().
+    // Возвращает результат Pacman::WonOrLost на начало такта.
+    int step(int direction);
+
+    const Map& getMap() const { return map; }
+    const MazeGraph& getGraph() const { return graph; }
+    // Клетки Пакмана и всех призраков
+    const Bitboard& occupancy();
+    // Точки (маленькие и большие), до которых Пакман может дойти из своей клетки
+    const Bitboard& reachablePellets();
+    const Pacman& getPacman() const { return pacman; }
+    const Food& getSmallFood() const { return smallFood; }
+    const Food& getBigFood() const { return bigFood; }
+    const Fruit& getFruit() const { return fruitArray[fruitIndex]; }
+    int getFruitIndex() const { return fruitIndex; }
+    // Точный счётчик по индексу точек карты
+    int getFoodLeft() const { return map.getPellets().size(); }
+    int getFoodTotal() const { return level.info().smallFood + level.info().bigFood; }
+    const Level& getLevel() const { return level; }
+    int getPacmanStartX() const { return pacmanStartX; }
+    int getPacmanStartY() const { return pacmanStartY; }
+    int getRecord() const { return record; }
+    long long getTickCount() const { return tickCount; }
+    long long getEpisode() const { return episode; }
+    // Хэш всего игрового состояния (без рекорда и номера партии): совпадает
+    // у двух миров тогда и только тогда, когда их партии идут одинаково
+    std::uint64_t checksum() const;
+    // Снимок всего изменяемого состояния; false, если мир не помещается в
+    // GameSnapshot (больше SNAPSHOT_GHOSTS призраков или слишком большой лабиринт)
+    bool clone(GameSnapshot& snapshot) const;
+    // Возвращает мир в состояние снимка; false, если снимок сделан на другом
+    // уровне или не проходит проверку (checkSnapshot, fitsLevel) - тогда мир
+    // не меняется. Карта меняется только в клетках, которыми она отличается от
+    // снимка. Журнал съеденных точек после восстановления идёт по порядку
+    // клеток, а не по порядку поедания
+    bool restore(const GameSnapshot& snapshot);
+    // Журнал съеденных точек текущей партии (номера клеток Map::cellId)
+    const std::vector<int>& getEatenCells() const { return eatenCells; }
+    const GhostStore& getGhosts() const { return ghosts; }
+    int getGhostCount() const { return ghosts.size(); }
+    Ghost getGhost(int i) const { return Ghost(ghosts, i); }
+};
@@ -0,0 +1,175 @@
+﻿#include "Snapshot.h"
+#include "LevelPack.h"
+#include "Simulation.h"
+#include <cstring>
+
+namespace {
+
+const char MAGIC[4] = { 'P', 'M', 'S', 'N' };
+// 2 - отпечаток уровня включает заголовок и считается по словам
+const std::uint8_t VERSION = 2;
+const std::size_t SERIALIZED_SIZE = 5 + sizeof(GameSnapshot);   // поля идут без промежутков
+
+// Запись и чтение целого из sizeof(T) байт, little-endian
+template <typename T>
+void put(std::vector<std::uint8_t>& out, T value) {
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        out.push_back((std::uint8_t)((std::uint64_t)value >> (i * 8)));
+}
+
+template <typename T>
+void get(const std::uint8_t*& p, T& value) {
+    std::uint64_t word = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+        word |= (std::uint64_t)p[i] << (i * 8);
+    value = (T)word;
+    p += sizeof(T);
+}
+
+// Один обход полей для записи и для чтения: порядок задаётся здесь один раз
+template <typename Visitor>
+void visit(GameSnapshot& s, Visitor&& field) {
+    field(s.level); field(s.random); field(s.tickCount); field(s.episode);
+    field(s.record);
+    field(s.pacmanScore); field(s.pacmanSpeed); field(s.pacmanPoints);
+    field(s.pacmanX); field(s.pacmanY); field(s.pacmanNextX); field(s.pacmanNextY);
+    field(s.pacmanPrevX); field(s.pacmanPrevY);
+    field(s.pacmanDirection); field(s.pacmanLives);
+    field(s.pacmanTile); field(s.fruitTile);
+    field(s.smallFood); field(s.bigFood);
+    field(s.fruitIndex); field(s.ghostCount);
+    field(s.reserved[0]); field(s.reserved[1]);
+    for (SnapshotFruit& fruit : s.fruits) {
+        field(fruit.x); field(fruit.y); field(fruit.points);
+        field(fruit.isActive); field(fruit.reserved);
+    }
+    for (SnapshotGhost& ghost : s.ghosts) {
+        field(ghost.random);
+        field(ghost.score); field(ghost.speed); field(ghost.frightenedTimer);
+        field(ghost.x); field(ghost.y); field(ghost.prevX); field(ghost.prevY);
+        field(ghost.direction); field(ghost.lastDirection);
+        field(ghost.state); field(ghost.archetype);
+    }
+    for (std::uint64_t& word : s.pellets)
+        field(word);
+}
+
+bool isDirection(int direction) { return direction >= 0 && direction < 4; }
+// Прогресс шага после такта меньше MOVE_STEP, прирост за такт не больше MOVE_STEP
+bool isStepProgress(std::int32_t score, std::int32_t speed) {
+    return score >= 0 && score < MOVE_STEP && speed >= 0 && speed <= MOVE_STEP;
+}
+
+}
+
+std::uint64_t levelFingerprint(const Level& level)
+{
+    // По 64-битным словам: поля заголовка, кроме имени, затем клетки по 8 байт
+    // little-endian. Умножение с перемешиванием старших битов в младшие, чтобы
+    // каждый байт слова влиял на весь хэш
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    auto add = [&hash](std::uint64_t word) {
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    };
+    auto pair = [](std::int32_t a, std::int32_t b) { return (std::uint64_t)(std::uint32_t)a | (std::uint64_t)(std::uint32_t)b << 32; };
+    const LevelHeader& info = level.info();
+    add(pair(info.width, info.height));
+    add(pair(info.pacman.x, info.pacman.y));
+    for (int i = 0; i < LEVEL_GHOSTS; ++i) {
+        add(pair(info.ghostSpawn[i].x, info.ghostSpawn[i].y));
+        add(pair(info.ghostHome[i].x, info.ghostHome[i].y));
+    }
+    add((std::uint64_t)(std::uint32_t)info.tunnelCount);
+    for (int i = 0; i < info.tunnelCount && i < LEVEL_MAX_TUNNELS; ++i) {
+        add(pair(info.tunnels[i].y, info.tunnels[i].leftX));
+        add(pair(info.tunnels[i].rightX, 0));
+    }
+    add(pair(info.smallFood, info.bigFood));
+    add(pair(info.fruitMin.x, info.fruitMin.y));
+    add(pair(info.fruitMax.x, info.fruitMax.y));
+
+    const std::uint8_t* tiles = reinterpret_cast<const std::uint8_t*>(level.tiles());
+    const std::size_t size = level.tileCount() * sizeof(LevelTile);
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word = 0;
+        for (int b = 0; b < 8; ++b)
+            word |= (std::uint64_t)tiles[i + b] << (b * 8);
+        add(word);
+    }
+    std::uint64_t tail = 0;
+    for (int b = 0; i < size; ++i, ++b)
+        tail |= (std::uint64_t)tiles[i] << (b * 8);
+    add(tail);
+    return hash;
+}
+
+void writeSnapshot(const GameSnapshot& snapshot, std::vector<std::uint8_t>& out)
+{
+    out.clear();
+    out.reserve(SERIALIZED_SIZE);
+    out.insert(out.end(), MAGIC, MAGIC + 4);
+    out.push_back(VERSION);
+    GameSnapshot copy = snapshot;
+    visit(copy, [&out](auto& value) { put(out, value); });
+}
+
+bool readSnapshot(const std::uint8_t* data, std::size_t size, GameSnapshot& snapshot, std::string& error)
+{
+    if (size < 5 || std::memcmp(data, MAGIC, 4)) {
+        error = "not a snapshot";
+        return false;
+    }
+    if (data[4] != VERSION) {
+        error = "unsupported snapshot version " + std::to_string(data[4]);
+        return false;
+    }
+    if (size != SERIALIZED_SIZE) {
+        error = "bad snapshot size";
+        return false;
+    }
+    const std::uint8_t* p = data + 5;
+    visit(snapshot, [&p](auto& value) { get(p, value); });
+    return checkSnapshot(snapshot, error);
+}
+
+bool checkSnapshot(const GameSnapshot& s, std::string& error)
+{
+    auto fail = [&error](const char* what) {
+        error = std::string("bad snapshot ") + what;
+        return false;
+    };
+    if (s.ghostCount < 0 || s.ghostCount > SNAPSHOT_GHOSTS)
+        return fail("ghost count");
+    if (s.fruitIndex < 0 || s.fruitIndex >= SNAPSHOT_FRUITS)
+        return fail("fruit index");
+    if (s.tickCount < 0 || s.episode < 0 || s.record < 0)
+        return fail("counters");
+    if (!isDirection(s.pacmanDirection) || s.pacmanLives < 0 || s.pacmanPoints < 0
+        || !isStepProgress(s.pacmanScore, s.pacmanSpeed))
+        return fail("pacman");
+    if (s.pacmanTile > 1 || s.fruitTile > 1 || s.reserved[0] || s.reserved[1])
+        return fail("flags");
+    if (s.smallFood < 0 || s.bigFood < 0)
+        return fail("food count");
+    for (const SnapshotFruit& fruit : s.fruits)
+        if (fruit.isActive > 1 || fruit.reserved || fruit.points < 0)
+            return fail("fruit");
+    if (s.fruitTile && !s.fruits[s.fruitIndex].isActive)
+        return fail("fruit tile");
+    const SnapshotGhost empty = SnapshotGhost();
+    for (int i = 0; i < SNAPSHOT_GHOSTS; ++i) {
+        const SnapshotGhost& ghost = s.ghosts[i];
+        if (i >= s.ghostCount) {
+            if (std::memcmp(&ghost, &empty, sizeof ghost))
+                return fail("unused ghost slot");
+            continue;
+        }
+        if (!isDirection(ghost.direction) || !isDirection(ghost.lastDirection)
+            || ghost.state > Ghost::EATEN || ghost.archetype >= ARCHETYPE_COUNT || ghost.frightenedTimer < 0
+            || !isStepProgress(ghost.score, ghost.speed))
+            return fail("ghost");
+    }
+    return true;
+}
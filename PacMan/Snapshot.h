@@ -0,0 +1,80 @@
+﻿#pragma once
+// Снимок партии: всё изменяемое состояние Simulation в одной POD-структуре
+// фиксированного размера. Копия снимка - один memcpy, поэтому поиск вперёд,
+// откат и контрольные точки могут разветвлять мир миллионы раз в секунду:
+// Simulation::clone() заполняет снимок, restore() возвращает мир в это
+// состояние на том же уровне.
+//
+// Карта хранится только оставшимися точками (битовая карта по Map::cellId),
+// стены и остальное берутся из уровня. Помещается до SNAPSHOT_GHOSTS
+// призраков и лабиринт до SNAPSHOT_WORDS * 64 клеток вместе с рамкой.
+//
+// Формат файла (writeSnapshot): "PMSN", версия (1 байт), затем все поля
+// структуры по порядку объявления, little-endian, без выравнивания.
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+class Level;
+
+const int SNAPSHOT_GHOSTS = 8;
+const int SNAPSHOT_WORDS = 20;      // 1280 клеток; классический лабиринт с рамкой - 1184
+const int SNAPSHOT_FRUITS = 5;
+
+struct SnapshotGhost {
+    std::uint64_t random;
+    std::int32_t score, speed, frightenedTimer;
+    std::int16_t x, y, prevX, prevY;
+    std::int8_t direction, lastDirection;
+    std::uint8_t state, archetype;
+};
+
+struct SnapshotFruit {
+    std::int16_t x, y, points;
+    std::uint8_t isActive;
+    std::uint8_t reserved;
+};
+
+struct GameSnapshot {
+    std::uint64_t level;            // levelFingerprint() уровня, на котором сделан снимок
+    std::uint64_t random;
+    std::int64_t tickCount, episode;
+    std::int32_t record;
+    std::int32_t pacmanScore, pacmanSpeed, pacmanPoints;
+    std::int16_t pacmanX, pacmanY, pacmanNextX, pacmanNextY, pacmanPrevX, pacmanPrevY;
+    std::int8_t pacmanDirection, pacmanLives;
+    std::uint8_t pacmanTile, fruitTile;     // стоят ли на карте 'P' под Пакманом и 'F' под фруктом
+    std::int16_t smallFood, bigFood;
+    std::int8_t fruitIndex, ghostCount;
+    std::uint8_t reserved[2];
+    SnapshotFruit fruits[SNAPSHOT_FRUITS];
+    SnapshotGhost ghosts[SNAPSHOT_GHOSTS];
+    std::uint64_t pellets[SNAPSHOT_WORDS];
+};
+
+static_assert(std::is_trivially_copyable<GameSnapshot>::value, "GameSnapshot must stay memcpy-able");
+static_assert(std::is_standard_layout<GameSnapshot>::value, "GameSnapshot must keep a fixed layout");
+static_assert(sizeof(SnapshotGhost) == 32, "SnapshotGhost layout changed");
+static_assert(sizeof(SnapshotFruit) == 8, "SnapshotFruit layout changed");
+static_assert(offsetof(GameSnapshot, fruits) == 72, "GameSnapshot layout changed");
+static_assert(offsetof(GameSnapshot, ghosts) == 112, "GameSnapshot layout changed");
+static_assert(offsetof(GameSnapshot, pellets) == 368, "GameSnapshot layout changed");
+static_assert(sizeof(GameSnapshot) == 528, "GameSnapshot layout changed");
+
+// Отпечаток уровня: заголовок без имени (размеры, точки появления, туннели,
+// число точек, область фруктов) и все клетки. Снимок восстанавливается только
+// на том же уровне, Simulation::load по нему узнаёт уже загруженный уровень
+std::uint64_t levelFingerprint(const Level& level);
+
+// Сериализация, не зависящая от компилятора и порядка байтов
+void writeSnapshot(const GameSnapshot& snapshot, std::vector<std::uint8_t>& out);
+// false и текст ошибки в error, если данные не снимок, другой версии или не
+// проходят checkSnapshot
+bool readSnapshot(const std::uint8_t* data, std::size_t size, GameSnapshot& snapshot, std::string& error);
+// Проверка полей, не зависящих от уровня: число призраков и номер фрукта в
+// пределах массивов, направления, состояния, флаги и прогресс шага из
+// допустимых значений, неиспользуемые байты нулевые. Координаты и точки
+// сверяет с уровнем Simulation::restore
+bool checkSnapshot(const GameSnapshot& snapshot, std::string& error);
@@ -7,17 +7,39 @@
 #include <random>
 #include <chrono>
 #include <sstream>
+#include <memory>
+#include <map>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <mutex>
+#ifdef _WIN32
 #include <WIndows.h>
+#endif
 #include <iostream>
+#include "Simulation.h"
+#include "GhostPolicies.h"
+#include "Autopilot.h"
+#include "ThreadPool.h"
+#include "TickScheduler.h"
+#include "PresentScheduler.h"
+#include "Profiler.h"
+#include "Replay.h"
+#include "AssetPack.h"
+#include "AllocationCounter.h"
+
+#ifdef PACMAN_EMBEDDED_ASSETS
+// Пакет ресурсов, запечённый при сборке (PacManAssetBake --cpp)
+extern const unsigned char PACMAN_ASSETS[];
+extern const std::size_t PACMAN_ASSETS_SIZE;
+#endif
 
 using namespace sf;
 using namespace std;
 
-class Food;
-class Map;
-class Fruit;
-class Ghost;
-
 class GameSettings {
 private:
     std::string windowTitle;
@@ -93,30 +115,131 @@ public:
 };
 
 
-template <typename ResourceType, typename ResourceKey = std::string>
+// Хронология запуска: отметки в миллисекундах от старта процесса (точнее, от
+// инициализации статических объектов, до main). Отметки ставятся из любого
+// потока, отчёт печатается после первого показанного кадра.
+class StartupTimeline {
+private:
+    struct Mark {
+        double ms;
+        std::string name;
+    };
+    std::chrono::steady_clock::time_point start;
+    std::vector<Mark> marks;
+    std::mutex mutex;
+public:
+    StartupTimeline() : start(std::chrono::steady_clock::now()) {}
+    double now() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+    void mark(const std::string& name) {
+        double ms = now();
+        std::lock_guard<std::mutex> lock(mutex);
+        marks.push_back({ ms, name });
+    }
+    void report(std::ostream& os) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::stable_sort(marks.begin(), marks.end(), [](const Mark& a, const Mark& b) { return a.ms < b.ms; });
+        os << "Startup timeline (ms since launch):\n";
+        for (const Mark& m : marks)
+            os << std::setw(9) << std::fixed << std::setprecision(1) << m.ms << "  " << m.name << "\n";
+        os.unsetf(std::ios::floatfield);
+        os << std::flush;
+    }
+};
+
+static StartupTimeline startupTimeline;
+
+
+// Асинхронная загрузка ресурсов. request() отдаёт чтение и разбор файла
+// (decoder) пулу потоков и сразу возвращается; несколько картинок
+// разбираются параллельно. Ресурс берётся из вкомпилированного пакета
+// (setSources), если он там есть, иначе с диска; файл из каталога
+// переопределений, если каталог задан, важнее пакета. get() ждёт, только если разбор ещё не закончен,
+// и в вызывающем потоке доделывает ресурс из разобранных данных
+// (createResource) - так текстуры попадают в видеопамять из потока окна.
+// Decoded - промежуточные данные, которые готовятся в фоне. Задача пула
+// держит только свою запись, поэтому менеджер можно разрушить, не дожидаясь её.
+template <typename ResourceType, typename Decoded, typename ResourceKey = std::string>
 class ResourceManager {
 public:
     using ResourcePtr = std::shared_ptr<ResourceType>;
+    // Вызываются из потока пула: файл или ресурс пакета -> промежуточные данные
+    using Decoder = bool (*)(Decoded& data, const std::string& filePath);
+    using AssetDecoder = bool (*)(Decoded& data, const AssetPack& pack, const AssetEntry& asset);
+
+    ResourceManager(ThreadPool& loader, Decoder decoder, AssetDecoder assetDecoder)
+        : loader_(loader), decoder_(decoder), assetDecoder_(assetDecoder), assets_(nullptr) {}
+    virtual ~ResourceManager() = default;
+
+    // Откуда брать ресурсы, запрошенные после вызова; пакет должен жить дольше менеджера
+    void setSources(const AssetPack* assets, const std::string& overrideDir) {
+        assets_ = assets;
+        overrideDir_ = overrideDir;
+    }
 
-    ResourcePtr load(const ResourceKey& key, const std::string& filePath) {
-        auto it = resources_.find(key);
-        if (it != resources_.end()) {
-            return it->second;
-        }
-
-        auto resource = std::make_shared<ResourceType>();
-        if (!loadResource(resource, filePath))
-            return nullptr; // Не удалось загрузить ресурс
-        resources_[key] = resource;
-        return resource;
+    // Ставит загрузку в очередь; повторный запрос того же ключа ничего не делает.
+    // data - начальное значение промежуточных данных (например, параметры разбора)
+    void request(const ResourceKey& key, const std::string& filePath, Decoded data = Decoded()) {
+        if (resources_.count(key))
+            return;
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->filePath = filePath;
+        entry->data = std::move(data);
+        Decoder decoder = decoder_;
+        AssetDecoder assetDecoder = assetDecoder_;
+        const AssetPack* assets = assets_;
+        std::string overridePath = overrideDir_.empty() ? std::string() : overrideDir_ + "/" + filePath;
+        auto task = std::make_shared<std::packaged_task<bool()>>([decoder, assetDecoder, assets, overridePath, entry] {
+            auto begin = std::chrono::steady_clock::now();
+            const AssetEntry* asset = assets ? assets->find(entry->filePath) : nullptr;
+            const char* source;
+            bool ok;
+            if (!overridePath.empty() && std::ifstream(overridePath)) {
+                source = "override";
+                ok = decoder(entry->data, overridePath);
+            }
+            else if (asset) {
+                source = "embedded";
+                ok = assetDecoder(entry->data, *assets, *asset);
+            }
+            else {
+                source = "disk";
+                ok = decoder(entry->data, entry->filePath);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            std::ostringstream name;
+            name << "decoded " << entry->filePath << " from " << source << " (" << std::fixed << std::setprecision(1) << ms << " ms" << (ok ? "" : ", failed") << ")";
+            startupTimeline.mark(name.str());
+            return ok;
+        });
+        entry->decoded = task->get_future();
+        resources_[key] = entry;
+        loader_.submit([task] { (*task)(); });
     }
 
-    ResourcePtr get(const ResourceKey& key) const {
+    // Готовый ресурс; ждёт фоновую загрузку, если она не закончилась.
+    // nullptr - ресурс не запрошен или не загрузился
+    ResourcePtr get(const ResourceKey& key) {
         auto it = resources_.find(key);
-        if (it != resources_.end()) {
-            return it->second;
+        if (it == resources_.end())
+            return nullptr;
+        Entry& entry = *it->second;
+        if (entry.decoded.valid()) {
+            bool ok = entry.decoded.get();
+            if (ok) {
+                auto resource = std::make_shared<ResourceType>();
+                if (createResource(*resource, entry.data))
+                    entry.resource = resource;
+            }
+            if (!entry.resource)
+                std::cerr << "Error loading " << entry.filePath << std::endl;
         }
-        return nullptr; // Ресурс не найден
+        return entry.resource;
+    }
+
+    // Синхронная загрузка: запрос и ожидание
+    ResourcePtr load(const ResourceKey& key, const std::string& filePath) {
+        request(key, filePath);
+        return get(key);
     }
 
     void unload(const ResourceKey& key) {
@@ -128,44 +251,200 @@ public:
     }
 
 protected:
-    virtual bool loadResource(std::shared_ptr<ResourceType>& resource, const std::string& filePath) = 0;
+    // Из потока, вызвавшего get(): промежуточные данные -> ресурс
+    virtual bool createResource(ResourceType& resource, Decoded& data) = 0;
 
 private:
-    std::map<ResourceKey, ResourcePtr> resources_;
+    struct Entry {
+        std::string filePath;
+        Decoded data;
+        std::future<bool> decoded;  // действителен, пока get() не забрал результат
+        ResourcePtr resource;
+    };
+    ThreadPool& loader_;
+    Decoder decoder_;
+    AssetDecoder assetDecoder_;
+    const AssetPack* assets_;
+    std::string overrideDir_;
+    std::map<ResourceKey, std::shared_ptr<Entry>> resources_;
 };
 
 
-class TextureManager : public ResourceManager<sf::Texture> {
-protected:
-    bool loadResource(std::shared_ptr<sf::Texture>& resource, const std::string& filePath) override {
-        return resource->loadFromFile(filePath);
-    }
+// Картинка для атласа; scale - во сколько раз она уменьшается до экранного размера
+struct AtlasImage {
+    sf::Image image;
+    float scale = 1.0f;
 };
 
+using TextureHandle = int;
+
+// Все картинки лежат в одной текстуре-атласе, уже уменьшенные до размера, в
+// котором рисуются: уменьшение идёт в фоне вместе с разбором файла. Строковый
+// ключ нужен только при запросе, дальше картинка - целый номер, а её место
+// в атласе берётся из массива по номеру. В углу атласа белый квадрат для
+// одноцветных фигур, поэтому фрукты, Пакман и призраки рисуются одним
+// вызовом draw с одной текстурой (SpriteBatch).
+class TextureManager : public ResourceManager<sf::IntRect, AtlasImage> {
+private:
+    static const unsigned ATLAS_SIZE = 256;
+    static const unsigned PADDING = 1;      // пустая полоса между картинками, чтобы соседи не просвечивали
+    sf::Texture atlas;
+    bool atlasCreated;
+    unsigned cursorX, cursorY, shelfHeight; // раскладка полками: слева направо, затем следующая полка
+    std::map<std::string, TextureHandle> handles;
+    std::vector<std::string> keys;          // по номеру картинки
+    std::vector<sf::IntRect> rects;         // по номеру; пустой прямоугольник - картинки нет
+    std::vector<bool> placed;
+
+    void createAtlas() {
+        atlas.create(ATLAS_SIZE, ATLAS_SIZE);
+        sf::Image white;
+        white.create(2, 2, sf::Color::White);
+        atlas.update(white, 0, 0);
+        atlasCreated = true;
+    }
+public:
+    explicit TextureManager(ThreadPool& loader)
+        : ResourceManager(loader, &decodeImage, &decodeAsset), atlasCreated(false), cursorX(2 + PADDING), cursorY(0), shelfHeight(2) {}
+
+    // Ставит картинку в очередь загрузки и возвращает её номер
+    TextureHandle request(const std::string& key, const std::string& filePath, float scale) {
+        auto it = handles.find(key);
+        if (it != handles.end())
+            return it->second;
+        AtlasImage data;
+        data.scale = scale;
+        ResourceManager::request(key, filePath, data);
+        TextureHandle handle = (TextureHandle)keys.size();
+        handles[key] = handle;
+        keys.push_back(key);
+        rects.push_back(sf::IntRect());
+        placed.push_back(false);
+        return handle;
+    }
+
+    // Место картинки в атласе. При первом обращении ждёт её разбор и
+    // копирует в атлас, дальше это просто элемент массива
+    const sf::IntRect& rect(TextureHandle handle) {
+        if (!placed[handle]) {
+            placed[handle] = true;
+            if (auto region = get(keys[handle]))
+                rects[handle] = *region;
+        }
+        return rects[handle];
+    }
+
+    // Белый квадрат для одноцветных фигур; цвет задаётся вершинами
+    sf::IntRect whiteRect() {
+        if (!atlasCreated)
+            createAtlas();
+        return sf::IntRect(0, 0, 2, 2);
+    }
+    const sf::Texture& getAtlas() const { return atlas; }
 
-class FontManager : public ResourceManager<sf::Font> {
 protected:
-    bool loadResource(std::shared_ptr<sf::Font>& resource, const std::string& filePath) override {
-        return resource->loadFromFile(filePath);
+    static bool scaleImage(const sf::Image& source, float scale, sf::Image& image) {
+        const std::uint32_t w = scaledSide(source.getSize().x, scale), h = scaledSide(source.getSize().y, scale);
+        if (w >= source.getSize().x && h >= source.getSize().y) {
+            image = source;
+            return true;
+        }
+        std::vector<std::uint8_t> pixels;
+        downscaleRgba(source.getPixelsPtr(), source.getSize().x, source.getSize().y, w, h, pixels);
+        image.create(w, h, pixels.data());
+        return true;
+    }
+    // Картинка с диска уменьшается до размера на экране здесь же, в фоне
+    static bool decodeImage(AtlasImage& data, const std::string& filePath) {
+        sf::Image source;
+        return source.loadFromFile(filePath) && scaleImage(source, data.scale, data.image);
+    }
+    // В пакете картинка обычно уже уменьшена при запекании
+    static bool decodeAsset(AtlasImage& data, const AssetPack& pack, const AssetEntry& asset) {
+        if (asset.kind == ASSET_RGBA) {
+            data.image.create(asset.width, asset.height, pack.data(asset));
+            return true;
+        }
+        sf::Image source;
+        return source.loadFromMemory(pack.data(asset), asset.size) && scaleImage(source, data.scale, data.image);
+    }
+
+    // Из потока окна: картинка копируется на свободное место атласа
+    bool createResource(sf::IntRect& region, AtlasImage& data) override {
+        if (!atlasCreated)
+            createAtlas();
+        const unsigned w = data.image.getSize().x, h = data.image.getSize().y;
+        if (cursorX + w > ATLAS_SIZE) {
+            cursorX = 0;
+            cursorY += shelfHeight + PADDING;
+            shelfHeight = 0;
+        }
+        if (w > ATLAS_SIZE || cursorY + h > ATLAS_SIZE) {
+            std::cerr << "Texture atlas is full" << std::endl;
+            return false;
+        }
+        atlas.update(data.image, cursorX, cursorY);
+        region = sf::IntRect((int)cursorX, (int)cursorY, (int)w, (int)h);
+        cursorX += w + PADDING;
+        shelfHeight = std::max(shelfHeight, h);
+        data.image = sf::Image();
+        return true;
     }
 };
 
-class Tile {
+// Прямоугольники из атласа, собранные за кадр в один массив вершин:
+// все спрайты рисуются одним вызовом draw
+class SpriteBatch {
+private:
+    sf::VertexArray vertices;
 public:
-    char type;
-    bool isPassable;
-    Tile(char type = ' ', bool isPassable = true) : type(type), isPassable(isPassable) {}
-
-    friend std::ostream& operator<<(std::ostream& os, const Tile& tile) {
-        os << "Type: " << tile.type << ", Passable: " << (tile.isPassable ? "true" : "false");
-        return os;
+    SpriteBatch() : vertices(sf::Triangles) {}
+    void clear() { vertices.clear(); }
+    void add(const sf::IntRect& source, float x, float y, float width, float height, sf::Color color = sf::Color::White) {
+        const float u0 = (float)source.left, v0 = (float)source.top;
+        const float u1 = u0 + source.width, v1 = v0 + source.height;
+        vertices.append(Vertex(Vector2f(x, y), color, Vector2f(u0, v0)));
+        vertices.append(Vertex(Vector2f(x + width, y), color, Vector2f(u1, v0)));
+        vertices.append(Vertex(Vector2f(x + width, y + height), color, Vector2f(u1, v1)));
+        vertices.append(Vertex(Vector2f(x, y), color, Vector2f(u0, v0)));
+        vertices.append(Vertex(Vector2f(x + width, y + height), color, Vector2f(u1, v1)));
+        vertices.append(Vertex(Vector2f(x, y + height), color, Vector2f(u0, v1)));
+    }
+    void draw(RenderWindow& window, const sf::Texture& atlas) {
+        window.draw(vertices, sf::RenderStates(&atlas));
+    }
+    // FNV-1a по вершинам: совпадает у двух кадров - спрайты на экране те же
+    std::uint64_t fingerprint() const {
+        std::uint64_t hash = 14695981039346656037ULL;
+        if (vertices.getVertexCount() == 0)
+            return hash;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[0]);
+        const std::size_t size = vertices.getVertexCount() * sizeof(Vertex);
+        for (std::size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        return hash;
     }
 };
 
-class InputManager {
+// Файл шрифта читается в фоне целиком. sf::Font::loadFromMemory не копирует
+// данные, поэтому они остаются в записи менеджера, пока жив шрифт
+class FontManager : public ResourceManager<sf::Font, std::vector<char>> {
 public:
-    virtual ~InputManager() = default;
-    virtual int getDirection() = 0;  // 0: вверх, 1: вниз, 2: влево, 3: вправо, -1: нет ввода
+    explicit FontManager(ThreadPool& loader) : ResourceManager(loader, &readFile, &copyAsset) {}
+protected:
+    static bool readFile(std::vector<char>& bytes, const std::string& filePath) {
+        std::ifstream in(filePath, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return !bytes.empty();
+    }
+    static bool copyAsset(std::vector<char>& bytes, const AssetPack& pack, const AssetEntry& asset) {
+        const char* data = reinterpret_cast<const char*>(pack.data(asset));
+        bytes.assign(data, data + asset.size);
+        return asset.kind == ASSET_FILE && !bytes.empty();
+    }
+    bool createResource(sf::Font& font, std::vector<char>& bytes) override {
+        return font.loadFromMemory(bytes.data(), bytes.size());
+    }
 };
 
 class KeyboardInput : public InputManager {
@@ -190,1067 +469,274 @@ public:
     }
 };
 
-class Pacman {
+// Отрисовка отделена от симуляции: функции только читают состояние Simulation.
+
+// Лабиринт рисуется из двух заранее собранных буферов вершин: стены
+// собираются один раз, точки - одним буфером, из которого съеденные
+// убираются по журналу Simulation::getEatenCells(). Вместо ~1000 вызовов
+// draw на кадр остаётся два.
+class MaseRenderer {
 private:
-    int x, y, nextX, nextY, score, nextDirection, lives, points;
-    static int maxPoints;
-public:
-    ~Pacman() {};
-    Pacman(int x, int y, int nextX, int nextY, int score, int nextDirection, int lives, int points) : x(x), y(y), nextX(nextX), nextY(nextY), score(score), nextDirection(nextDirection), lives(lives), points(points) {};
-    int getX() const { return x; }
-    int getY() const { return y; }
-    int getPoints() const { return points; }
-    int getLives() const { return lives; }
-    int getNextDirection() const { return nextDirection; }
-    void setX(int a) { x = a; }
-    void setY(int a) { y = a; }
-    void setNextX(int a) { nextX = a; }
-    void setNextY(int a) { nextY = a; }
-    void setScore(int a) { score = a; }
-    void setLives(int a) { lives = a; }
-    void setPoints(int a) { points = a; }
-    void setNextDirection(int a) { nextDirection = a; }
-    void loseLife() { lives--; }
-    void addPoints(int points) { this->points += points; }
-    static int getMaxPoints();
-    static void updateMaxPoints(int newPoints);
-    int* getPointsPointer() {
-        return &points;
-    }
-    int& getLivesReference() {
-        return lives;
+    static const int CIRCLE_SEGMENTS = 12;
+    static const int PELLET_VERTICES = CIRCLE_SEGMENTS * 3;
+    sf::VertexArray walls;
+    sf::VertexArray pellets;
+    std::vector<int> pelletVertex;  // первая вершина точки по номеру клетки, -1 - точки нет
+    std::size_t eatenSeen;          // сколько записей журнала уже применено
+    long long episode;
+    unsigned revision;              // растёт при каждом изменении буферов
+
+    static void addQuad(sf::VertexArray& vertices, float x, float y, float size, sf::Color color) {
+        vertices.append(Vertex(Vector2f(x, y), color));
+        vertices.append(Vertex(Vector2f(x + size, y), color));
+        vertices.append(Vertex(Vector2f(x + size, y + size), color));
+        vertices.append(Vertex(Vector2f(x, y), color));
+        vertices.append(Vertex(Vector2f(x + size, y + size), color));
+        vertices.append(Vertex(Vector2f(x, y + size), color));
     }
 
-    void PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit,Ghost** ghost, InputManager& inputManager);
-
-    int WonOrLost(Food smallFood, Food bigFood, Text& Result);
-    friend std::ostream& operator<<(std::ostream& os, const Pacman& pacman) {
-        os << "Pacman: x=" << pacman.x << ", y=" << pacman.y << ", score=" << pacman.score << ", lives=" << pacman.lives << ", points=" << pacman.points;
-        return os;
+    // Круг как веер треугольников; (x, y) - левый верхний угол, как у CircleShape
+    static void addCircle(sf::VertexArray& vertices, float x, float y, float radius, sf::Color color) {
+        const float pi = 3.14159265f;
+        float cx = x + radius, cy = y + radius;
+        for (int k = 0; k < CIRCLE_SEGMENTS; ++k) {
+            float a0 = 2 * pi * k / CIRCLE_SEGMENTS, a1 = 2 * pi * (k + 1) / CIRCLE_SEGMENTS;
+            vertices.append(Vertex(Vector2f(cx, cy), color));
+            vertices.append(Vertex(Vector2f(cx + radius * std::cos(a0), cy + radius * std::sin(a0)), color));
+            vertices.append(Vertex(Vector2f(cx + radius * std::cos(a1), cy + radius * std::sin(a1)), color));
+        }
     }
 
-    void setGhostsFrightened(Ghost** ghosts, int duration);
-};
-
-
-int Pacman::maxPoints = 0; // Инициализация статической переменной
-int Pacman::getMaxPoints() {
-    return maxPoints;
-}
-void Pacman::updateMaxPoints(int newScore) {
-    if (newScore > maxPoints)
-        maxPoints = newScore;
-}
-
-class Food {
-private:
-    int count;
-    int point;
-    char type;
-    static int totalFoodCount;
-public:
-    ~Food() {};
-    Food(int count, int point, char type) : count(count), point(point), type(type) { totalFoodCount += count; }
-    int getCount() { return count; }
-    int getPoint() { return point; }
-    char getType() { return type; }
-    void decreaseCount() { count--; totalFoodCount--; }
-    static int getTotalFoodCount();
-    static void setTotalFoodCount(int count);
-    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, Ghost** ghost, InputManager& inputManager);
-    friend int Pacman::WonOrLost(Food smallFood, Food bigFood, Text& Result);
-    friend std::ostream& operator<<(std::ostream& os, const Food& food) {
-        os << "Food: count=" << food.count << ", point=" << food.point << ", type=" << food.type;
-        return os;
+    void removePellet(int cell) {
+        if (cell < 0 || cell >= (int)pelletVertex.size() || pelletVertex[cell] < 0)
+            return;
+        // вырождаем треугольники точки в невидимые, буфер не перестраивается
+        for (int k = 0; k < PELLET_VERTICES; ++k)
+            pellets[pelletVertex[cell] + k].color = sf::Color::Transparent;
+        pelletVertex[cell] = -1;
+        revision++;
     }
-};
-int Food::totalFoodCount = 0;
-int Food::getTotalFoodCount() { return Food::totalFoodCount; }
-void Food::setTotalFoodCount(int count) { Food::totalFoodCount = count; }
 
-class Map {
-private:
-    int H, W;
-    std::vector<std::vector<Tile>> Mase;
 public:
-    ~Map() {};
-    Map(int H, int W) : H(H), W(W) { Mase.resize(H, std::vector<Tile>(W)); }
-    int getH() const { return H; }
-    int getW() const { return W; }
-    Tile getTile(int y, int x) const { return Mase[y][x]; }
-    void setTile(int y, int x, Tile tile) { Mase[y][x] = tile; }
-    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, Ghost** ghost, InputManager& inputManager);
-    void createMap() {
-        std::string tempMase[] = {
-            "                              ",
-            "                              ",
-            "                              ",
-            " XXXXXXXXXXXXXXXXXXXXXXXXXXXX ",
-            " XooooooooooooXXooooooooooooX ",
-            " XoXXXXoXXXXXoXXoXXXXXoXXXXoX ",
-            " XOXXXXoXXXXXoXXoXXXXXoXXXXOX ",
-            " XoXXXXoXXXXXoXXoXXXXXoXXXXoX ",
-            " XooooooooooooooooooooooooooX ",
-            " XoXXXXoXXoXXXXXXXXoXXoXXXXoX ",
-            " XoXXXXoXXoXXXXXXXXoXXoXXXXoX ",
-            " XooooooXXooooXXooooXXooooooX ",
-            " XXXXXXoXXXXX XX XXXXXoXXXXXX ",
-            " nnnnnXoXXXXX XX XXXXXoXnnnnn ",
-            " nnnnnXoXX          XXoXnnnnn ",
-            " nnnnnXoXX XXXXXXXX XXoXnnnnn ",
-            " XXXXXXoXX XnnnnnnX XXoXXXXXX ",
-            "       o   XnnnnnnX   o       ",
-            " XXXXXXoXX XnnnnnnX XXoXXXXXX ",
-            " nnnnnXoXX XXXXXXXX XXoXnnnnn ",
-            " nnnnnXoXX          XXoXnnnnn ",
-            " nnnnnXoXX XXXXXXXX XXoXnnnnn ",
-            " XXXXXXoXX XXXXXXXX XXoXXXXXX ",
-            " XooooooooooooXXooooooooooooX ",
-            " XoXXXXoXXXXXoXXoXXXXXoXXXXoX ",
-            " XoXXXXoXXXXXoXXoXXXXXoXXXXoX ",
-            " XOooXXooooooooooooooooXXooOX ",
-            " XXXoXXoXXoXXXXXXXXoXXoXXoXXX ",
-            " XXXoXXoXXoXXXXXXXXoXXoXXoXXX ",
-            " XooooooXXooooXXooooXXooooooX ",
-            " XoXXXXXXXXXXoXXoXXXXXXXXXXoX ",
-            " XoXXXXXXXXXXoXXoXXXXXXXXXXoX ",
-            " XooooooooooooooooooooooooooX ",
-            " XXXXXXXXXXXXXXXXXXXXXXXXXXXX ",
-            "                              ",
-        };
-        for (int i = 0; i < H; ++i) {
-            for (int j = 0; j < W; ++j) {
-                Mase[i][j] = Tile(tempMase[i][j], tempMase[i][j] != 'X');
-            }
-        }
-    }
-
-    void MasePaint(GameSettings& settings, RenderWindow& window, Food& smallFood, Food& bigFood, Sprite fruitShape) {
-        RectangleShape square(Vector2f(settings.getGridSize(), settings.getGridSize()));
-        square.setFillColor(settings.getSquareColor());
-        CircleShape smallCircle(3);
-        smallCircle.setFillColor(settings.getCircleColor());
-        CircleShape biglCircle(6);
-        biglCircle.setFillColor(settings.getCircle2Color());
-        RectangleShape pacman(Vector2f(settings.getGridSize(), settings.getGridSize()));
-        pacman.setFillColor(settings.getPacmanColor());
-
-        for (int i = 0; i < H; i++) {
-            for (int j = 0; j < W; j++) {
-                if (Mase[i][j].type == 'X')
-                {
-                    square.setPosition(j * settings.getGridSize(), i * settings.getGridSize());
-                    window.draw(square);
+    MaseRenderer() : walls(sf::Triangles), pellets(sf::Triangles), eatenSeen(0), episode(-1), revision(0) {}
+
+    unsigned getRevision() const { return revision; }
+
+    void build(const Simulation& simulation, GameSettings& settings) {
+        const Map& map = simulation.getMap();
+        const float grid = (float)settings.getGridSize();
+        walls.clear();
+        pellets.clear();
+        pelletVertex.assign(map.cellCount(), -1);
+        for (int i = 0; i < map.getH(); i++) {
+            for (int j = 0; j < map.getW(); j++) {
+                char type = map.getTile(i, j).type;
+                if (type == 'X')
+                    addQuad(walls, j * grid, i * grid, grid, settings.getSquareColor());
+                else if (type == simulation.getSmallFood().getType()) {
+                    pelletVertex[map.cellId(i, j)] = (int)pellets.getVertexCount();
+                    addCircle(pellets, j * grid + 8.5f, i * grid + 8.5f, 3, settings.getCircleColor());
                 }
-                else if (Mase[i][j].type == smallFood.getType())
-                {
-                    smallCircle.setPosition(j * settings.getGridSize() + 8.5, i * settings.getGridSize() + 8.5f);
-                    window.draw(smallCircle);
-                }
-                else if (Mase[i][j].type == bigFood.getType())
-                {
-                    biglCircle.setPosition(j * settings.getGridSize() + 5.5f, i * settings.getGridSize() + 5.5f);
-                    window.draw(biglCircle);
-                }
-                else if (Mase[i][j].type == 'P')
-                {
-                    pacman.setPosition(j * settings.getGridSize(), i * settings.getGridSize());
-                    window.draw(pacman);
-                }
-                else if (Mase[i][j].type == 'F')
-                {
-                    window.draw(fruitShape);
+                else if (type == simulation.getBigFood().getType()) {
+                    pelletVertex[map.cellId(i, j)] = (int)pellets.getVertexCount();
+                    addCircle(pellets, j * grid + 5.5f, i * grid + 5.5f, 6, settings.getCircle2Color());
                 }
             }
         }
+        eatenSeen = 0;
+        episode = simulation.getEpisode();
+        revision++;
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const Map& map) {
-        os << "Map: H=" << map.H << ", W=" << map.W << "\n";
-        for (const auto& row : map.Mase) {
-            for (const auto& tile : row) {
-                os << tile.type;
-            }
-            os << "\n";
+    // Применяет новые записи журнала съеденных точек; после reset() или
+    // отката к снимку (журнал стал короче) собирает точки заново
+    void update(const Simulation& simulation, GameSettings& settings) {
+        if (episode != simulation.getEpisode() || simulation.getEatenCells().size() < eatenSeen) {
+            build(simulation, settings);
+            return;
         }
-        return os;
+        const std::vector<int>& eaten = simulation.getEatenCells();
+        for (; eatenSeen < eaten.size(); ++eatenSeen)
+            removePellet(eaten[eatenSeen]);
     }
-};
 
-
-class Fruit {
-private:
-    int x;
-    int y;
-    int points;
-    Sprite sprite;
-    static bool isActive;
-public:
-    Fruit() {};
-    Fruit(int points, Sprite sprite) : points(points), sprite(sprite) {}
-    int getX() const { return x; }
-    int getY() const { return y; }
-    int getPoints() const { return points; }
-    Sprite getSprite() const { return sprite; }
-    void setIsActive(bool active) { Fruit::isActive = active; }
-    bool getIsActive() { return Fruit::isActive; }
-    friend void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, Ghost** ghost, InputManager& inputManager);
-
-    void createFruit(GameSettings& settings, Map& map, RenderWindow& window, Food food) {
-        if ((food.getTotalFoodCount() == 176 || food.getTotalFoodCount() == 76) && !isActive)
-        {
-            int randY, randX;
-            do {
-                randY = rand() % 30 + 4;
-                randX = rand() % 23 + 4;
-            } while (map.getTile(randY, randX).type != ' ');
-            x = randX;
-            y = randY;
-            sprite.setPosition(randX * settings.getGridSize(), randY * settings.getGridSize());
-            isActive = true;
-        }
-        if (isActive)
-        {
-            map.setTile(y, x, 'F');
-        }
-    }
-    friend std::ostream& operator<<(std::ostream& os, const Fruit& fruit) {
-        os << "Fruit: x=" << fruit.x << ", y=" << fruit.y << ", points=" << fruit.points << ", isActive=" << fruit.isActive;
-        return os;
+    void paint(RenderWindow& window) {
+        window.draw(walls);
+        window.draw(pellets);
     }
 };
 
-bool Fruit::isActive = false;
-
-void Pacman::PacmanMove(Map& map, Food& smallFood, Food& bigFood, Fruit& fruit, Ghost** ghost, InputManager& inputManager)
-{
-    int direction = inputManager.getDirection();
-    if (direction == 0 && map.Mase[nextY - 1][nextX].isPassable && !(nextY == 17 && nextX == 0 || nextY == 17 && nextX == map.getW() - 1)) {
-        nextDirection = 0;
-        nextX = x;
-        nextY = y;
-    }
-    if (direction == 1 && map.Mase[nextY + 1][nextX].isPassable && !(nextY == 17 && nextX == 0 || nextY == 17 && nextX == map.getW() - 1)) {
-        nextDirection = 1;
-        nextX = x;
-        nextY = y;
-    }
-    if (direction == 2 && (map.Mase[nextY][nextX - 1].isPassable)) {
-        nextDirection = 2;
-        nextX = x;
-        nextY = y;
-    }
-    if (direction == 3 && (map.Mase[nextY][nextX + 1].isPassable)) {
-        nextDirection = 3;
-        nextX = x;
-        nextY = y;
+// HUD в удержанном режиме: все поля "подпись + число" - один буфер вершин,
+// который рисуется одним вызовом draw с текстурой глифов шрифта. Глифы
+// растеризуются заранее, поле переписывает свои вершины только при смене
+// значения, поэтому в обычном кадре нет ни строк, ни выделений памяти.
+class Hud {
+private:
+    struct Field {
+        float x, y;
+        std::size_t digitsVertex;   // первая вершина под цифры
+        int maxDigits;
+        long long value;
+        bool valid;
+    };
+    const sf::Font& font;
+    unsigned characterSize;
+    sf::Color color;
+    sf::VertexArray vertices;
+    std::vector<Field> fields;
+    unsigned revision;              // растёт при каждом изменении вершин
+
+    // Пишет квад глифа c в вершины начиная с index; возвращает сдвиг пера
+    float putGlyph(std::size_t index, char c, float penX, float y) {
+        const sf::Glyph& glyph = font.getGlyph((sf::Uint32)c, characterSize, false);
+        float left = penX + glyph.bounds.left, top = y + characterSize + glyph.bounds.top;
+        float right = left + glyph.bounds.width, bottom = top + glyph.bounds.height;
+        float u0 = (float)glyph.textureRect.left, v0 = (float)glyph.textureRect.top;
+        float u1 = u0 + glyph.textureRect.width, v1 = v0 + glyph.textureRect.height;
+        vertices[index + 0] = Vertex(Vector2f(left, top), color, Vector2f(u0, v0));
+        vertices[index + 1] = Vertex(Vector2f(right, top), color, Vector2f(u1, v0));
+        vertices[index + 2] = Vertex(Vector2f(right, bottom), color, Vector2f(u1, v1));
+        vertices[index + 3] = Vertex(Vector2f(left, top), color, Vector2f(u0, v0));
+        vertices[index + 4] = Vertex(Vector2f(right, bottom), color, Vector2f(u1, v1));
+        vertices[index + 5] = Vertex(Vector2f(left, bottom), color, Vector2f(u0, v1));
+        return glyph.advance;
     }
 
-    score++;
-    if (score >= 150)
-    {
-        switch (nextDirection)
-        {
-        case 0:
-            if (map.Mase[nextY - 1][nextX].isPassable && nextY - 1 >= 0)
-                nextY--;
-            break;
-        case 1:
-            if (map.Mase[nextY + 1][nextX].isPassable && nextY + 1 <= 35)
-                nextY++;
-            break;
-        case 2:
-            if (nextY == 17 && nextX == 1)
-                nextX = map.W - 2;
-            else if (map.Mase[nextY][nextX - 1].isPassable && nextX - 1 >= 0)
-                nextX--;
-            break;
-        case 3:
-            if (nextY == 17 && nextX == map.getW() - 2)
-                nextX = 1;
-            else if (map.Mase[nextY][nextX + 1].isPassable && nextX + 1 <= 35)
-                nextX++;
-            break;
-        }
-        score = 0;
+    void clearGlyph(std::size_t index) {
+        for (int k = 0; k < 6; ++k)
+            vertices[index + k] = Vertex(Vector2f(0, 0), sf::Color::Transparent);
     }
 
-    if (map.Mase[nextY][nextX].isPassable && nextY != 0 && nextX != 0)
-    {
-        if (map.Mase[nextY][nextX].type == smallFood.getType())
-        {
-            addPoints(smallFood.point);
-            smallFood.decreaseCount();
-        }
-        if (map.Mase[nextY][nextX].type == bigFood.getType())
-        {
-            addPoints(bigFood.point);
-            bigFood.decreaseCount();
-            setGhostsFrightened(ghost, 3000);
-        }
-        if (fruit.isActive && nextX == fruit.x && nextY == fruit.y)
-        {
-            addPoints(fruit.points);
-            fruit.isActive = false;;
+    void rebuild(Field& field) {
+        char digits[24];
+        int n = 0;
+        unsigned long long v = field.value < 0 ? 0ULL - (unsigned long long)field.value : (unsigned long long)field.value;
+        do {
+            digits[n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v && n < 20);
+        if (field.value < 0)
+            digits[n++] = '-';
+        revision++;
+        float penX = field.x;
+        for (int k = 0; k < field.maxDigits; ++k) {
+            std::size_t index = field.digitsVertex + k * 6;
+            if (k < n)
+                penX += putGlyph(index, digits[n - 1 - k], penX, field.y);
+            else
+                clearGlyph(index);
         }
-        map.setTile(y, x, ' ');
-        map.setTile(nextY, nextX, 'P');
-        x = nextX;
-        y = nextY;
     }
-}
-
-
-int Pacman::WonOrLost(Food smallFood, Food bigFood, Text& Result)
-{
-    int f = 1;
-    if (smallFood.totalFoodCount == 0)
-        Result.setString("You won! ");
-    else if (!getLives())
-        Result.setString("You lost! ");
-    else f = 0;
-    return f;
-}
-
 
-class Ghost {
 public:
-    enum GhostState {
-        NORMAL,
-        FRIGHTENED,
-        EATEN
-    };
-protected:                       //модификатор protected                         
-    GhostState currentState;
-    int frightenedTimer;  // таймер для режима испуга                                      
-    int x, y, score, direction, lastDirection;
-public:
-    Ghost() {};
-    ~Ghost() {};
-    Ghost(int x, int y, int score, int direction, int lastDirection) : x(x), y(y), score(score), direction(direction), lastDirection(lastDirection), currentState(NORMAL), frightenedTimer(0) {};
-    int getX() const { return x; }
-    int getY() const { return y; }
-    int getScore() const { return score; }
-    int getDirection() const { return direction; }
-    int getLastDirection() const { return lastDirection; }
-    GhostState getCurrentState() { return currentState; }
-    void setGhostState(GhostState state, int duration) {
-        currentState = state;
-        frightenedTimer = duration;
+    Hud(const sf::Font& font, unsigned characterSize, sf::Color color) : font(font), characterSize(characterSize), color(color), vertices(sf::Triangles), revision(0) {
+        // растеризуем цифры заранее, чтобы текстура шрифта не менялась во время игры
+        for (char c = '0'; c <= '9'; ++c)
+            font.getGlyph((sf::Uint32)c, characterSize, false);
+        font.getGlyph((sf::Uint32)'-', characterSize, false);
     }
-    void setAll(int a, int b, int c, int d, int e) { x = a, y = b, score = c, d = direction, e = lastDirection; }
 
-    /*Ghost& operator=(const Ghost& other) {
-        if (this == &other) { // Проверка на самоприсваивание
-            return *this;
-        }
-        x = other.x;
-        y = other.y;
-        score = other.score;
-        direction = other.direction;
-        lastDirection = other.lastDirection;
-        return *this;
-    }*/
-
-    // Перегрузка оператора + (сложение)
-    Ghost operator+(const Ghost& other) const {
-        return Ghost(
-            (x + other.x) / 2, // Среднее арифметическое x
-            (y + other.y) / 2, // Среднее арифметическое y
-            0, //сбрасываем score
-            direction,
-            lastDirection
-        );
+    // Добавляет поле; подпись раскладывается один раз, под число резервируется maxDigits знаков
+    int addField(const std::string& label, float x, float y, int maxDigits) {
+        std::size_t first = vertices.getVertexCount();
+        vertices.resize(first + (label.size() + maxDigits) * 6);
+        float penX = x;
+        for (std::size_t k = 0; k < label.size(); ++k)
+            penX += putGlyph(first + k * 6, label[k], penX, y);
+        Field field = { penX, y, first + label.size() * 6, maxDigits, 0, false };
+        fields.push_back(field);
+        revision++;
+        return (int)fields.size() - 1;
     }
 
-    // Перегрузка префиксного оператора ++
-    Ghost& operator++() {
-        x++;
-        return *this;
-    }
-
-    // Перегрузка постфиксного оператора ++
-    Ghost operator++(int) {
-        Ghost temp = *this;
-        x++;
-        return temp;
-    }
+    unsigned getRevision() const { return revision; }
 
-    float distance(int x1, int y1, int x2, int y2) {
-        return (sqrt(pow(x1 - x2, 2) + pow(y1 - y2, 2)));
+    void set(int index, long long value) {
+        Field& field = fields[index];
+        if (field.valid && field.value == value)
+            return;
+        field.value = value;
+        field.valid = true;
+        rebuild(field);
     }
 
-    void ghostDraw(sf::Color color, RenderWindow& window, GameSettings settings)
-    {
-        RectangleShape ghostShape(Vector2f(settings.getGridSize(), settings.getGridSize()));
-        if (currentState == FRIGHTENED)
-        {
-            ghostShape.setFillColor(sf::Color::White); //Синий цвет для испуганного состояния
-        }
-        else
-            ghostShape.setFillColor(color);
-        ghostShape.setPosition(getX() * settings.getGridSize(), getY() * settings.getGridSize());
-        window.draw(ghostShape);
-    }
-
-   /* void drawGhostFromBase(RenderWindow& window, GameSettings settings)
-    {
-        ghostDraw(window, settings);
-    }*/
-
-    void move(Map map, int goalX, int goalY, Ghost** ghost) {
-        float distanceUp, distanceDown, distanceLeft, distanceRight;
-        double minDistance = INFINITY;
-        int change = 0;
-        int f = 0;
-
-        if (currentState == FRIGHTENED) {
-            //случайное движение
-            frightenedTimer--;
-            if (frightenedTimer <= 0) {
-                currentState = NORMAL;
-                ghost[0]->setAll(11, 14, 0, 3, 3);
-                ghost[1]->setAll(13, 14, 0, 3, 3);
-                ghost[2]->setAll(15, 14, 0, 3, 3);
-                ghost[3]->setAll(17, 14, 0, 3, 3);
-            }
-            score++;
-            if (score >= 400)
-            {
-                change = 1;
-                int newDirection;
-                do {
-                    newDirection = rand() % 4;
-                    f = 0; // Начинаем с предположения, что направление допустимо
-
-                    if (newDirection == 0) { // Вверх
-                        if (map.getTile(y - 1, x).isPassable && lastDirection != 1 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                            f = 1; // Установим f в 1, если направление подходит
-                        }
-                    }
-                    else if (newDirection == 1) { // Вниз
-                        if (map.getTile(y + 1, x).isPassable && lastDirection != 0 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                            f = 1; // Установим f в 1, если направление подходит
-                        }
-                    }
-                    else if (newDirection == 2) { // Влево
-                        if (map.getTile(y, x - 1).isPassable && lastDirection != 3) {
-                            f = 1; // Установим f в 1, если направление подходит
-                        }
-                    }
-                    else if (newDirection == 3) { // Вправо
-                        if (map.getTile(y, x + 1).isPassable && lastDirection != 2) {
-                            f = 1; // Установим f в 1, если направление подходит
-                        }
-                    }
-
-                    // Если f равно нулю, то цикл должен повторится
-                } while (f == 0);
-                direction = newDirection;
-              
-             
-                switch (direction) {
-                case 0: //Движение вверх
-                    y--;
-                    break;
-                case 1: //Движение вниз
-                    y++;
-                    break;
-                case 2: //Движение влево
-                    if (y == 17 && x == 1)
-                        x = map.getW() - 2;
-                    else
-                        x--;
-                    break;
-                case 3: //Движение вправо
-                    if (y == 17 && x == map.getW() - 2)
-                        x = 1;
-                    else
-                        x++;
-                    break;
-                default:
-                    break;
-                }
-                score = 0;
-            }
-
-            if (lastDirection != direction && change)
-                lastDirection = direction;
-        }
-        else
-        {
-            distanceUp = distance(goalX, goalY, x, y - 1);
-            distanceDown = distance(goalX, goalY, x, y + 1);
-            if (y == 17 && x == 1)
-                distanceLeft = distance(goalX, goalY, map.getW() - 1, y);
-            else distanceLeft = distance(goalX, goalY, x - 1, y);
-            if (y == 17 && x == map.getW() - 1)
-                distanceRight = distance(goalX, goalY, 0, y);
-            else distanceRight = distance(goalX, goalY, x + 1, y);
-
-            if (distanceRight <= minDistance && map.getTile(y, x + 1).isPassable && lastDirection != 2) {
-                minDistance = distanceRight;
-                direction = 3;
-            }
-            if (distanceUp <= minDistance && map.getTile(y - 1, x).isPassable && lastDirection != 1 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                minDistance = distanceUp;
-                direction = 0;
-            }
-            if (distanceLeft <= minDistance && map.getTile(y, x - 1).isPassable && lastDirection != 3) {
-                minDistance = distanceLeft;
-                direction = 2;
-            }
-            if (distanceDown <= minDistance && map.getTile(y + 1, x).isPassable && lastDirection != 0 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                minDistance = distanceDown;
-                direction = 1;
-            }
-
-            score++;
-            if (score >= 150)
-            {
-                change = 1;
-                // Двигаемся в выбранном направлении
-                switch (direction) {
-                case 0: //Движение вверх
-                    y--;
-                    break;
-                case 1: //Движение вниз
-                    y++;
-                    break;
-                case 2: //Движение влево
-                    if (y == 17 && x == 1)
-                        x = map.getW() - 2;
-                    else
-                        x--;
-                    break;
-                case 3: //Движение вправо
-                    if (y == 17 && x == map.getW() - 2)
-                        x = 1;
-                    else
-                        x++;
-                    break;
-                default:
-                    break;
-                }
-                score = 0;
-            }
-
-            if (lastDirection != direction && change)
-                lastDirection = direction;
-        }
-    }
-
-    friend std::ostream& operator<<(std::ostream& os, const Ghost& ghost) {
-        os << "Ghost: x=" << ghost.x << ", y=" << ghost.y << ", score=" << ghost.score << ", direction=" << ghost.direction << ", lastDirection=" << ghost.lastDirection;
-        return os;
+    void draw(RenderWindow& window) {
+        sf::RenderStates states;
+        states.texture = &font.getTexture(characterSize);
+        window.draw(vertices, states);
     }
 };
 
-
-void Pacman::setGhostsFrightened(Ghost** ghosts, int duration) {
-    for (int i = 0; i < 4; ++i)
-    {
-        ghosts[i]->setGhostState(Ghost::FRIGHTENED, duration);
-    }
+// Экранная позиция между предыдущей и текущей клеткой; fraction - доля пройденного пути
+Vector2f interpolate(int prevX, int prevY, int x, int y, float fraction, int gridSize)
+{
+    if (std::abs(x - prevX) + std::abs(y - prevY) != 1) // стоит на месте, телепорт или туннель
+        fraction = 1.0f;
+    return Vector2f((prevX + (x - prevX) * fraction) * gridSize, (prevY + (y - prevY) * fraction) * gridSize);
 }
 
+// Пакман и призраки - одноцветные квадраты из белого участка атласа (white)
+void pacmanDraw(const Pacman& pacman, SpriteBatch& batch, const sf::IntRect& white, GameSettings& settings, float alpha)
+{
+    const float size = (float)settings.getGridSize();
+    Vector2f position = interpolate(pacman.getPrevX(), pacman.getPrevY(), pacman.getX(), pacman.getY(), pacman.getStepFraction(alpha), settings.getGridSize());
+    batch.add(white, position.x, position.y, size, size, settings.getPacmanColor());
+}
 
-class Blinky : public Ghost {
-public:
-    ~Blinky() {};
-    Blinky() {};
-    Blinky(int x, int y, int score, int direction, int lastDirection) : Ghost(x, y, score, direction, lastDirection) {};  //вызов конструктора базового класса
-    void ghostDraw(sf::Color color, RenderWindow& window, GameSettings settings)                         // Перегрузка метода без вызова метода базового класса
-    {
-        RectangleShape ghostShape(Vector2f(settings.getGridSize() / 1.5, settings.getGridSize() / 1.5));
-        ghostShape.setFillColor(color);
-        ghostShape.setPosition(getX() * settings.getGridSize() + settings.getGridSize() / 6, getY() * settings.getGridSize() + settings.getGridSize() / 6); //другое положение и размер
-        window.draw(ghostShape);
-    }
-    void BlinkyMove(Pacman pacman, Map map, GameSettings settings, RenderWindow& window, Ghost** ghost) {
-        move(map, pacman.getX(), pacman.getY(), ghost);
-        Ghost::ghostDraw(settings.getBlinkyColor(), window, settings);
-    }
-};
-
-class Pinky : public Ghost {
-public:
-    ~Pinky() {};
-    Pinky() {};
-    Pinky(int x, int y, int score, int direction, int lastDirection) : Ghost(x, y, score, direction, lastDirection) {};    //вызов конструктора базового класса
-    void PinkyMove(Pacman pacman, Map map, GameSettings settings, RenderWindow& window, Food food, Ghost** ghost) {
-        int a = pacman.getX(), b = pacman.getY();
-        switch (pacman.getNextDirection())
-        {
-        case 0:
-            b = b - 4;
-            break;
-        case 1:
-            b = b + 4;
-            break;
-        case 2:
-            a = a - 4;
-            break;
-        case 3:
-            a = a + 4;
-            break;
-        }
-        if (food.getTotalFoodCount() < 20) //если в лабиринте осталось меньше 20 точек
-        {
-            float distanceUp, distanceDown, distanceLeft, distanceRight;
-            double minDistance = INFINITY;
-            int change = 0;
-
-            distanceUp = distance(a, b, x, y - 1);
-            distanceDown = distance(a, b, x, y + 1);
-            if (y == 17 && x == 1)
-                distanceLeft = distance(a, b, map.getW() - 1, y);
-            else distanceLeft = distance(a, b, x - 1, y);
-            if (y == 17 && x == map.getW() - 1)
-                distanceRight = distance(a, b, 0, y);
-            else distanceRight = distance(a, b, x + 1, y);
-
-            if (distanceRight <= minDistance && map.getTile(y, x + 1).isPassable && lastDirection != 2) {
-                minDistance = distanceRight;
-                direction = 3;
-            }
-            if (distanceUp <= minDistance && map.getTile(y - 1, x).isPassable && lastDirection != 1 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                minDistance = distanceUp;
-                direction = 0;
-            }
-            if (distanceLeft <= minDistance && map.getTile(y, x - 1).isPassable && lastDirection != 3) {
-                minDistance = distanceLeft;
-                direction = 2;
-            }
-            if (distanceDown <= minDistance && map.getTile(y + 1, x).isPassable && lastDirection != 0 && !(y == 17 && x == 0 || y == 17 && x == map.getW() - 1)) {
-                minDistance = distanceDown;
-                direction = 1;
-            }
-
-            score++;
-            if (score >= 100)                        //то  призрак ускоряется
-            {
-                change = 1;
-                // Двигаемся в выбранном направлении
-                switch (direction) {
-                case 0: //Движение вверх
-                    y--;
-                    break;
-                case 1: //Движение вниз
-                    y++;
-                    break;
-                case 2: //Движение влево
-                    if (y == 17 && x == 1)
-                        x = map.getW() - 2;
-                    else
-                        x--;
-                    break;
-                case 3: //Движение вправо
-                    if (y == 17 && x == map.getW() - 2)
-                        x = 1;
-                    else
-                        x++;
-                    break;
-                default:
-                    break;
-                }
-                score = 0;
-            }
-            if (lastDirection != direction && change)
-                lastDirection = direction;
-        }
-        else Ghost::move(map, a, b, ghost); // Вызов метода базового класса
-        ghostDraw(settings.getPinkyColor(), window, settings);
-    }
-};
-
-class Inky : public Ghost {
-private:
-    int inkySpecific;
-public:
-    ~Inky() {};
-    Inky() {};
-    Inky(int x, int y, int score, int direction, int lastDirection) : Ghost(x, y, score, direction, lastDirection) {};   //вызов конструктора базового класса
-
-    Inky& operator=(const Ghost& baseGhost) {
-        if (this != &baseGhost) {
-            this->x = baseGhost.getX();
-            this->y = baseGhost.getY();
-            this->score = baseGhost.getScore();
-            this->direction = baseGhost.getDirection();
-            this->lastDirection = baseGhost.getLastDirection();
-        }
-        return *this;
-    }
-
-    void InkyMove(Pacman pacman, Map map, Ghost blinky, GameSettings settings, RenderWindow& window, Ghost** ghost) {
-        int a = pacman.getX(), b = pacman.getY();
-        switch (pacman.getNextDirection())
-        {
-        case 0:
-            b = b - 2;
-            break;
-        case 1:
-            b = b + 2;
-            break;
-        case 2:
-            a = a - 2;
-            break;
-        case 3:
-            a = a + 2;
-            break;
-        }
-        a = blinky.getX() + 2 * (a - blinky.getX());
-        b = blinky.getY() + 2 * (b - blinky.getY());
-        move(map, a, b, ghost);
-        ghostDraw(settings.getInkyColor(), window, settings);
-    }
-};
-
-class Clyde : public Ghost {
-public:
-    ~Clyde() {};
-    Clyde() {};
-    Clyde(int x, int y, int score, int direction, int lastDirection) : Ghost(x, y, score, direction, lastDirection) {};   //вызов конструктора базового класса
-
-   /* void ghostDraw(RenderWindow& window, GameSettings settings) override                          //делаем функцию виртуальной, добавляем override для избежания ошибок переопределения
-    {
-        CircleShape ghostShape(11);
-        ghostShape.setFillColor(settings.getClydeColor());
-        ghostShape.setPosition(getX() * settings.getGridSize() , getY() * settings.getGridSize() );
-        window.draw(ghostShape);
-    }*/
-
-    void ClydeMove(Pacman pacman, Map map, GameSettings settings, RenderWindow& window, Ghost** ghost) {
-        int a, b;
-        float mainDistance = distance(pacman.getX(), pacman.getY(), x, y);
-        if (mainDistance > 8)
-        {
-            a = pacman.getX();
-            b = pacman.getY();
-        }
-        else
-        {
-            a = 0;
-            b = map.getH();
-        }
-        move(map, a, b, ghost);
-        ghostDraw(settings.getClydeColor(), window, settings);
-    }
-
-    int Lose(Pacman& pacman, Blinky& blinky, Pinky& pinky, Inky& inky)
-    {
-        int result = 0;
-        if (pacman.getX() == blinky.getX() && pacman.getY() == blinky.getY()) {
-            if (blinky.getCurrentState() == Ghost::FRIGHTENED)
-            {
-                blinky.setAll(13, 16, 0, 3, 3);
-                pacman.addPoints(300);
-            }
-            else
-            {
-                pacman.loseLife();
-                result = 1;
-            }
-        }
-        else if (pacman.getX() == pinky.getX() && pacman.getY() == pinky.getY()) {
-            if (pinky.getCurrentState() == Ghost::FRIGHTENED)
-            {
-                pinky.setAll(16, 16, 0, 3, 3);
-                pacman.addPoints(300);
-            }
-            else
-            {
-                pacman.loseLife();
-                result = 1;
-            }
-        }
-        else if (pacman.getX() == inky.getX() && pacman.getY() == inky.getY()) {
-            if (inky.getCurrentState() == Ghost::FRIGHTENED)
-            {
-                inky.setAll(13, 18, 0, 3, 3);
-                pacman.addPoints(300);
-            }
-            else
-            {
-                pacman.loseLife();
-                result = 1;
-            }
-        }
-        else if (pacman.getX() == getX() && pacman.getY() == getY()) {
-            if (currentState == Ghost::FRIGHTENED)
-            {
-                setAll(16, 18, 0, 3, 3);
-                pacman.addPoints(300);
-            }
-            else
-            {
-                pacman.loseLife();
-                result = 1;
-            }
-        }
-        switch (pacman.getNextDirection()) {
-        case 0:
-            if (pacman.getX() == blinky.getX() && pacman.getY() - 1 == blinky.getY()) {
-                if (blinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    blinky.setAll(13, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == pinky.getX() && pacman.getY() - 1 == pinky.getY()) {
-                if (pinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    pinky.setAll(16, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == inky.getX() && pacman.getY() - 1 == inky.getY()) {
-                if (inky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    inky.setAll(13, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == getX() && pacman.getY() - 1 == getY()) {
-                if (getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    setAll(16, 18, 0, 3, 3); 
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            break;
-        case 1:
-            if (pacman.getX() == blinky.getX() && pacman.getY() + 1 == blinky.getY()) {
-                if (blinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    blinky.setAll(13, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == pinky.getX() && pacman.getY() + 1 == pinky.getY()) {
-                if (pinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    pinky.setAll(16, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == inky.getX() && pacman.getY() + 1 == inky.getY()) {
-                if (inky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    inky.setAll(13, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() == getX() && pacman.getY() + 1 == getY()) {
-                if (getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    setAll(16, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            break;
-        case 2:
-            if (pacman.getX() - 1 == blinky.getX() && pacman.getY() == blinky.getY()) {
-                if (blinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    blinky.setAll(13, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() - 1 == pinky.getX() && pacman.getY() == pinky.getY()) {
-                if (pinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                   pinky.setAll(16, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() - 1 == inky.getX() && pacman.getY() == inky.getY()) {
-                if (inky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    inky.setAll(13, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() - 1 == getX() && pacman.getY() == getY()) {
-                if (getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    setAll(16, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            break;
-        case 3:
-            if (pacman.getX() + 1 == blinky.getX() && pacman.getY() == blinky.getY()) {
-                if (blinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    blinky.setAll(13, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }1;
-            }
-            else if (pacman.getX() + 1 == pinky.getX() && pacman.getY() == pinky.getY()) {
-                if (pinky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    pinky.setAll(16, 16, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            else if (pacman.getX() + 1 == inky.getX() && pacman.getY() == inky.getY()) {
-                if (inky.getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    inky.setAll(13, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }1;
-            }
-            else if (pacman.getX() + 1 == getX() && pacman.getY() == getY()) {
-                if (getCurrentState() == Ghost::FRIGHTENED)
-                {
-                    setAll(16, 18, 0, 3, 3);
-                    pacman.addPoints(300);
-                }
-                else
-                {
-                    pacman.loseLife();
-                    result = 1;
-                }
-            }
-            break;
-        }
-        return result;
-    }
-};
+void ghostDraw(const Ghost& ghost, sf::Color color, SpriteBatch& batch, const sf::IntRect& white, GameSettings& settings, float alpha)
+{
+    const float size = (float)settings.getGridSize();
+    if (ghost.getCurrentState() == Ghost::FRIGHTENED)
+        color = sf::Color::White; //Синий цвет для испуганного состояния
+    Vector2f position = interpolate(ghost.getPrevX(), ghost.getPrevY(), ghost.getX(), ghost.getY(), ghost.getStepFraction(alpha), settings.getGridSize());
+    batch.add(white, position.x, position.y, size, size, color);
+}
 
-class Game {
-public:
-    Game() {};
-    ~Game() {};
-    void resetGame(Map& map, Food& smallFood, Food& bigFood, Pacman& pacman, Ghost** ghostArray, GameSettings& settings, Text& Result, Fruit& fruit) {
-        // сброс карты
-
-        map.createMap();
-
-        // сброс еды
-        smallFood.setTotalFoodCount(-1);
-        smallFood = Food(242, 5, 'o');
-        bigFood = Food(4, 10, 'O');
-
-        // сброс фрукта
-        fruit.setIsActive(false);
-
-        // сброс Pacman
-        pacman.setX(settings.getPacmanStartX());
-        pacman.setY(settings.getPacmanStartY());
-        pacman.setNextX(settings.getPacmanStartX());
-        pacman.setNextY(settings.getPacmanStartY());
-        pacman.setNextDirection(3);
-        int* pointsPtr = pacman.getPointsPointer();
-        *pointsPtr = 0;                                              // Изменяем значение points через указатель
-        int& livesRef = pacman.getLivesReference();
-        livesRef = 3;                                              // Изменяем значение lives через ссылку
-        pacman.setScore(0);
-
-        // сброс призраков
-        Blinky& blinky = *static_cast<Blinky*>(ghostArray[0]);
-        Pinky& pinky = *static_cast<Pinky*>(ghostArray[1]);
-        Inky& inky = *static_cast<Inky*>(ghostArray[2]);
-        Clyde& clyde = *static_cast<Clyde*>(ghostArray[3]);
-        blinky.setAll(11, 14, 0, 3, 3);
-        pinky.setAll(13, 14, 0, 3, 3);
-        inky.setAll(15, 14, 0, 3, 3);
-        clyde.setAll(17, 14, 0, 3, 3);
-        map.setTile(pacman.getY(), pacman.getX(), ' ');
-        map.setTile(settings.getPacmanStartY(), settings.getPacmanStartX(), 'P');
-        Result.setString(" ");
-        std::cout << "Настройки: \n" << settings << std::endl;
-        std::cout << "Карта: \n" << map << std::endl;
-        std::cout << "Пакман: " << pacman << std::endl << std::endl; // std::endl в конце каждого блока
-    }
-};
+// Blinky (вид ShrinkOnGameOver) на экране окончания игры рисуется уменьшенным квадратом
+void blinkyDraw(const Ghost& blinky, sf::Color color, SpriteBatch& batch, const sf::IntRect& white, GameSettings& settings)
+{
+    const float size = settings.getGridSize() / 1.5f;
+    batch.add(white, blinky.getX() * settings.getGridSize() + settings.getGridSize() / 6, blinky.getY() * settings.getGridSize() + settings.getGridSize() / 6, size, size, color); //другое положение и размер
+}
 
 int main()
 {
+#ifdef _WIN32
     AllocConsole();
 
     FILE* fDummy;
     freopen_s(&fDummy, "CONOUT$", "w", stdout);
     freopen_s(&fDummy, "CONOUT$", "w", stderr);
     freopen_s(&fDummy, "CONIN$", "r", stdin);
-    Game game;
+#endif
+    startupTimeline.mark("main");
+    // Шрифт и картинки читаются и разбираются в фоне, пока создаются мир и окно
+    ThreadPool loaderPool;
+    TextureManager textureManager(loaderPool);
+    FontManager fontManager(loaderPool);
+    // Ресурсы берутся из пакета внутри программы, без обращений к диску;
+    // файлы из каталога PACMAN_ASSET_DIR, если он задан, перекрывают пакет
+    AssetPack embeddedAssets;
+#ifdef PACMAN_EMBEDDED_ASSETS
+    std::string assetError;
+    if (!embeddedAssets.view(PACMAN_ASSETS, PACMAN_ASSETS_SIZE, assetError))
+        std::cerr << "Embedded assets: " << assetError << std::endl;
+#endif
+    const char* assetDir = std::getenv("PACMAN_ASSET_DIR");
+    textureManager.setSources(&embeddedAssets, assetDir ? assetDir : "");
+    fontManager.setSources(&embeddedAssets, assetDir ? assetDir : "");
+    fontManager.request("default_font", "Unformital Medium.ttf");
+
+    // Картинки фруктов, индекс совпадает с Simulation::getFruitIndex(). Картинки
+    // разного размера уменьшаются до клетки; в атлас фрукт попадает при первом появлении
+    const TextureHandle fruitTextures[5] = {
+        textureManager.request("cherry", "images/cherry.png", 0.1f),
+        textureManager.request("apple", "images/apple.png", 0.02f),
+        textureManager.request("pear", "images/pear.png", 0.1f),
+        textureManager.request("orange", "images/orange.png", 0.1f),
+        textureManager.request("watermelon", "images/watermelon.png", 0.03f),
+    };
+
     ArrowInput inputManager;
     //динамический массив объектов класса GameSettings 
     GameSettings* settingsArray;
@@ -1262,104 +748,40 @@ int main()
     );
     srand(time(NULL));
     GameSettings settings = settingsArray[rand() % 1];
-    Pacman pacman(settings.getPacmanStartX(), settings.getPacmanStartY(), settings.getPacmanStartX(), settings.getPacmanStartY(), 0, 3, 3, 0);
-    Ghost** ghostArray = new Ghost * [4];
-    Map map(35, 30);
-    map.createMap();
-    Food smallFood(242, 5, 'o');
-    Food bigFood(4, 10, 'O');
-
-    TextureManager textureManager;
-    // Загружаем текстуры с помощью TextureManager
-    auto cherryTexturePtr = textureManager.load("cherry", "images/cherry.png");
-    auto appleTexturePtr = textureManager.load("apple", "images/apple.png");
-    auto pearTexturePtr = textureManager.load("pear", "images/pear.png");
-    auto orangeTexturePtr = textureManager.load("orange", "images/orange.png");
-    auto watermelonTexturePtr = textureManager.load("watermelon", "images/watermelon.png");
-    sf::Sprite cherryShape;
-    if (cherryTexturePtr)
-    {
-        cherryShape.setTexture(*cherryTexturePtr);
-        cherryShape.setScale(0.1f, 0.1f);
-    }
-    else
-    {
-        std::cerr << "Error loading cherry texture" << std::endl;
-    }
-
-    sf::Sprite appleShape;
-    if (appleTexturePtr)
-    {
-        appleShape.setTexture(*appleTexturePtr);
-        appleShape.setScale(0.02f, 0.02f);
-    }
-    else
-    {
-        std::cerr << "Error loading apple texture" << std::endl;
-    }
-
-    sf::Sprite pearShape;
-    if (pearTexturePtr)
-    {
-        pearShape.setTexture(*pearTexturePtr);
-        pearShape.setScale(0.1f, 0.1f);
-    }
-    else
-    {
-        std::cerr << "Error loading pear texture" << std::endl;
-    }
-
-    sf::Sprite orangeShape;
-    if (orangeTexturePtr)
-    {
-        orangeShape.setTexture(*orangeTexturePtr);
-        orangeShape.setScale(0.1f, 0.1f);
-    }
-    else
-    {
-        std::cerr << "Error loading orange texture" << std::endl;
-    }
-
-    sf::Sprite watermelonShape;
-    if (watermelonTexturePtr)
-    {
-        watermelonShape.setTexture(*watermelonTexturePtr);
-        watermelonShape.setScale(0.03f, 0.03f);
-    }
-    else
-    {
-        std::cerr << "Error loading watermelon texture" << std::endl;
-    }
-
-    //массив фруктов
-    Fruit fruitArray[5];
-    fruitArray[0] = Fruit(20, cherryShape);
-    fruitArray[1] = Fruit(30, appleShape);
-    fruitArray[2] = Fruit(40, pearShape);
-    fruitArray[3] = Fruit(50, orangeShape);
-    fruitArray[4] = Fruit(60, watermelonShape);
-    int randFruit = 0;
-
-    //массив динамических объектов класса Ghost
-    ghostArray[0] = new Blinky(11, 14, 0, 3, 3);
-    ghostArray[1] = new Pinky(13, 14, 0, 3, 3);
-    ghostArray[2] = new Inky(15, 14, 0, 3, 3);
-    ghostArray[3] = new Clyde(17, 14, 0, 3, 3);
-    Blinky& blinky = *static_cast<Blinky*>(ghostArray[0]);
-    Pinky& pinky = *static_cast<Pinky*>(ghostArray[1]);
-    Inky& inky = *static_cast<Inky*>(ghostArray[2]);
-    Clyde& clyde = *static_cast<Clyde*>(ghostArray[3]);
+    std::uint64_t sessionSeed = (std::uint64_t)time(NULL);
+    Simulation simulation(settings.getPacmanStartX(), settings.getPacmanStartY(), sessionSeed);
+    // Вся сессия пишется с самого начала; F5 сохраняет запись для PacManHeadless --replay
+    // Запись ограничена часом игры в реальном времени; память под неё берётся сразу,
+    // чтобы игровой цикл не выделял её по ходу. По достижении предела запись просто
+    // останавливается, сохранить можно то, что успело записаться
+    Replay recorder(LevelPack::builtin().get(0), "", 0, sessionSeed, settings.getPacmanStartX(), settings.getPacmanStartY());
+    recorder.setLimit(3600LL * TICKS_PER_SECOND, 256 * 1024);
+    // F4 - играет автопилот; ищет на всех ядрах, полмиллисекунды на такт
+    ThreadPool autopilotPool;
+    AutopilotSettings autopilotSettings;
+    autopilotSettings.budgetMicros = 500;
+    autopilotSettings.seed = sessionSeed;
+    AutopilotInput autopilot(simulation, autopilotSettings, &autopilotPool);
+    bool autopilotOn = false;
+    const Map& map = simulation.getMap();
+    const Pacman& pacman = simulation.getPacman();
+
+    //цвет призрака по его поведению (GhostArchetype)
+    const sf::Color ghostColors[ARCHETYPE_COUNT] = { settings.getBlinkyColor(), settings.getPinkyColor(), settings.getInkyColor(), settings.getClydeColor() };
+
+    startupTimeline.mark("simulation ready");
+    RenderWindow window(VideoMode(settings.getGridSize() * map.getW(), settings.getGridSize() * map.getH()), settings.getWindowTitle());
+    startupTimeline.mark("window created");
 
     sf::RenderWindow windoww; //объявляем окно
 
-    // Создаем экземпляр FontManager
-    FontManager fontManager;
-
-    // Загружаем шрифт с помощью FontManager
-    auto fontPtr = fontManager.load("default_font", "Unformital Medium.ttf");
+    // Шрифт нужен для первого кадра: здесь ждём его фоновую загрузку
+    auto fontPtr = fontManager.get("default_font");
+    startupTimeline.mark("font ready");
 
     if (!fontPtr) {
         // Если загрузка шрифта не удалась, выводим ошибку и завершаем программу
+        window.close();
         windoww.create(sf::VideoMode(700, 200), "Error: Font not loaded. Press any key to close"); //создаём окно
         while (windoww.isOpen()) {
             sf::Event event;
@@ -1373,27 +795,26 @@ int main()
     }
     sf::Font& font = *fontPtr;
 
-    sf::Text pointsText;
-    pointsText.setFont(font);
-    pointsText.setCharacterSize(40);
-    pointsText.setFillColor(sf::Color::White);
-    pointsText.setPosition(2 * settings.getGridSize(), 1 * settings.getGridSize());
-    sf::Text livesText;
-    livesText.setFont(font);
-    livesText.setCharacterSize(40);
-    livesText.setFillColor(sf::Color::White);
-    livesText.setPosition(22 * settings.getGridSize(), 1 * settings.getGridSize());
     sf::Text Result;
     Result.setFont(font);
     Result.setCharacterSize(80);
     Result.setFillColor(sf::Color::White);
     Result.setPosition(5 * settings.getGridSize(), 10 * settings.getGridSize());
-    sf::Text Record;
-    Record.setFont(font);
-    Record.setCharacterSize(40);
-    Record.setFillColor(sf::Color::White);
-    Record.setPosition(11 * settings.getGridSize(), 1 * settings.getGridSize());
-    RenderWindow window(VideoMode(settings.getGridSize() * map.getW(), settings.getGridSize() * map.getH()), settings.getWindowTitle());
+    Hud hud(font, 40, sf::Color::White);
+    int scoreField = hud.addField("Score ", 2 * settings.getGridSize(), 1 * settings.getGridSize(), 6);
+    int recordField = hud.addField("Record ", 11 * settings.getGridSize(), 1 * settings.getGridSize(), 6);
+    int livesField = hud.addField("Lives ", 22 * settings.getGridSize(), 1 * settings.getGridSize(), 2);
+    // Поля производительности, включаются клавишей F1
+    Hud perfHud(font, 20, sf::Color(160, 160, 160));
+    int fpsField = perfHud.addField("FPS ", 2 * settings.getGridSize(), 33.8f * settings.getGridSize(), 6);
+    int tickRateField = perfHud.addField("Ticks/s ", 11 * settings.getGridSize(), 33.8f * settings.getGridSize(), 9);
+    // выделения памяти в секунду: в установившейся игре (без оверлея профилировщика) здесь 0
+    int allocRateField = perfHud.addField("Allocs/s ", 22 * settings.getGridSize(), 33.8f * settings.getGridSize(), 6);
+    bool showPerf = false;
+
+    // Операторы призраков показываются на копиях, игровые призраки не меняются
+    Ghost blinky = simulation.getGhost(0);
+    Ghost pinky = simulation.getGhost(1);
 
     // Операция сложения призраков:
     Ghost combinedGhost = blinky + pinky; // Combined Ghost: x = 7, y = 7
@@ -1415,78 +836,263 @@ int main()
     std::cout << "Карта: \n" << map << std::endl;
     std::cout << "Пакман: " << pacman << std::endl << std::endl; // std::endl в конце каждого блока
 
+    MaseRenderer maseRenderer;
+    SpriteBatch sprites;
+    const sf::IntRect white = textureManager.whiteRect();
+    maseRenderer.build(simulation, settings);
+    TickScheduler scheduler;
+    // Темп показа кадров: PACMAN_PACING=vsync|fixed|adaptive и PACMAN_FPS
+    // (целевая частота для fixed/adaptive и длительность пропущенного кадра в vsync).
+    // F6 переключает режим на ходу
+    PresentScheduler presenter;
+    if (const char* pacing = std::getenv("PACMAN_PACING")) {
+        PacingMode mode;
+        if (PresentScheduler::parseMode(pacing, mode))
+            presenter.setMode(mode);
+        else
+            std::cerr << "Unknown PACMAN_PACING '" << pacing << "', using " << PresentScheduler::modeName(presenter.getMode()) << std::endl;
+    }
+    if (const char* fps = std::getenv("PACMAN_FPS"))
+        presenter.setTargetFps(std::atoi(fps));
+    window.setVerticalSyncEnabled(presenter.usesVerticalSync());
+    sf::Text pausedText("Paused", font, 80);
+    pausedText.setFillColor(sf::Color::White);
+    {
+        sf::FloatRect textBounds = pausedText.getLocalBounds();
+        sf::Vector2u windowSize = window.getSize();
+        pausedText.setPosition((windowSize.x - textBounds.width) / 2, (windowSize.y - textBounds.height) / 2 - 50);
+    }
+    bool paused = false;
+    // Отпечаток видимого состояния последнего показанного кадра: кадр с тем же
+    // отпечатком не рисуется. waitingForEvent - партия окончена или на паузе и
+    // её кадр уже на экране: цикл спит в waitEvent вместо опроса
+    std::uint64_t shownFrameKey = 0;
+    bool waitingForEvent = false;
+    sf::Clock frameClock;
+    sf::Clock perfClock;
+    long long perfFrames = 0, perfTicks = 0;
+    long long perfAllocations = AllocationCounter::count();
+    int shownResult = 0;
+    int result = 0;
+    bool startupReported = false;
+#ifdef PACMAN_PROFILE
+    // Оверлей профилировщика: F2 - показать/скрыть, F3 - записать pacman_trace.json
+    sf::Text profileText;
+    profileText.setFont(font);
+    profileText.setCharacterSize(14);
+    profileText.setFillColor(sf::Color(200, 255, 200));
+    profileText.setPosition(0.5f * settings.getGridSize(), 3 * settings.getGridSize());
+    sf::Clock profileClock;
+    bool showProfile = false;
+#endif
     while (window.isOpen())
     {
-        Event event;
-        while (window.pollEvent(event))
+        int ticks = 0, direction;
+        bool forceRedraw = false;
         {
-            if (event.type == Event::Closed)
-                window.close();
-            if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::Enter) {
-                game.resetGame(map, smallFood, bigFood, pacman, ghostArray, settings, Result, fruitArray[0]);
+            PROFILE_SCOPE("Input");
+            Event event;
+            bool woken = waitingForEvent && window.waitEvent(event);
+            if (woken) {
+                // время сна не должно превратиться в такты симуляции
+                presenter.noteIdleWait();
+                frameClock.restart();
+                scheduler.reset();
+            }
+            waitingForEvent = false;
+            // событие, разбудившее цикл, обрабатывается первым, затем остальные из очереди
+            while (woken || window.pollEvent(event))
+            {
+                woken = false;
+                if (event.type == Event::Closed)
+                    window.close();
+                // содержимое окна могло пропасть: показываем кадр заново
+                if (event.type == Event::Resized || event.type == Event::GainedFocus)
+                    forceRedraw = true;
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::Enter) {
+                    simulation.reset();
+                    recorder.recordReset();
+                    scheduler.reset();
+                    result = 0;
+                    shownResult = 0;
+                    paused = false;
+                    Result.setString(" ");
+                    std::cout << "Настройки: \n" << settings << std::endl;
+                    std::cout << "Карта: \n" << map << std::endl;
+                    std::cout << "Пакман: " << pacman << std::endl << std::endl; // std::endl в конце каждого блока
+                }
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::P && !result) {
+                    paused = !paused;
+                    scheduler.reset();
+                }
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F1)
+                    showPerf = !showPerf;
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F4) {
+                    autopilotOn = !autopilotOn;
+                    std::cout << (autopilotOn ? "Autopilot on" : "Autopilot off") << std::endl;
+                }
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F5) {
+                    if (recorder.save("pacman_replay.pmr"))
+                        std::cout << "Replay written to pacman_replay.pmr (" << recorder.getSteps() << " ticks"
+                            << (recorder.isFull() ? ", recording limit reached" : "") << ")" << std::endl;
+                    else
+                        std::cerr << "Error writing pacman_replay.pmr" << std::endl;
+                }
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F6) {
+                    presenter.setMode((PacingMode)((presenter.getMode() + 1) % PACING_MODE_COUNT));
+                    window.setVerticalSyncEnabled(presenter.usesVerticalSync());
+                    std::cout << "Pacing: " << PresentScheduler::modeName(presenter.getMode()) << " (" << presenter.getTargetFps() << " fps)" << std::endl;
+                }
+#ifdef PACMAN_PROFILE
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F2)
+                    showProfile = !showProfile;
+                if (event.type == Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                    if (Profiler::writeChromeTrace("pacman_trace.json"))
+                        std::cout << "Trace written to pacman_trace.json" << std::endl;
+                    else
+                        std::cerr << "Error writing pacman_trace.json" << std::endl;
+                }
+#endif
+                // Ускоренная перемотка: 1 - x1, 2 - x10, 3 - x100, 4 - 1000 тактов на кадр
+                if (event.type == Event::KeyPressed && event.key.code >= sf::Keyboard::Num1 && event.key.code <= sf::Keyboard::Num4) {
+                    static const int multipliers[] = { 1, 10, 100 };
+                    int mode = event.key.code - sf::Keyboard::Num1;
+                    scheduler.setFrameSkip(mode == 3 ? 1000 : 0);
+                    if (mode < 3)
+                        scheduler.setFastForward(multipliers[mode]);
+                    window.setTitle(settings.getWindowTitle() + (mode == 3 ? " [1000 ticks/frame]" : " x" + std::to_string(scheduler.getFastForward())));
+                }
             }
+            // окончив партию, симуляция стоит до Enter: такты ничего бы не изменили
+            float frameSeconds = frameClock.restart().asSeconds();
+            if (!result && !paused)
+                ticks = scheduler.advance(frameSeconds);
+            direction = inputManager.getDirection();
         }
-        if (!fruitArray[0].getIsActive())
         {
-            randFruit = rand() % 5;
+            PROFILE_SCOPE("Simulation");
+            for (int t = 0; t < ticks && !result; ++t) {
+                if (autopilotOn)
+                    direction = autopilot.getDirection();
+                result = simulation.step(direction);
+                recorder.recordStep(direction, simulation);
+            }
         }
-        window.clear(Color::Black);
-        fruitArray[randFruit].createFruit(settings, map, window, smallFood);
-        map.MasePaint(settings, window, smallFood, bigFood, fruitArray[randFruit].getSprite());
-        if (pacman.WonOrLost(smallFood, bigFood, Result))
-        {
-            blinky.ghostDraw(settings.getBlinkyColor(), window, settings);
-            //combinedGhost.ghostDraw(Color::White, window, settings);
-            pinky.ghostDraw(settings.getPinkyColor(), window, settings);
-            inky.ghostDraw(settings.getInkyColor(), window, settings);
-            clyde.ghostDraw(settings.getClydeColor(), window, settings);
+        float alpha = scheduler.getAlpha();
 
-            sf::FloatRect textBounds = Result.getLocalBounds();
-            sf::Vector2u windowSize = window.getSize();
-            Result.setPosition((windowSize.x - textBounds.width) / 2, (windowSize.y - textBounds.height) / 2 - 50);
-            window.draw(Result);
-            pacman.updateMaxPoints(pacman.getPoints());
-
-        }
-        else
+        // Сначала обновляются буферы кадра, затем по их отпечатку решается, нужно ли рисовать
+        const Fruit& fruit = simulation.getFruit();
         {
-            pacman.PacmanMove(map, smallFood, bigFood, fruitArray[randFruit], ghostArray, inputManager);
-            //combinedGhost = blinky + pinky;
+            PROFILE_SCOPE("Prepare");
+            maseRenderer.update(simulation, settings);
+            sprites.clear();
+            if (fruit.getIsActive()) {
+                // картинка к первому появлению обычно уже разобрана, остаётся скопировать её в атлас
+                const sf::IntRect& source = textureManager.rect(fruitTextures[simulation.getFruitIndex()]);
+                sprites.add(source, (float)fruit.getX() * settings.getGridSize(), (float)fruit.getY() * settings.getGridSize(), (float)source.width, (float)source.height);
+            }
+            pacmanDraw(pacman, sprites, white, settings, alpha);
             //combinedGhost.ghostDraw(Color::White, window, settings);
-            blinky.BlinkyMove(pacman, map, settings, window, ghostArray);
-            pinky.PinkyMove(pacman, map, settings, window, smallFood, ghostArray);
-            inky.InkyMove(pacman, map, blinky, settings, window, ghostArray);
-            clyde.ClydeMove(pacman, map, settings, window, ghostArray);
-            if (clyde.Lose(pacman, blinky, pinky, inky))
+            const GhostStore& ghosts = simulation.getGhosts();
+            for (int i = 0; i < ghosts.size(); ++i) {
+                const Ghost ghost(ghosts, i);
+                if (result && shrinksOnGameOver((GhostArchetype)ghosts.archetype[i]))
+                    blinkyDraw(ghost, ghostColors[ghosts.archetype[i]], sprites, white, settings);
+                else
+                    ghostDraw(ghost, ghostColors[ghosts.archetype[i]], sprites, white, settings, alpha);
+            }
+            if (result && shownResult != result) {
+                // надпись раскладывается один раз за окончание партии
+                shownResult = result;
+                Result.setString(result == 1 ? "You won! " : "You lost! ");
+                sf::FloatRect textBounds = Result.getLocalBounds();
+                sf::Vector2u windowSize = window.getSize();
+                Result.setPosition((windowSize.x - textBounds.width) / 2, (windowSize.y - textBounds.height) / 2 - 50);
+            }
+            hud.set(scoreField, pacman.getPoints());
+            hud.set(livesField, pacman.getLives());
+            hud.set(recordField, simulation.getRecord());
+            // частота показанных кадров и тактов, усреднённые за секунду
+            perfTicks += ticks;
+            if (perfClock.getElapsedTime().asSeconds() >= 1.0f) {
+                float elapsed = perfClock.restart().asSeconds();
+                perfHud.set(fpsField, (long long)(perfFrames / elapsed));
+                perfHud.set(tickRateField, (long long)(perfTicks / elapsed));
+                long long allocations = AllocationCounter::count();
+                perfHud.set(allocRateField, (long long)((allocations - perfAllocations) / elapsed));
+                perfAllocations = allocations;
+                perfFrames = 0;
+                perfTicks = 0;
+            }
+        }
+        std::uint64_t frameKey = sprites.fingerprint();
+        const std::uint64_t frameParts[] = { maseRenderer.getRevision(), hud.getRevision(),
+            showPerf ? perfHud.getRevision() + 1ULL : 0ULL, (std::uint64_t)(result + 1), (std::uint64_t)paused };
+        for (std::uint64_t part : frameParts)
+            frameKey = (frameKey ^ part) * 1099511628211ULL;
+        bool redraw = forceRedraw || !startupReported || frameKey != shownFrameKey;
+#ifdef PACMAN_PROFILE
+        // строки оверлея меняются по таймеру, с ним кадры рисуются всегда
+        redraw = redraw || showProfile;
+#endif
+        if (redraw) {
+            window.clear(Color::Black);
             {
-                if (pacman.getLives())
-                {
-                    blinky.setAll(11, 14, 0, 3, 3);
-                    pinky.setAll(13, 14, 0, 3, 3);
-                    inky.setAll(15, 14, 0, 3, 3);
-                    clyde.setAll(17, 14, 0, 3, 3);
-                    map.setTile(pacman.getY(), pacman.getX(), ' ');
-                    map.setTile(settings.getPacmanStartY(), settings.getPacmanStartX(), 'P');
-                    pacman.setX(settings.getPacmanStartX());
-                    pacman.setY(settings.getPacmanStartY());
-                    pacman.setNextX(settings.getPacmanStartX());
-                    pacman.setNextY(settings.getPacmanStartY());
-                    pacman.setScore(0);
-                    pacman.setNextDirection(3);
+                PROFILE_SCOPE("MasePaint");
+                maseRenderer.paint(window);
+            }
+            {
+                PROFILE_SCOPE("Sprites");
+                sprites.draw(window, textureManager.getAtlas());
+            }
+            {
+                PROFILE_SCOPE("Text");
+                if (result)
+                    window.draw(Result);
+                else if (paused)
+                    window.draw(pausedText);
+                hud.draw(window);
+                if (showPerf)
+                    perfHud.draw(window);
+            }
+#ifdef PACMAN_PROFILE
+            if (showProfile) {
+                // строки оверлея пересобираются дважды в секунду, а не каждый кадр
+                if (profileClock.getElapsedTime().asSeconds() >= 0.5f) {
+                    profileClock.restart();
+                    std::ostringstream lines;
+                    lines.precision(1);
+                    lines << std::fixed << std::left << std::setw(12) << "phase" << std::right
+                        << std::setw(9) << "p50us" << std::setw(9) << "p99us" << std::setw(9) << "maxus" << "\n";
+                    for (int phase = 0; phase < Profiler::getPhaseCount(); ++phase) {
+                        Profiler::PhaseStats stats = Profiler::getStats(phase);
+                        lines << std::left << std::setw(12) << stats.name << std::right
+                            << std::setw(9) << stats.p50Us << std::setw(9) << stats.p99Us << std::setw(9) << stats.maxUs << "\n";
+                    }
+                    profileText.setString(lines.str());
                 }
+                window.draw(profileText);
             }
+#endif
+            {
+                PROFILE_SCOPE("Display");
+                window.display();
+            }
+            shownFrameKey = frameKey;
+            perfFrames++;
+        }
+        if (!startupReported) {
+            startupTimeline.mark("first frame presented");
+            startupTimeline.report(std::cout);
+            startupReported = true;
+        }
+        {
+            PROFILE_SCOPE("Pacing");
+            presenter.endFrame(redraw);
         }
-        pointsText.setString("Score " + std::to_string(pacman.getPoints()));
-        livesText.setString("Lives " + std::to_string(pacman.getLives()));
-        Record.setString("Record " + std::to_string(pacman.getMaxPoints()));
-        window.draw(pointsText);
-        window.draw(livesText);
-        window.draw(Record);
-        window.display();
+        // кадр окончившейся или остановленной партии показан: дальше только события
+        waitingForEvent = result || paused;
     }
     delete[] settingsArray;
-    for (int i = 0; i < 4; ++i)
-        delete ghostArray[i];
-    delete[] ghostArray;
     return 0;
 }
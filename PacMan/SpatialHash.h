@@ -0,0 +1,49 @@
+﻿#pragma once
+// Равномерная сетка корзин поверх лабиринта для запросов "кто рядом".
+// Перестраивается целиком за два прохода (подсчёт и раскладка), без
+// выделения памяти после первого построения: корзина - отрезок в общем
+// массиве номеров.
+#include <vector>
+
+class SpatialHash {
+private:
+    int cellSize;               // сторона корзины в клетках лабиринта
+    int columns, rows;
+    std::vector<int> bucketStart;   // начало корзины в entries; размер корзин + 1
+    std::vector<int> entries;       // номера объектов, сгруппированные по корзинам
+    std::vector<int> cursor;        // место записи в каждую корзину при раскладке
+
+    int bucketColumn(int x) const { return x < 0 ? 0 : x / cellSize >= columns ? columns - 1 : x / cellSize; }
+    int bucketRow(int y) const { return y < 0 ? 0 : y / cellSize >= rows ? rows - 1 : y / cellSize; }
+public:
+    explicit SpatialHash(int cellSize = 4) : cellSize(cellSize), columns(1), rows(1), bucketStart(2, 0) {}
+
+    // Раскладывает n объектов с координатами x[i], y[i] по корзинам сетки width x height.
+    // Внутри корзины номера идут по возрастанию.
+    void build(const int* x, const int* y, int n, int width, int height) {
+        columns = (width + cellSize - 1) / cellSize;
+        rows = (height + cellSize - 1) / cellSize;
+        const int buckets = columns * rows;
+        bucketStart.assign(buckets + 1, 0);
+        for (int i = 0; i < n; ++i)
+            bucketStart[bucketRow(y[i]) * columns + bucketColumn(x[i]) + 1]++;
+        for (int b = 0; b < buckets; ++b)
+            bucketStart[b + 1] += bucketStart[b];
+        cursor.assign(bucketStart.begin(), bucketStart.end() - 1);
+        entries.resize(n);
+        for (int i = 0; i < n; ++i)
+            entries[cursor[bucketRow(y[i]) * columns + bucketColumn(x[i])]++] = i;
+    }
+
+    // fn(i) для всех объектов из корзин, задевающих прямоугольник [minX, maxX] x [minY, maxY].
+    // Это кандидаты: точное попадание проверяет вызывающий.
+    template <typename F>
+    void query(int minX, int minY, int maxX, int maxY, F fn) const {
+        for (int row = bucketRow(minY); row <= bucketRow(maxY); ++row)
+            for (int column = bucketColumn(minX); column <= bucketColumn(maxX); ++column) {
+                int b = row * columns + column;
+                for (int k = bucketStart[b]; k < bucketStart[b + 1]; ++k)
+                    fn(entries[k]);
+            }
+    }
+};
@@ -0,0 +1,140 @@
+﻿#include "ThreadPool.h"
+
+namespace {
+// Номер рабочего потока текущего пула, -1 вне пула
+thread_local int currentWorker = -1;
+thread_local const ThreadPool* currentPool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) : queued(0), unfinished(0), nextQueue(0), stopping(false)
+{
+    if (!threadCount)
+        threadCount = std::thread::hardware_concurrency();
+    if (!threadCount)
+        threadCount = 1;
+    for (unsigned i = 0; i < threadCount; ++i)
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    for (unsigned i = 0; i < threadCount; ++i)
+        threads.emplace_back(&ThreadPool::workerLoop, this, (int)i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    unsigned target = currentPool == this ? (unsigned)currentWorker : nextQueue++ % (unsigned)queues.size();
+    unfinished++;
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // под sleepMutex, чтобы засыпающий поток не пропустил сигнал
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::runOne(int self)
+{
+    std::function<void()> task;
+    const int n = (int)queues.size();
+    if (self >= 0) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.pop_back();
+        }
+    }
+    for (int i = 1; !task && i <= n; ++i) {
+        Queue& victim = *queues[(self + i + n) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.pop_front();
+        }
+    }
+    if (!task)
+        return false;
+    queued--;
+    task();
+    if (--unfinished == 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        idle.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(int self)
+{
+    currentWorker = self;
+    currentPool = this;
+    for (;;) {
+        if (runOne(self))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return queued > 0 || stopping; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+void ThreadPool::wait()
+{
+    int self = currentPool == this ? currentWorker : -1;
+    while (unfinished > 0) {
+        if (runOne(self))
+            continue;
+        // остальное уже выполняется в других потоках
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this] { return unfinished == 0 || queued > 0; });
+    }
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const std::function<void(int)>& fn)
+{
+    if (begin >= end)
+        return;
+    if (grain < 1)
+        grain = 1;
+    Batch batch;
+    batch.pool = this;
+    batch.fn = &fn;
+    batch.end = end;
+    batch.grain = grain;
+    batch.pending = (end - begin + grain - 1) / grain;
+    // в задаче только указатель на batch и начало куска: std::function
+    // хранит их без выделения памяти
+    Batch* shared = &batch;
+    for (int first = begin; first < end; first += grain)
+        submit([shared, first] {
+            int last = shared->end - first > shared->grain ? first + shared->grain : shared->end;
+            for (int i = first; i < last; ++i)
+                (*shared->fn)(i);
+            // после уменьшения счётчика batch может уже не существовать
+            ThreadPool* pool = shared->pool;
+            if (--shared->pending == 0) {
+                std::lock_guard<std::mutex> lock(pool->sleepMutex);
+                pool->idle.notify_all();
+            }
+        });
+
+    int self = currentPool == this ? currentWorker : -1;
+    while (batch.pending > 0) {
+        if (runOne(self))
+            continue;
+        // свои куски уже выполняются в других потоках
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this, &batch] { return batch.pending == 0 || queued > 0; });
+    }
+}
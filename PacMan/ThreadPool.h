@@ -0,0 +1,93 @@
+﻿#pragma once
+// Пул потоков с перехватом задач (work stealing). У каждого рабочего потока
+// своя очередь: свои задачи он берёт с конца (последние добавленные ещё в
+// кэше), а опустевший поток забирает задачи с начала чужих очередей. Так
+// длинные и короткие партии сами распределяются по ядрам без общей очереди,
+// за которую дрались бы все потоки.
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+    // Кольцевой буфер задач. std::deque при движении очереди то выделяет,
+    // то освобождает блоки; кольцо растёт только при переполнении, а в
+    // установившемся режиме память не трогает
+    class TaskRing {
+    private:
+        std::vector<std::function<void()>> slots;
+        std::size_t head = 0, count = 0;
+        std::function<void()>& at(std::size_t i) { return slots[(head + i) % slots.size()]; }
+    public:
+        bool empty() const { return count == 0; }
+        void push_back(std::function<void()>&& task) {
+            if (count == slots.size()) {
+                std::vector<std::function<void()>> grown(slots.empty() ? 16 : slots.size() * 2);
+                for (std::size_t i = 0; i < count; ++i)
+                    grown[i] = std::move(at(i));
+                slots.swap(grown);
+                head = 0;
+            }
+            slots[(head + count) % slots.size()] = std::move(task);
+            count++;
+        }
+        std::function<void()> pop_back() {
+            return std::move(at(--count));
+        }
+        std::function<void()> pop_front() {
+            std::function<void()> task = std::move(slots[head]);
+            head = (head + 1) % slots.size();
+            count--;
+            return task;
+        }
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        TaskRing tasks;
+    };
+
+    // Задачи одного parallelFor: ждущий поток следит только за своим счётчиком
+    struct Batch {
+        ThreadPool* pool;
+        const std::function<void(int)>* fn;
+        int end, grain;
+        std::atomic<int> pending;   // кусков ещё не выполнено
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued;        // задач в очередях
+    std::atomic<int> unfinished;    // задач отправлено и ещё не выполнено
+    std::atomic<unsigned> nextQueue;
+    std::mutex sleepMutex;
+    std::condition_variable wake;   // появились задачи или пул останавливается
+    std::condition_variable idle;   // все задачи или все куски какого-то parallelFor выполнены
+    bool stopping;
+
+    // Берёт задачу из своей очереди или крадёт у соседей; self < 0 - чужой поток
+    bool runOne(int self);
+    void workerLoop(int self);
+public:
+    // threads == 0 - по числу аппаратных потоков
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)threads.size(); }
+    // Из рабочего потока задача попадает в его же очередь, извне - по кругу
+    void submit(std::function<void()> task);
+    // Ждёт выполнения всех задач пула, помогая их выполнять. Только извне
+    // пула: из задачи не вызывать - в числе невыполненных и она сама, и
+    // ожидание не закончится
+    void wait();
+    // fn(i) для всех i из [begin, end), кусками по grain. Ждёт только свои
+    // куски (помогая выполнять любые задачи), поэтому можно вызывать из задачи
+    // пула и из нескольких потоков сразу
+    void parallelFor(int begin, int end, int grain, const std::function<void(int)>& fn);
+};
@@ -0,0 +1,44 @@
+﻿#pragma once
+// Планировщик фиксированного шага: копит реальное время кадров и отдаёт
+// целое число тактов симуляции. Остаток такта используется для интерполяции.
+#include "Simulation.h"
+
+class TickScheduler {
+private:
+    double accumulator;     // накопленное, но ещё не отсимулированное время, с
+    int fastForward;        // множитель скорости (1 - реальное время)
+    int frameSkip;          // если > 0, ровно столько тактов на кадр без учёта времени
+    int maxTicksPerFrame;   // защита от "спирали смерти" на медленной машине
+public:
+    TickScheduler(int maxTicksPerFrame = 2000) : accumulator(0), fastForward(1), frameSkip(0), maxTicksPerFrame(maxTicksPerFrame) {}
+
+    int getFastForward() const { return fastForward; }
+    int getFrameSkip() const { return frameSkip; }
+    void setFastForward(int multiplier) { fastForward = multiplier > 0 ? multiplier : 1; }
+    void setFrameSkip(int ticksPerFrame) { frameSkip = ticksPerFrame > 0 ? ticksPerFrame : 0; }
+    void reset() { accumulator = 0; }
+
+    // Сколько тактов выполнить за кадр длительностью frameSeconds
+    int advance(double frameSeconds) {
+        if (frameSkip > 0)
+            return frameSkip;
+        const double tick = 1.0 / TICKS_PER_SECOND;
+        accumulator += frameSeconds * fastForward;
+        int ticks = (int)(accumulator / tick);
+        if (ticks > maxTicksPerFrame) {
+            // не успеваем: отбрасываем лишнее время вместо бесконечного догоняния
+            ticks = maxTicksPerFrame;
+            accumulator = 0;
+        }
+        else
+            accumulator -= ticks * tick;
+        return ticks;
+    }
+
+    // Доля следующего такта, уже прошедшая в реальном времени, [0, 1)
+    float getAlpha() const {
+        if (frameSkip > 0)
+            return 0.0f;
+        return (float)(accumulator * TICKS_PER_SECOND);
+    }
+};